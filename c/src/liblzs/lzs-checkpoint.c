@@ -0,0 +1,264 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief LZS Checkpoint Index
+ *
+ * This implements an index of checkpoints for an LZS stream, kept in a
+ * separate file beside it. Each checkpoint has the state of incremental
+ * decompression at one position in the decompressed data, including the
+ * history, so decompression can be resumed from there without decompressing
+ * the data before it. With a checkpoint every interval bytes, reading a range
+ * of the data costs up to interval bytes of extra decompression, instead of
+ * all the data before it. Ranges can be decompressed in parallel from
+ * different checkpoints.
+ *
+ * The index is made by decompressing the stream once with
+ * lzs_decompress_incremental(), stopping every interval bytes of output to
+ * call lzs_decompress_save_checkpoint().
+ *
+ * Layout, with all multi-byte fields little-endian:
+ *
+ *     Index header (LZS_CHECKPOINT_HEADER_SIZE bytes):
+ *         magic           4   0x89 'L' 'Z' 'C'
+ *         version         1   LZS_CHECKPOINT_VERSION
+ *         reserved        3   0
+ *         interval        4   Decompressed bytes between checkpoints
+ *
+ *     Checkpoints, each LZS_CHECKPOINT_SIZE bytes:
+ *         out position    8   Position in the decompressed data
+ *         in position     8   Position in the compressed data to resume reading from
+ *         bit count       1   Number of bits before the in position still to be decoded
+ *         bits            1   Those bits, in the most significant bits
+ *         state           1   Decompression state, one of the codes 0 to 8
+ *         length          1
+ *         offset          2
+ *         history length  2
+ *         history         LZS_MAX_HISTORY_SIZE bytes, of which the first
+ *                         history length are the last decompressed bytes,
+ *                         oldest first, and the rest are 0
+ *
+ * Checkpoint k is at out position k * interval, so a reader can go straight
+ * to the one before any position.
+ *
+ * This code is licensed according to the MIT license as follows:
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2017 Craig McQueen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ----------------------------------------------------------------------------
+ ****************************************************************************/
+
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include "lzs.h"
+#include "lzs-common.h"
+
+#include <stdint.h>
+
+
+/*****************************************************************************
+ * Defines
+ ****************************************************************************/
+
+#define CHECKPOINT_MAGIC_0          0x89u
+#define CHECKPOINT_MAGIC_1          'L'
+#define CHECKPOINT_MAGIC_2          'Z'
+#define CHECKPOINT_MAGIC_3          'C'
+
+#define ARRAY_ENTRIES(a)            (sizeof(a)/sizeof((a)[0]))
+
+
+/*****************************************************************************
+ * Tables
+ ****************************************************************************/
+
+// Decompression state for each state code in a checkpoint. The codes are part
+// of the index format, so they mustn't change when LzsDecompressState_t does.
+static const uint8_t checkpoint_states[] =
+{
+    DECOMPRESS_COPY_DATA,
+    DECOMPRESS_GET_TOKEN_TYPE,
+    DECOMPRESS_GET_LITERAL,
+    DECOMPRESS_GET_OFFSET_TYPE,
+    DECOMPRESS_GET_OFFSET_SHORT,
+    DECOMPRESS_GET_OFFSET_LONG,
+    DECOMPRESS_GET_LENGTH,
+    DECOMPRESS_COPY_EXTENDED_DATA,
+    DECOMPRESS_GET_EXTENDED_LENGTH
+};
+
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+/*
+ * \brief Write an index header
+ *
+ * Writes LZS_CHECKPOINT_HEADER_SIZE bytes, and returns that size.
+ */
+size_t lzs_checkpoint_write_header(uint8_t * pOut, uint32_t interval)
+{
+    pOut[0] = CHECKPOINT_MAGIC_0;
+    pOut[1] = CHECKPOINT_MAGIC_1;
+    pOut[2] = CHECKPOINT_MAGIC_2;
+    pOut[3] = CHECKPOINT_MAGIC_3;
+    pOut[4] = LZS_CHECKPOINT_VERSION;
+    pOut[5] = 0;
+    pOut[6] = 0;
+    pOut[7] = 0;
+    lzs_store_le32(pOut + 8u, interval);
+    return LZS_CHECKPOINT_HEADER_SIZE;
+}
+
+/*
+ * \brief Read and check an index header
+ *
+ * Returns false if there are fewer than LZS_CHECKPOINT_HEADER_SIZE bytes, or
+ * they aren't an index header of a version that this code supports.
+ */
+bool lzs_checkpoint_read_header(const uint8_t * pIn, size_t inLen, uint32_t * pInterval)
+{
+    if (
+            (inLen < LZS_CHECKPOINT_HEADER_SIZE) ||
+            (pIn[0] != CHECKPOINT_MAGIC_0) ||
+            (pIn[1] != CHECKPOINT_MAGIC_1) ||
+            (pIn[2] != CHECKPOINT_MAGIC_2) ||
+            (pIn[3] != CHECKPOINT_MAGIC_3) ||
+            (pIn[4] != LZS_CHECKPOINT_VERSION) ||
+            (pIn[5] != 0) ||
+            (pIn[6] != 0) ||
+            (pIn[7] != 0)
+       )
+    {
+        return false;
+    }
+    *pInterval = lzs_load_le32(pIn + 8u);
+    return (*pInterval != 0);
+}
+
+/*
+ * \brief Write a checkpoint
+ *
+ * Writes LZS_CHECKPOINT_SIZE bytes, and returns that size.
+ */
+size_t lzs_checkpoint_write(uint8_t * pOut, const LzsCheckpoint_t * pCheckpoint)
+{
+    uint8_t             stateCode;
+
+    // A state that isn't valid gets a code that isn't either
+    for (stateCode = 0; stateCode < ARRAY_ENTRIES(checkpoint_states); stateCode++)
+    {
+        if (checkpoint_states[stateCode] == pCheckpoint->state)
+        {
+            break;
+        }
+    }
+    lzs_store_le64(pOut, pCheckpoint->outPos);
+    lzs_store_le64(pOut + 8u, pCheckpoint->inPos);
+    pOut[16] = pCheckpoint->bitCount;
+    pOut[17] = pCheckpoint->bits;
+    pOut[18] = stateCode;
+    pOut[19] = pCheckpoint->length;
+    lzs_store_le16(pOut + 20u, pCheckpoint->offset);
+    lzs_store_le16(pOut + 22u, pCheckpoint->historyLen);
+    memcpy(pOut + 24u, pCheckpoint->history, pCheckpoint->historyLen);
+    memset(pOut + 24u + pCheckpoint->historyLen, 0, LZS_MAX_HISTORY_SIZE - pCheckpoint->historyLen);
+    return LZS_CHECKPOINT_SIZE;
+}
+
+/*
+ * \brief Read a checkpoint
+ *
+ * Reads LZS_CHECKPOINT_SIZE bytes. Returns false if the state code isn't
+ * known, or the history length is too big. Other checks are done by
+ * lzs_decompress_restore_checkpoint().
+ */
+bool lzs_checkpoint_read(const uint8_t * pIn, LzsCheckpoint_t * pCheckpoint)
+{
+    pCheckpoint->outPos = lzs_load_le64(pIn);
+    pCheckpoint->inPos = lzs_load_le64(pIn + 8u);
+    pCheckpoint->bitCount = pIn[16];
+    pCheckpoint->bits = pIn[17];
+    if (pIn[18] >= ARRAY_ENTRIES(checkpoint_states))
+    {
+        return false;
+    }
+    pCheckpoint->state = checkpoint_states[pIn[18]];
+    pCheckpoint->length = pIn[19];
+    pCheckpoint->offset = lzs_load_le16(pIn + 20u);
+    pCheckpoint->historyLen = lzs_load_le16(pIn + 22u);
+    if (pCheckpoint->historyLen > LZS_MAX_HISTORY_SIZE)
+    {
+        return false;
+    }
+    memcpy(pCheckpoint->history, pIn + 24u, pCheckpoint->historyLen);
+    return true;
+}
+
+/*
+ * \brief Resume incremental decompression from the checkpoint nearest before a position
+ *
+ * pCheckpoints must be in order of outPos. This finds the last one that is at
+ * or before outPos in the decompressed data, and restores pParams from it
+ * with lzs_decompress_restore_checkpoint(). Then the compressed data should be
+ * input from the checkpoint's inPos, and the first (outPos - its outPos)
+ * bytes of output skipped.
+ *
+ * Returns the checkpoint, or NULL if there is none before outPos. Then pParams
+ * is initialised to decompress from the start of the stream, and any
+ * dictionary should be set again. It also returns NULL if the checkpoint isn't
+ * valid, with LZS_D_STATUS_ERROR in pParams->status.
+ */
+const LzsCheckpoint_t * lzs_decompress_seek(LzsDecompressParameters_t * pParams, const LzsCheckpoint_t * pCheckpoints,
+                                            size_t numCheckpoints, uint64_t outPos)
+{
+    size_t              low = 0;
+    size_t              high = numCheckpoints;
+    size_t              mid;
+
+    // Find the first checkpoint after outPos
+    while (low < high)
+    {
+        mid = low + (high - low) / 2u;
+        if (pCheckpoints[mid].outPos <= outPos)
+        {
+            low = mid + 1u;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    lzs_decompress_init(pParams);
+    if (low == 0)
+    {
+        return NULL;
+    }
+    if (!lzs_decompress_restore_checkpoint(pParams, &pCheckpoints[low - 1u]))
+    {
+        pParams->status = LZS_D_STATUS_ERROR;
+        return NULL;
+    }
+    return &pCheckpoints[low - 1u];
+}
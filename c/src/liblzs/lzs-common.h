@@ -31,6 +31,20 @@
 #ifndef __LZS_COMMON_H
 #define __LZS_COMMON_H
 
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
 /*****************************************************************************
  * Implementation Defines
  ****************************************************************************/
@@ -38,7 +52,12 @@
 #define SHORT_OFFSET_BITS           7u
 #define LONG_OFFSET_BITS            11u
 #define EXTENDED_LENGTH_BITS        4u
-#define BIT_QUEUE_BITS              32u
+#define BIT_QUEUE64_BITS            64u
+
+// Single-call compression only copies bits from the bit field queue to the
+// output when there are at least this many. The longest token without
+// extended lengths, 17 bits, still fits in the queue after that.
+#define BIT_QUEUE_FLUSH_BITS        40u
 
 #define SHORT_OFFSET_MAX            ((1u << SHORT_OFFSET_BITS) - 1u)
 #define LONG_OFFSET_MAX             ((1u << LONG_OFFSET_BITS) - 1u)
@@ -52,13 +71,170 @@
 #define MAX_SHORT_LENGTH            8u
 #define MAX_EXTENDED_LENGTH         ((1u << EXTENDED_LENGTH_BITS) - 1u)
 
+// Multiplier for multiplicative hashing of input bytes, from Knuth (2^32 / phi).
+#define HASH_MULT_MULTIPLIER        2654435761u
+
 #define LZSMIN(X,Y)                 (((X) < (Y)) ? (X) : (Y))
+#define LZSMAX(X,Y)                 (((X) > (Y)) ? (X) : (Y))
+
+// Use word-at-a-time compare in lzs_common_prefix(), if the compiler supports it.
+#if defined(__GNUC__) && defined(__BYTE_ORDER__)
+#define LZS_COMMON_PREFIX_WORDS     1
+#else
+#define LZS_COMMON_PREFIX_WORDS     0
+#endif
+
+// Force inlining of a function, so it can be specialised for constant arguments.
+#if defined(__GNUC__)
+#define LZS_ALWAYS_INLINE           inline __attribute__((always_inline))
+#else
+#define LZS_ALWAYS_INLINE           inline
+#endif
+
+// Library-internal functions that are shared between source files. They are
+// hidden, so the shared library doesn't export them as part of its ABI.
+#if defined(__GNUC__)
+#define LZS_INTERNAL                __attribute__((visibility("hidden")))
+#else
+#define LZS_INTERNAL
+#endif
+
+
+/*****************************************************************************
+ * Typedefs
+ ****************************************************************************/
+
+// Bit code of an offset/length token, for one type of offset and one length.
+// The offset goes in at bit 'shift' of the code. For MAX_SHORT_LENGTH, it is
+// only the first part of the token; the extended lengths follow it.
+typedef struct
+{
+    uint32_t            code;
+    uint8_t             width;
+    uint8_t             shift;
+} LzsTokenCode_t;
+
+// State of incremental decompression. Checkpoints save it, so the index
+// format maps it to codes of its own (see lzs-checkpoint.c).
+typedef enum
+{
+    DECOMPRESS_COPY_DATA,           // Must come before DECOMPRESS_GET_TOKEN_TYPE, so state transition can be done by increment
+    DECOMPRESS_GET_TOKEN_TYPE,
+    DECOMPRESS_GET_LITERAL,
+    DECOMPRESS_GET_OFFSET_TYPE,
+    DECOMPRESS_GET_OFFSET_SHORT,
+    DECOMPRESS_GET_OFFSET_LONG,
+    DECOMPRESS_GET_LENGTH,
+    DECOMPRESS_COPY_EXTENDED_DATA,  // Must come before DECOMPRESS_GET_EXTENDED_LENGTH, so state transition can be done by increment
+    DECOMPRESS_GET_EXTENDED_LENGTH,
+
+    NUM_DECOMPRESS_STATES
+} LzsDecompressState_t;
+
+
+/*****************************************************************************
+ * Tables
+ ****************************************************************************/
+
+/* Length is encoded as:
+ *  0b00 --> 2
+ *  0b01 --> 3
+ *  0b10 --> 4
+ *  0b1100 --> 5
+ *  0b1101 --> 6
+ *  0b1110 --> 7
+ *  0b1111 xxxx --> 8 (extended)
+ */
+static const uint8_t length_value[MAX_SHORT_LENGTH + 1u] =
+{
+    0,
+    0,
+    0x0,
+    0x1,
+    0x2,
+    0xC,
+    0xD,
+    0xE,
+    0xF
+};
+
+static const uint8_t length_width[MAX_SHORT_LENGTH + 1u] =
+{
+    0,
+    0,
+    2,
+    2,
+    2,
+    4,
+    4,
+    4,
+    4,
+};
+
+/* Offset/length token codes, indexed by [long offset][length].
+ * 1 bit indicates offset/length token, then 1 bit indicates short (1) or
+ * long (0) offset, then the offset, then the length. */
+#define TOKEN_CODE(PREFIX, OFFSET_BITS, LENGTH_VALUE, LENGTH_WIDTH) \
+    { ((uint32_t)(PREFIX) << ((OFFSET_BITS) + (LENGTH_WIDTH))) | (LENGTH_VALUE), \
+      2u + (OFFSET_BITS) + (LENGTH_WIDTH), (LENGTH_WIDTH) }
+
+static const LzsTokenCode_t tokenEncodeTable[2][MAX_SHORT_LENGTH + 1u] =
+{
+    {
+        { 0, 0, 0 },
+        { 0, 0, 0 },
+        TOKEN_CODE(3u, SHORT_OFFSET_BITS, 0x0u, 2u),
+        TOKEN_CODE(3u, SHORT_OFFSET_BITS, 0x1u, 2u),
+        TOKEN_CODE(3u, SHORT_OFFSET_BITS, 0x2u, 2u),
+        TOKEN_CODE(3u, SHORT_OFFSET_BITS, 0xCu, 4u),
+        TOKEN_CODE(3u, SHORT_OFFSET_BITS, 0xDu, 4u),
+        TOKEN_CODE(3u, SHORT_OFFSET_BITS, 0xEu, 4u),
+        TOKEN_CODE(3u, SHORT_OFFSET_BITS, 0xFu, 4u),
+    },
+    {
+        { 0, 0, 0 },
+        { 0, 0, 0 },
+        TOKEN_CODE(2u, LONG_OFFSET_BITS, 0x0u, 2u),
+        TOKEN_CODE(2u, LONG_OFFSET_BITS, 0x1u, 2u),
+        TOKEN_CODE(2u, LONG_OFFSET_BITS, 0x2u, 2u),
+        TOKEN_CODE(2u, LONG_OFFSET_BITS, 0xCu, 4u),
+        TOKEN_CODE(2u, LONG_OFFSET_BITS, 0xDu, 4u),
+        TOKEN_CODE(2u, LONG_OFFSET_BITS, 0xEu, 4u),
+        TOKEN_CODE(2u, LONG_OFFSET_BITS, 0xFu, 4u),
+    },
+};
+
+#undef TOKEN_CODE
+
+
+/*****************************************************************************
+ * Function prototypes
+ ****************************************************************************/
+
+// Library-internal: used by lzs_compress_parallel().
+LZS_INTERNAL size_t lzs_compress_segment(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen,
+                                         size_t primeLen, uint8_t level, size_t * pBitCount);
+
+// Library-internal: used by lzs_compress_parallel_search().
+LZS_INTERNAL uint_fast8_t lzs_search_matches_per_position(uint8_t level, size_t a_inLen);
+LZS_INTERNAL void lzs_search_heads(const uint8_t * a_pInData, size_t a_inLen, size_t start, size_t end, uint16_t * pHeads);
+LZS_INTERNAL void lzs_search_matches(const uint8_t * a_pInData, size_t a_inLen, size_t start, size_t end, uint8_t level,
+                                     const uint16_t * pHeads, uint16_t * pMatches);
+LZS_INTERNAL size_t lzs_compress_matches(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen,
+                                         uint8_t level, const uint16_t * pMatches);
 
 
 /*****************************************************************************
  * Inline Functions
  ****************************************************************************/
 
+// Return hash of two input bytes, modulo INPUT_HASH_SIZE. It is the default
+// hash of the match finders.
+static inline lzs_input_hash_t inputs_hash(uint8_t a, uint8_t b)
+{
+    return (((lzs_input_hash_t)a << 4u) ^ (lzs_input_hash_t)b) % INPUT_HASH_SIZE;
+}
+
 static inline uint_fast16_t lzs_idx_inc_wrap(uint_fast16_t idx, uint_fast16_t inc, uint_fast16_t array_size)
 {
     uint_fast16_t new_idx;
@@ -105,5 +281,261 @@ static inline uint_fast16_t lzs_idx_delta2_wrap(uint_fast16_t idx1, uint_fast16_
     return idx1 - idx2;
 }
 
+// Return a multiplicative hash of two input bytes a and b, of hashBits bits.
+static inline uint_fast16_t lzs_hash_mult2(uint8_t a, uint8_t b, uint_fast8_t hashBits)
+{
+    return (uint32_t)((((uint32_t)a << 8u) | b) * HASH_MULT_MULTIPLIER) >> (32u - hashBits);
+}
+
+// Load 8 bytes of big-endian data from a possibly unaligned address.
+static inline uint64_t lzs_load_be64(const uint8_t * pData)
+{
+#if defined(__GNUC__) && defined(__BYTE_ORDER__)
+    uint64_t        value;
+
+    memcpy(&value, pData, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+#else
+    return ((uint64_t)pData[0] << 56u) | ((uint64_t)pData[1] << 48u) |
+           ((uint64_t)pData[2] << 40u) | ((uint64_t)pData[3] << 32u) |
+           ((uint64_t)pData[4] << 24u) | ((uint64_t)pData[5] << 16u) |
+           ((uint64_t)pData[6] << 8u)  | (uint64_t)pData[7];
+#endif
+}
+
+// Store 8 bytes of big-endian data to a possibly unaligned address.
+static inline void lzs_store_be64(uint8_t * pData, uint64_t value)
+{
+#if defined(__GNUC__) && defined(__BYTE_ORDER__)
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    memcpy(pData, &value, sizeof(value));
+#else
+    uint_fast8_t    i;
+
+    for (i = 0; i < sizeof(value); i++)
+    {
+        pData[i] = (uint8_t)(value >> (56u - 8u * i));
+    }
+#endif
+}
+
+// Store and load little-endian values of the sizes used in saved
+// dictionaries, the framed container and the checkpoint index, byte by byte.
+static inline void lzs_store_le16(uint8_t * pData, uint16_t value)
+{
+    pData[0] = (uint8_t)value;
+    pData[1] = (uint8_t)(value >> 8u);
+}
+
+static inline uint16_t lzs_load_le16(const uint8_t * pData)
+{
+    return (uint16_t)(pData[0] | (pData[1] << 8u));
+}
+
+static inline void lzs_store_le32(uint8_t * pData, uint32_t value)
+{
+    pData[0] = (uint8_t)value;
+    pData[1] = (uint8_t)(value >> 8u);
+    pData[2] = (uint8_t)(value >> 16u);
+    pData[3] = (uint8_t)(value >> 24u);
+}
+
+static inline uint32_t lzs_load_le32(const uint8_t * pData)
+{
+    return (uint32_t)pData[0] |
+            ((uint32_t)pData[1] << 8u) |
+            ((uint32_t)pData[2] << 16u) |
+            ((uint32_t)pData[3] << 24u);
+}
+
+static inline void lzs_store_le64(uint8_t * pData, uint64_t value)
+{
+    lzs_store_le32(pData, (uint32_t)value);
+    lzs_store_le32(pData + 4u, (uint32_t)(value >> 32u));
+}
+
+static inline uint64_t lzs_load_le64(const uint8_t * pData)
+{
+    return (uint64_t)lzs_load_le32(pData) | ((uint64_t)lzs_load_le32(pData + 4u) << 32u);
+}
+
+// Copy whole bytes from a bit field queue for output, to the output buffer.
+// The queue is right-aligned, with bitFieldQueueLen bits in it. Copy at most
+// outSpace bytes. Return the number of bytes copied; the caller takes 8 bits
+// off bitFieldQueueLen for each one.
+// If there are at least 8 bytes of output space, it is done with one 8-byte
+// store. Then the bytes after the ones that are copied are overwritten too.
+static inline uint_fast8_t lzs_bit_queue_flush(uint8_t * pOut, size_t outSpace,
+                                               uint64_t bitFieldQueue, uint_fast8_t bitFieldQueueLen)
+{
+    uint_fast8_t    count;
+    uint_fast8_t    i;
+
+    count = bitFieldQueueLen / 8u;
+    if (count == 0)
+    {
+        return 0;
+    }
+    if (outSpace >= sizeof(uint64_t))
+    {
+        lzs_store_be64(pOut, bitFieldQueue << (BIT_QUEUE64_BITS - bitFieldQueueLen));
+        return count;
+    }
+    count = LZSMIN(count, outSpace);
+    for (i = 0; i < count; i++)
+    {
+        bitFieldQueueLen -= 8u;
+        pOut[i] = (uint8_t)(bitFieldQueue >> bitFieldQueueLen);
+    }
+    return count;
+}
+
+// Return the bit field queue for output, with the first part of an
+// offset/length token added to it: up to the length, or up to the first
+// extended length for lengths of MAX_SHORT_LENGTH or more.
+// Add the width of it, tokenEncodeTable[][].width, to bitFieldQueueLen.
+static inline uint64_t lzs_bit_queue_token(uint64_t bitFieldQueue, const LzsTokenCode_t * pTokenCode,
+                                           uint_fast16_t offset)
+{
+    return (bitFieldQueue << pTokenCode->width) | pTokenCode->code | ((uint64_t)offset << pTokenCode->shift);
+}
+
+// Load the first numBits bits (8 to 64) of 8 bytes of big-endian data, left-aligned.
+// The remaining bits are zero.
+// This is used to fill a 64-bit bit field queue with whole bytes of input in
+// one step. The queue is left-aligned, so it takes the bits as follows:
+//      fillBits = (BIT_QUEUE64_BITS - bitFieldQueueLen) & ~7u;
+//      bitFieldQueue |= lzs_load_be64_bits(inPtr, fillBits) >> bitFieldQueueLen;
+static inline uint64_t lzs_load_be64_bits(const uint8_t * pData, uint_fast8_t numBits)
+{
+    return lzs_load_be64(pData) & (UINT64_MAX << (BIT_QUEUE64_BITS - numBits));
+}
+
+#if LZS_COMMON_PREFIX_WORDS
+
+// Return the index of the first differing byte of two 8-byte words, which
+// were loaded from memory by memcpy(). diff is the XOR of them, and must be
+// non-zero.
+static inline uint_fast8_t lzs_first_diff64(uint64_t diff)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return (uint_fast8_t)__builtin_ctzll(diff) / 8u;
+#else
+    return (uint_fast8_t)__builtin_clzll(diff) / 8u;
+#endif
+}
+
+// Return the XOR of 8 bytes at aPtr and 8 bytes at bPtr.
+static inline uint64_t lzs_diff64(const uint8_t * aPtr, const uint8_t * bPtr)
+{
+    uint64_t        a;
+    uint64_t        b;
+
+    memcpy(&a, aPtr, sizeof(a));
+    memcpy(&b, bPtr, sizeof(b));
+    return a ^ b;
+}
+
+#endif // LZS_COMMON_PREFIX_WORDS
+
+// Return the number of bytes that are the same at the start of aPtr[] and
+// bPtr[], up to max.
+//
+// It compares 32 bytes at a time with AVX2 or 16 with SSE2, then 8 bytes at a
+// time. The last few bytes are compared by re-reading the last 8 bytes before
+// max, so it never reads past max bytes of either input. The two inputs may
+// overlap.
+static inline uint_fast8_t lzs_common_prefix(const uint8_t * aPtr, const uint8_t * bPtr, uint_fast8_t max)
+{
+    uint_fast8_t    len = 0;
+#if LZS_COMMON_PREFIX_WORDS
+    uint64_t        diff;
+#if defined(__AVX2__)
+    uint32_t        mask;
+
+    while ((uint_fast8_t)(max - len) >= 32u)
+    {
+        mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                    _mm256_loadu_si256((const __m256i *)(aPtr + len)),
+                    _mm256_loadu_si256((const __m256i *)(bPtr + len))));
+        if (mask != UINT32_MAX)
+        {
+            return len + (uint_fast8_t)__builtin_ctz(~mask);
+        }
+        len += 32u;
+    }
+#elif defined(__SSE2__)
+    uint32_t        mask;
+
+    while ((uint_fast8_t)(max - len) >= 16u)
+    {
+        mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(
+                    _mm_loadu_si128((const __m128i *)(aPtr + len)),
+                    _mm_loadu_si128((const __m128i *)(bPtr + len))));
+        if (mask != 0xFFFFu)
+        {
+            return len + (uint_fast8_t)__builtin_ctz(~mask);
+        }
+        len += 16u;
+    }
+#endif
+    while ((uint_fast8_t)(max - len) >= 8u)
+    {
+        diff = lzs_diff64(aPtr + len, bPtr + len);
+        if (diff != 0)
+        {
+            return len + lzs_first_diff64(diff);
+        }
+        len += 8u;
+    }
+    if (len != max)
+    {
+        if (max >= 8u)
+        {
+            // Bytes before len are already known to match, so the first
+            // difference in the last 8 bytes is at or after len.
+            diff = lzs_diff64(aPtr + max - 8u, bPtr + max - 8u);
+            return (diff != 0) ? (max - 8u + lzs_first_diff64(diff)) : max;
+        }
+    }
+#endif
+    for ( ; len < max; len++)
+    {
+        if (aPtr[len] != bPtr[len])
+        {
+            break;
+        }
+    }
+    return len;
+}
+
+// Return the number of bytes that are the same at the start of the data at
+// aIdx and bIdx in the circular buffer ringPtr[] of size ringSize, up to max.
+// The compare is only split where either one wraps around.
+static inline uint_fast8_t lzs_ring_common_prefix(const uint8_t * ringPtr, uint_fast16_t ringSize,
+                                                  uint_fast16_t aIdx, uint_fast16_t bIdx, uint_fast8_t max)
+{
+    uint_fast8_t    len = 0;
+    uint_fast8_t    chunk;
+    uint_fast8_t    chunkLen;
+
+    for (;;)
+    {
+        chunk = LZSMIN((uint_fast16_t)(max - len), LZSMIN(ringSize - aIdx, ringSize - bIdx));
+        chunkLen = lzs_common_prefix(ringPtr + aIdx, ringPtr + bIdx, chunk);
+        len += chunkLen;
+        if (chunkLen < chunk || len >= max)
+        {
+            return len;
+        }
+        aIdx = lzs_idx_inc_wrap(aIdx, chunk, ringSize);
+        bIdx = lzs_idx_inc_wrap(bIdx, chunk, ringSize);
+    }
+}
 
 #endif // !defined(__LZS_COMMON_H)
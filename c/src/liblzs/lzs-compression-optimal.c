@@ -0,0 +1,445 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief LZS Compression, with optimal parsing
+ *
+ * This implements LZS (Lempel-Ziv-Stac) compression, which is an LZ77
+ * derived algorithm with a 2kB sliding window and Huffman coding.
+ *
+ * This compressor finds the sequence of literals and matches that gives the
+ * smallest output for the exact LZS bit widths, rather than taking the
+ * longest match at each position. It is much slower than lzs_compress(), but
+ * the output is smaller, and it is a standard LZS stream.
+ *
+ * See:
+ *     * ANSI X3.241-1994
+ *     * RFC 1967
+ *     * RFC 1974
+ *     * RFC 2395
+ *     * RFC 3943
+ *
+ * This code is licensed according to the MIT license as follows:
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2017 Craig McQueen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ----------------------------------------------------------------------------
+ ****************************************************************************/
+
+
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include "lzs.h"
+#include "lzs-common.h"
+
+#include <stdint.h>
+
+//#include <inttypes.h>
+//#include <ctype.h>
+//#include <stdio.h>
+
+#include <string.h>
+
+
+/*****************************************************************************
+ * Defines
+ ****************************************************************************/
+
+// Number of input positions that are parsed together, in one block.
+#define OPTIMAL_BLOCK_SIZE          1024u
+
+// A match at least this long is taken straight away, ending the block. It is
+// extended as far as it goes. This also limits the match lengths that are
+// compared by the parse.
+#define OPTIMAL_NICE_LENGTH         64u
+
+// The parse of a block goes on this many positions past its end, so that the
+// token that crosses the end is chosen as part of the cheapest path through
+// the data after it, rather than being cut short. Only the tokens that start
+// in the block are output; the rest are parsed again with the next block.
+#define OPTIMAL_BLOCK_OVERLAP       OPTIMAL_NICE_LENGTH
+
+// Maximum number of hash chain entries to check at each input position. The
+// default checks every match in the history. Reduce it to bound the time taken
+// on highly repetitive data, for slightly worse compression.
+#define OPTIMAL_CHAIN_DEPTH         LZS_MAX_HISTORY_SIZE
+
+#define LITERAL_BITS                (1u + 8u)
+
+#define OPTIMAL_PRICE_MAX           UINT32_MAX
+
+//#define LZS_DEBUG(X)                printf X
+#define LZS_DEBUG(X)
+
+#define LZS_ASSERT(X)
+
+#if OPTIMAL_NICE_LENGTH > UINT8_MAX
+#error OPTIMAL_NICE_LENGTH is too large
+#endif
+
+#define ARRAY_ENTRIES(a)            (sizeof(a)/sizeof((a)[0]))
+
+
+/*****************************************************************************
+ * Typedefs
+ ****************************************************************************/
+
+// Compressed output, via a bit field queue
+typedef struct
+{
+    uint8_t           * outPtr;
+    size_t              outCount;           // Count of output bytes that have been generated
+    size_t              outBufferSize;
+    uint64_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 63 when shifted left.
+    uint_fast8_t        bitFieldQueueLen;
+} OptimalOutput_t;
+
+
+/*****************************************************************************
+ * Inline Functions
+ ****************************************************************************/
+
+// Return the width in bits of an offset/length token, including any extended lengths.
+static inline uint_fast16_t match_bits(uint_fast16_t offset, size_t length)
+{
+    uint_fast16_t   width;
+
+    width = 2u + ((offset <= SHORT_OFFSET_MAX) ? SHORT_OFFSET_BITS : LONG_OFFSET_BITS);
+    if (length < MAX_SHORT_LENGTH)
+    {
+        width += length_width[length];
+    }
+    else
+    {
+        width += length_width[MAX_SHORT_LENGTH] +
+                    EXTENDED_LENGTH_BITS * (1u + (length - MAX_SHORT_LENGTH) / MAX_EXTENDED_LENGTH);
+    }
+    return width;
+}
+
+// Add the input position at historyIdx to the hash chains.
+// There must be at least 2 bytes of input at inPtr.
+static inline void hash_insert(uint16_t * hashTable, uint16_t * historyHash, const uint8_t * inPtr,
+                               uint_fast16_t historyIdx)
+{
+    lzs_input_hash_t    inputHash;
+
+    inputHash = inputs_hash(*inPtr, *(inPtr + 1));
+    historyHash[historyIdx] = hashTable[inputHash];
+    hashTable[inputHash] = historyIdx;
+}
+
+// Copy whole bytes from the bit field queue to the output.
+// Return false if the output buffer is full.
+static inline bool output_flush(OptimalOutput_t * pOutput)
+{
+    uint_fast8_t    count;
+
+    count = lzs_bit_queue_flush(pOutput->outPtr, pOutput->outBufferSize - pOutput->outCount,
+                                pOutput->bitFieldQueue, pOutput->bitFieldQueueLen);
+    pOutput->outPtr += count;
+    pOutput->outCount += count;
+    pOutput->bitFieldQueueLen -= 8u * count;
+    return pOutput->bitFieldQueueLen < 8u;
+}
+
+// Write bits to the output. They are held in the bit field queue until there
+// are at least BIT_QUEUE_FLUSH_BITS of them, or until output_flush().
+// Return false if the output buffer is full.
+static inline bool output_bits(OptimalOutput_t * pOutput, uint_fast32_t value, uint_fast8_t width)
+{
+    pOutput->bitFieldQueue = (pOutput->bitFieldQueue << width) | value;
+    pOutput->bitFieldQueueLen += width;
+    if (pOutput->bitFieldQueueLen < BIT_QUEUE_FLUSH_BITS)
+    {
+        return true;
+    }
+    return output_flush(pOutput);
+}
+
+// Write an offset/length token to the output, including any extended lengths.
+// Return false if the output buffer is full.
+static inline bool output_match(OptimalOutput_t * pOutput, uint_fast16_t offset, size_t length)
+{
+    const LzsTokenCode_t  * pTokenCode;
+    bool                    ok;
+
+    pTokenCode = &tokenEncodeTable[offset > SHORT_OFFSET_MAX][LZSMIN(length, MAX_SHORT_LENGTH)];
+    ok = output_bits(pOutput, pTokenCode->code | ((uint_fast32_t)offset << pTokenCode->shift), pTokenCode->width);
+    if (length < MAX_SHORT_LENGTH)
+    {
+        return ok;
+    }
+    for (length -= MAX_SHORT_LENGTH; length >= MAX_EXTENDED_LENGTH; length -= MAX_EXTENDED_LENGTH)
+    {
+        ok = ok && output_bits(pOutput, MAX_EXTENDED_LENGTH, EXTENDED_LENGTH_BITS);
+    }
+    return ok && output_bits(pOutput, length, EXTENDED_LENGTH_BITS);
+}
+
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+/*
+ * Single-call compression, with optimal parsing
+ *
+ * No state is kept between calls. Compression is expected to complete in a single call.
+ * It will stop if/when it reaches the end of either the input or the output buffer.
+ *
+ * Output buffer space past the returned output length may be overwritten with rubbish.
+ *
+ * At each input position, the hash chains give all the matches within the
+ * history. The nearest match is the cheapest one for each length, since
+ * short offsets take fewer bits. A shortest-path parse over the bit widths of
+ * literals and matches then picks the tokens to output. This is done in
+ * blocks of OPTIMAL_BLOCK_SIZE input positions, each of which looks
+ * OPTIMAL_BLOCK_OVERLAP positions ahead.
+ *
+ * It uses about 20 kB of stack.
+ */
+size_t lzs_compress_optimal(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen)
+{
+    OptimalOutput_t     output;
+    uint16_t            hashTable[INPUT_HASH_SIZE];
+    uint16_t            historyHash[LZS_MAX_HISTORY_SIZE];
+    uint32_t            price[OPTIMAL_BLOCK_SIZE + OPTIMAL_BLOCK_OVERLAP + 1u];         // Fewest bits to reach each position of the parse
+    uint16_t            fromOffset[OPTIMAL_BLOCK_SIZE + OPTIMAL_BLOCK_OVERLAP + 1u];    // Offset of the match that reaches each position
+    uint8_t             fromLength[OPTIMAL_BLOCK_SIZE + OPTIMAL_BLOCK_OVERLAP + 1u];    // Length of the match (or 1 for literal) that reaches each position
+    const uint8_t     * inPtr;
+    size_t              blockStart;         // Input position of the start of the block
+    size_t              blockLen;
+    size_t              parseLen;           // Number of positions parsed, including those past the block
+    size_t              parseEnd;           // Block position where parsing stopped
+    size_t              blockEnd;           // Block position after the last token that is output
+    size_t              inRemaining;        // Count of remaining bytes of input
+    size_t              historyLen;
+    size_t              niceLength;         // Length of a match that ends the block early
+    size_t              i;
+    uint_fast16_t       historyLatestIdx;
+    uint_fast16_t       historyReadIdx;
+    uint_fast16_t       offset;
+    uint_fast16_t       niceOffset;
+    uint_fast16_t       chainDepth;
+    uint_fast8_t        matchMax;
+    uint_fast8_t        length;
+    uint_fast8_t        maxLength;
+    uint32_t            cost;
+    uint16_t            temp16;
+
+
+    for (temp16 = 0; temp16 < ARRAY_ENTRIES(hashTable); temp16++)
+    {
+        hashTable[temp16] = (uint16_t)-1;
+    }
+
+    output.outPtr = a_pOutData;
+    output.outCount = 0;
+    output.outBufferSize = a_outBufferSize;
+    output.bitFieldQueue = 0;
+    output.bitFieldQueueLen = 0;
+
+    for (blockStart = 0; blockStart < a_inLen; )
+    {
+        // Parse past the end of the block, unless it is at the end of the input
+        if (a_inLen - blockStart > OPTIMAL_BLOCK_SIZE + OPTIMAL_BLOCK_OVERLAP)
+        {
+            blockLen = OPTIMAL_BLOCK_SIZE;
+            parseLen = OPTIMAL_BLOCK_SIZE + OPTIMAL_BLOCK_OVERLAP;
+        }
+        else
+        {
+            blockLen = a_inLen - blockStart;
+            parseLen = blockLen;
+        }
+        price[0] = 0;
+        for (i = 1u; i <= parseLen; i++)
+        {
+            price[i] = OPTIMAL_PRICE_MAX;
+        }
+        niceLength = 0;
+        niceOffset = 0;
+
+        // Find the fewest bits to reach each position of the parse, by
+        // relaxing the literal and all the matches from each position in turn.
+        for (i = 0; i < parseLen; i++)
+        {
+            inPtr = a_pInData + blockStart + i;
+            inRemaining = a_inLen - (blockStart + i);
+            historyLen = LZSMIN(blockStart + i, LZS_MAX_HISTORY_SIZE);
+            historyLatestIdx = (blockStart + i) % LZS_MAX_HISTORY_SIZE;
+
+            /* Literal */
+            cost = price[i] + LITERAL_BITS;
+            if (cost < price[i + 1u])
+            {
+                price[i + 1u] = cost;
+                fromLength[i + 1u] = 1u;
+            }
+
+            if (inRemaining < MIN_LENGTH)
+            {
+                continue;
+            }
+
+            /* Matches, nearest first. Each one only needs to be considered for
+             * lengths that no nearer match reaches. */
+            maxLength = 1u;
+            matchMax = LZSMIN(inRemaining, OPTIMAL_NICE_LENGTH);
+            historyReadIdx = hashTable[inputs_hash(*inPtr, *(inPtr + 1))];
+            if (historyReadIdx < historyLen)
+            {
+                offset = lzs_idx_delta2_wrap(historyLatestIdx, historyReadIdx, LZS_MAX_HISTORY_SIZE);
+
+                for (chainDepth = OPTIMAL_CHAIN_DEPTH; chainDepth != 0; chainDepth--)
+                {
+                    length = lzs_common_prefix(inPtr, inPtr - offset, matchMax);
+                    if (length > maxLength)
+                    {
+                        if (length >= OPTIMAL_NICE_LENGTH)
+                        {
+                            niceLength = length;
+                            niceOffset = offset;
+                            break;
+                        }
+                        for (temp16 = maxLength + 1u; temp16 <= LZSMIN(length, parseLen - i); temp16++)
+                        {
+                            cost = price[i] + match_bits(offset, temp16);
+                            if (cost < price[i + temp16])
+                            {
+                                price[i + temp16] = cost;
+                                fromLength[i + temp16] = temp16;
+                                fromOffset[i + temp16] = offset;
+                            }
+                        }
+                        maxLength = length;
+                        if (length >= matchMax)
+                        {
+                            break;
+                        }
+                    }
+
+                    // Get next offset from historyHash[]
+                    // This involves calculating historyReadIdx to index into it.
+                    historyReadIdx = historyHash[historyReadIdx];
+                    if (historyReadIdx >= historyLen)
+                    {
+                        break;
+                    }
+                    // Calculate new offset.
+                    temp16 = lzs_idx_delta2_wrap(historyLatestIdx, historyReadIdx, LZS_MAX_HISTORY_SIZE);
+                    if (temp16 <= offset)
+                    {
+                        break;
+                    }
+                    offset = temp16;
+                }
+            }
+            // Positions past the block are added to the hash chains once
+            // they are output, since they may be parsed again.
+            if (i < blockLen)
+            {
+                hash_insert(hashTable, historyHash, inPtr, historyLatestIdx);
+            }
+
+            if (niceLength)
+            {
+                // Take this match straight away. First, finish the block here.
+                break;
+            }
+        }
+        parseEnd = i;
+
+        // Trace the cheapest path back from the end, recording each token in
+        // price[] at the position where it starts.
+        for (i = parseEnd; i > 0; i -= length)
+        {
+            length = fromLength[i];
+            price[i - length] = ((uint32_t)length << 16u) | ((length > 1u) ? fromOffset[i] : 0);
+        }
+        // Output the tokens that start in the block, or all of them before a
+        // long match.
+        blockEnd = niceLength ? parseEnd : blockLen;
+        for (i = 0; i < blockEnd; i += length)
+        {
+            length = price[i] >> 16u;
+            if (length == 1u)
+            {
+                /* Byte-literal */
+                LZS_DEBUG(("Literal %02X\n", a_pInData[blockStart + i]));
+                if (!output_bits(&output, a_pInData[blockStart + i], LITERAL_BITS))
+                {
+                    return output.outCount;
+                }
+            }
+            else
+            {
+                LZS_DEBUG(("Offset %"PRIu32" length %"PRIuFAST8"\n", price[i] & 0xFFFFu, length));
+                if (!output_match(&output, price[i] & 0xFFFFu, length))
+                {
+                    return output.outCount;
+                }
+            }
+        }
+        // The last token may end past the block. Add the positions past the
+        // block that it covers, and the start of a long match, to the hash chains.
+        blockEnd = i;
+        for (i = blockLen; i < blockEnd + (niceLength ? 1u : 0); i++)
+        {
+            hash_insert(hashTable, historyHash, a_pInData + blockStart + i, (blockStart + i) % LZS_MAX_HISTORY_SIZE);
+        }
+        blockStart += blockEnd;
+
+        if (niceLength)
+        {
+            // Extend the long match as far as it goes, and output it
+            inPtr = a_pInData + blockStart;
+            inRemaining = a_inLen - blockStart;
+            while ((niceLength < inRemaining) && (inPtr[niceLength] == inPtr[niceLength - niceOffset]))
+            {
+                niceLength++;
+            }
+            LZS_DEBUG(("Offset %"PRIuFAST16" length %zu\n", niceOffset, niceLength));
+            if (!output_match(&output, niceOffset, niceLength))
+            {
+                return output.outCount;
+            }
+            // The first position was already added to the hash chains
+            for (i = 1u; (i < niceLength) && (i + 1u < inRemaining); i++)
+            {
+                hash_insert(hashTable, historyHash, inPtr + i, (blockStart + i) % LZS_MAX_HISTORY_SIZE);
+            }
+            blockStart += niceLength;
+        }
+    }
+
+    /* Make end marker, which is like a short offset with value 0, padded out
+     * with 0 to 7 extra zeros to reach a byte boundary. That is,
+     * 0b110000000 */
+    if (output_bits(&output, 3u << (SHORT_OFFSET_BITS + 7u), 2u + SHORT_OFFSET_BITS + 7u))
+    {
+        output_flush(&output);
+    }
+    return output.outCount;
+}
@@ -82,88 +82,58 @@ typedef enum
 } SimpleCompressState_t;
 
 
-/*****************************************************************************
- * Tables
- ****************************************************************************/
-
-/* Length is encoded as:
- *  0b00 --> 2
- *  0b01 --> 3
- *  0b10 --> 4
- *  0b1100 --> 5
- *  0b1101 --> 6
- *  0b1110 --> 7
- *  0b1111 xxxx --> 8 (extended)
- */
-static const uint8_t length_value[MAX_SHORT_LENGTH + 1u] =
-{
-    0,
-    0,
-    0x0,
-    0x1,
-    0x2,
-    0xC,
-    0xD,
-    0xE,
-    0xF
-};
-
-static const uint8_t length_width[MAX_SHORT_LENGTH + 1u] =
-{
-    0,
-    0,
-    2,
-    2,
-    2,
-    4,
-    4,
-    4,
-    4,
-};
-
-
 /*****************************************************************************
  * Inline Functions
  ****************************************************************************/
 
 static inline uint_fast8_t lzs_match_len(const uint8_t * aPtr, const uint8_t * bPtr, uint_fast8_t matchMax)
 {
-    uint_fast8_t    len;
-
-
-    for (len = 0; len < matchMax; len++)
-    {
-        if (*aPtr++ != *bPtr++)
-        {
-            return len;
-        }
-    }
-    return len;
+    return lzs_common_prefix(aPtr, bPtr, matchMax);
 }
 
 static inline uint_fast8_t lzs_inc_match_len(LzsSimpleCompressParameters_t * pParams, uint_fast16_t offset, uint_fast8_t matchMax)
 {
-    uint_fast16_t   historyReadIdx;
-    uint_fast16_t   historyLookAheadIdx;
-    uint_fast8_t    len;
+    return lzs_ring_common_prefix(pParams->historyBuffer, sizeof(pParams->historyBuffer), pParams->historyLatestIdx,
+                                  lzs_idx_dec_wrap(pParams->historyLatestIdx, offset, sizeof(pParams->historyBuffer)),
+                                  matchMax);
+}
 
+// Return hash of the two input bytes starting at idx in the history buffer,
+// for the hash table set by lzs_simple_compress_set_hash().
+static inline uint_fast16_t simple_inputs_hash(const LzsSimpleCompressParameters_t * pParams, uint_fast16_t idx)
+{
+    return lzs_hash_mult2(pParams->historyBuffer[idx],
+                          pParams->historyBuffer[lzs_idx_inc_wrap(idx, 1u, sizeof(pParams->historyBuffer))],
+                          pParams->hashBits);
+}
 
-    historyReadIdx = lzs_idx_dec_wrap(pParams->historyLatestIdx, offset,
-                                        sizeof(pParams->historyBuffer));
-    historyLookAheadIdx = pParams->historyLatestIdx;
+// Add the history position idx to the hash table. The byte after it must be in
+// the history buffer.
+static inline void simple_hash_insert(LzsSimpleCompressParameters_t * pParams, uint_fast16_t idx)
+{
+    pParams->pHashTable[simple_inputs_hash(pParams, idx)] = idx;
+}
 
-    for (len = 0; len < matchMax; ++len )
+// Look for a match in history, for the data at historyLatestIdx, using the
+// hash table. Only the latest position with the same hash is tried.
+static inline uint_fast8_t simple_hash_find_match(LzsSimpleCompressParameters_t * pParams, uint_fast8_t matchMax,
+                                                  uint_fast16_t * pOffset)
+{
+    uint_fast16_t       historyReadIdx;
+    uint_fast16_t       offset;
+
+    historyReadIdx = pParams->pHashTable[simple_inputs_hash(pParams, pParams->historyLatestIdx)];
+    if (historyReadIdx >= sizeof(pParams->historyBuffer))
     {
-        if (pParams->historyBuffer[historyLookAheadIdx] != pParams->historyBuffer[historyReadIdx])
-        {
-            return len;
-        }
-        historyLookAheadIdx = lzs_idx_inc_wrap(historyLookAheadIdx, 1u,
-                                                sizeof(pParams->historyBuffer));
-        historyReadIdx = lzs_idx_inc_wrap(historyReadIdx, 1u,
-                                                sizeof(pParams->historyBuffer));
+        return 0;
+    }
+    offset = lzs_idx_delta2_wrap(pParams->historyLatestIdx, historyReadIdx, sizeof(pParams->historyBuffer));
+    if (offset > pParams->historyLen)
+    {
+        return 0;
     }
-    return len;
+    *pOffset = offset;
+    return lzs_inc_match_len(pParams, offset, matchMax);
 }
 
 
@@ -177,6 +147,8 @@ static inline uint_fast8_t lzs_inc_match_len(LzsSimpleCompressParameters_t * pPa
  * No state is kept between calls. Compression is expected to complete in a single call.
  * It will stop if/when it reaches the end of either the input or the output buffer.
  *
+ * Output buffer space past the returned output length may be overwritten with rubbish.
+ *
  * This is like lzs_compress(), but it doesn't use hash tables to quickly find
  * data matches in the history. So it uses less RAM, but is slower.
  */
@@ -187,7 +159,8 @@ size_t lzs_simple_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const u
     size_t              historyLen;
     size_t              inRemaining;        // Count of remaining bytes of input
     size_t              outCount;           // Count of output bytes that have been generated
-    uint32_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 31 when shifted left.
+    uint64_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 63 when shifted left.
+    const LzsTokenCode_t  * pTokenCode;
     uint_fast8_t        bitFieldQueueLen;
     uint_fast16_t       offset;
     uint_fast8_t        matchMax;
@@ -209,16 +182,18 @@ size_t lzs_simple_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const u
 
     for (;;)
     {
-        /* Copy output bits to output buffer */
-        while (bitFieldQueueLen >= 8u)
+        /* Copy output bits to output buffer, when there are enough of them */
+        if (bitFieldQueueLen >= BIT_QUEUE_FLUSH_BITS)
         {
-            if (outCount >= a_outBufferSize)
+            temp8 = lzs_bit_queue_flush(outPtr, a_outBufferSize - outCount, bitFieldQueue, bitFieldQueueLen);
+            outPtr += temp8;
+            outCount += temp8;
+            bitFieldQueueLen -= 8u * temp8;
+            if (bitFieldQueueLen >= 8u)
             {
+                // We're out of space in the output buffer.
                 return outCount;
             }
-            *outPtr++ = (bitFieldQueue >> (bitFieldQueueLen - 8u));
-            bitFieldQueueLen -= 8u;
-            outCount++;
         }
         if (inRemaining == 0 && state == COMPRESS_NORMAL)
         {
@@ -261,36 +236,11 @@ size_t lzs_simple_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const u
                 {
                     LZS_DEBUG(("Best offset %"PRIuFAST16" length %"PRIuFAST8"\n", best_offset, best_length));
                     /* Offset/length token */
-                    /* 1 bit indicates offset/length token */
-                    bitFieldQueue <<= 1u;
-                    bitFieldQueueLen++;
-                    bitFieldQueue |= 1u;
-                    /* Encode offset */
-                    if (best_offset <= SHORT_OFFSET_MAX)
-                    {
-                        /* Short offset */
-                        LZS_DEBUG(("Short offset %"PRIuFAST16"\n", best_offset));
-                        bitFieldQueue <<= (1u + SHORT_OFFSET_BITS);
-                        /* Initial 1 bit indicates short offset */
-                        bitFieldQueue |= (1u << SHORT_OFFSET_BITS) | best_offset;
-                        bitFieldQueueLen += (1u + SHORT_OFFSET_BITS);
-                    }
-                    else
-                    {
-                        /* Long offset */
-                        LZS_DEBUG(("Long offset %"PRIuFAST16"\n", best_offset));
-                        bitFieldQueue <<= (1u + LONG_OFFSET_BITS);
-                        /* Initial 0 bit indicates long offset */
-                        bitFieldQueue |= best_offset;
-                        bitFieldQueueLen += (1u + LONG_OFFSET_BITS);
-                    }
-                    /* Encode length */
                     length = LZSMIN(best_length, MAX_SHORT_LENGTH);
-                    LZS_DEBUG(("Length %"PRIuFAST8"\n", length));
-                    temp8 = length_width[length];
-                    bitFieldQueue <<= temp8;
-                    bitFieldQueue |= length_value[length];
-                    bitFieldQueueLen += temp8;
+                    LZS_DEBUG(("Offset %"PRIuFAST16" length %"PRIuFAST8"\n", best_offset, length));
+                    pTokenCode = &tokenEncodeTable[best_offset > SHORT_OFFSET_MAX][length];
+                    bitFieldQueue = lzs_bit_queue_token(bitFieldQueue, pTokenCode, best_offset);
+                    bitFieldQueueLen += pTokenCode->width;
 
                     if (length == MAX_SHORT_LENGTH)
                     {
@@ -328,16 +278,7 @@ size_t lzs_simple_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const u
     bitFieldQueueLen += (2u + SHORT_OFFSET_BITS + 7u);
     bitFieldQueue |= (3u << (SHORT_OFFSET_BITS + 7u));
     /* Copy output bits to output buffer */
-    while (bitFieldQueueLen >= 8u)
-    {
-        if (outCount >= a_outBufferSize)
-        {
-            return outCount;
-        }
-        *outPtr++ = (bitFieldQueue >> (bitFieldQueueLen - 8u));
-        bitFieldQueueLen -= 8u;
-        outCount++;
-    }
+    outCount += lzs_bit_queue_flush(outPtr, a_outBufferSize - outCount, bitFieldQueue, bitFieldQueueLen);
     return outCount;
 }
 
@@ -358,6 +299,53 @@ void lzs_simple_compress_init(LzsSimpleCompressParameters_t * pParams)
     pParams->historyLookAheadIdx = 0;
     pParams->historyLen = 0;
     pParams->offset = 0;
+    pParams->pHashTable = NULL;
+    pParams->hashBits = 0;
+}
+
+/*
+ * \brief Set a hash table for incremental compression ("simple" version)
+ *
+ * This can be done at any time between calls of
+ * lzs_simple_compress_incremental(), to move a stream between the reduced hash
+ * and history only memory tiers (see LzsSimpleCompressParameters_t), without
+ * losing its history.
+ *
+ * pHashTable has LZS_HASH_TABLE_ENTRIES(hashBits) entries, which must remain
+ * valid until compression is finished, or another table is set. hashBits is
+ * limited to LZS_HASH_BITS_MIN to LZS_HASH_BITS_MAX. The table is filled from
+ * the data that is in the history. If pHashTable is NULL, the history is
+ * searched without a hash table.
+ */
+void lzs_simple_compress_set_hash(LzsSimpleCompressParameters_t * pParams, uint16_t * pHashTable, uint8_t hashBits)
+{
+    uint_fast16_t       idx;
+    uint_fast16_t       count;
+    uint_fast32_t       i;
+
+    pParams->pHashTable = pHashTable;
+    if (pHashTable == NULL)
+    {
+        return;
+    }
+    hashBits = LZSMAX(hashBits, LZS_HASH_BITS_MIN);
+    pParams->hashBits = LZSMIN(hashBits, LZS_HASH_BITS_MAX);
+    for (i = 0; i < LZS_HASH_TABLE_ENTRIES(pParams->hashBits); i++)
+    {
+        pHashTable[i] = (uint16_t)-1;
+    }
+    // Add the history positions, oldest first, that have a following byte.
+    count = pParams->historyLen;
+    if (pParams->lookAheadLen == 0 && count != 0)
+    {
+        count--;
+    }
+    idx = lzs_idx_dec_wrap(pParams->historyLatestIdx, pParams->historyLen, sizeof(pParams->historyBuffer));
+    for (i = 0; i < count; i++)
+    {
+        simple_hash_insert(pParams, idx);
+        idx = lzs_idx_inc_wrap(idx, 1u, sizeof(pParams->historyBuffer));
+    }
 }
 
 /*
@@ -365,6 +353,8 @@ void lzs_simple_compress_init(LzsSimpleCompressParameters_t * pParams)
  *
  * This is like lzs_compress_incremental(), but it doesn't use hash tables to
  * quickly find data matches in the history. So it uses less RAM, but is slower.
+ *
+ * Output buffer space past the final outPtr may be overwritten with rubbish.
  */
 size_t lzs_simple_compress_incremental(LzsSimpleCompressParameters_t * pParams, bool add_end_marker)
 {
@@ -375,6 +365,8 @@ size_t lzs_simple_compress_incremental(LzsSimpleCompressParameters_t * pParams,
     uint_fast16_t       best_offset;
     uint_fast8_t        best_length;
     uint_fast8_t        temp8;
+    bool                hashLatest;
+    const LzsTokenCode_t  * pTokenCode;
 
 
     pParams->status = LZS_C_STATUS_NONE;
@@ -384,22 +376,19 @@ size_t lzs_simple_compress_incremental(LzsSimpleCompressParameters_t * pParams,
     {
         length = 0;
         // Write data from the bit field queue to output
-        while (pParams->bitFieldQueueLen >= 8u)
+        temp8 = lzs_bit_queue_flush(pParams->outPtr, pParams->outLength,
+                                    pParams->bitFieldQueue, pParams->bitFieldQueueLen);
+        pParams->outPtr += temp8;
+        pParams->outLength -= temp8;
+        pParams->bitFieldQueueLen -= 8u * temp8;
+        outCount += temp8;
+        if (pParams->bitFieldQueueLen >= 8u)
         {
-            // Check if we have space in the output buffer
-            if (pParams->outLength == 0)
-            {
-                // We're out of space in the output buffer.
-                // Set status, exit this inner copying loop, but maintain the current state.
-                pParams->status |= LZS_C_STATUS_NO_OUTPUT_BUFFER_SPACE;
-                break;
-            }
-            *pParams->outPtr++ = (pParams->bitFieldQueue >> (pParams->bitFieldQueueLen - 8u));
-            pParams->outLength--;
-            pParams->bitFieldQueueLen -= 8u;
-            ++outCount;
+            // We're out of space in the output buffer.
+            // Set status, but maintain the current state.
+            pParams->status |= LZS_C_STATUS_NO_OUTPUT_BUFFER_SPACE;
         }
-        if (pParams->bitFieldQueueLen > BIT_QUEUE_BITS)
+        if (pParams->bitFieldQueueLen > BIT_QUEUE64_BITS)
         {
             // It is an error if we ever get here.
             LZS_ASSERT(0);
@@ -422,9 +411,16 @@ size_t lzs_simple_compress_incremental(LzsSimpleCompressParameters_t * pParams,
             }
         }
 
-        // Try to fill look-ahead buffer in history buffer
-        temp8 = LZSMIN(LZS_MAX_LOOK_AHEAD_LEN - pParams->lookAheadLen, pParams->inLength);
+        // Try to fill look-ahead buffer in history buffer.
+        // It can hold more than LZS_MAX_LOOK_AHEAD_LEN, after lzs_compress_to_simple().
+        temp8 = 0;
+        if (pParams->lookAheadLen < LZS_MAX_LOOK_AHEAD_LEN)
+        {
+            temp8 = LZSMIN(LZS_MAX_LOOK_AHEAD_LEN - pParams->lookAheadLen, pParams->inLength);
+        }
         // temp8 holds number of bytes that can be copied from input to look-ahead area of historyBuffer[].
+        // If the look-ahead is empty, the latest history position couldn't be hashed yet.
+        hashLatest = (pParams->pHashTable != NULL && pParams->lookAheadLen == 0 && pParams->historyLen != 0 && temp8 != 0);
         // Copy that number of bytes from input into look-ahead area of historyBuffer[].
         pParams->lookAheadLen += temp8;
         pParams->inLength -= temp8;
@@ -434,6 +430,10 @@ size_t lzs_simple_compress_incremental(LzsSimpleCompressParameters_t * pParams,
             pParams->historyLookAheadIdx = lzs_idx_inc_wrap(pParams->historyLookAheadIdx, 1u,
                                                             sizeof(pParams->historyBuffer));
         }
+        if (hashLatest)
+        {
+            simple_hash_insert(pParams, lzs_idx_dec_wrap(pParams->historyLatestIdx, 1u, sizeof(pParams->historyBuffer)));
+        }
 
         // Process input data in a state machine
         switch (pParams->state)
@@ -450,16 +450,26 @@ size_t lzs_simple_compress_incremental(LzsSimpleCompressParameters_t * pParams,
                 // Look for a match in history.
                 best_length = 0;
                 matchMax = LZSMIN(pParams->lookAheadLen, LZS_SEARCH_MATCH_MAX);
-                for (offset = 1; offset <= pParams->historyLen; offset++)
+                if (pParams->pHashTable != NULL)
                 {
-                    length = lzs_inc_match_len(pParams, offset, matchMax);
-                    if (length > best_length)
+                    if (matchMax >= MIN_LENGTH)
                     {
-                        best_offset = offset;
-                        best_length = length;
-                        if (length >= matchMax)
+                        best_length = simple_hash_find_match(pParams, matchMax, &best_offset);
+                    }
+                }
+                else
+                {
+                    for (offset = 1; offset <= pParams->historyLen; offset++)
+                    {
+                        length = lzs_inc_match_len(pParams, offset, matchMax);
+                        if (length > best_length)
                         {
-                            break;
+                            best_offset = offset;
+                            best_length = length;
+                            if (length >= matchMax)
+                            {
+                                break;
+                            }
                         }
                     }
                 }
@@ -480,36 +490,11 @@ size_t lzs_simple_compress_incremental(LzsSimpleCompressParameters_t * pParams,
                 {
                     LZS_DEBUG(("Best offset %"PRIuFAST16" length %"PRIuFAST8"\n", best_offset, best_length));
                     /* Offset/length token */
-                    /* 1 bit indicates offset/length token */
-                    pParams->bitFieldQueue <<= 1u;
-                    pParams->bitFieldQueueLen++;
-                    pParams->bitFieldQueue |= 1u;
-                    /* Encode offset */
-                    if (best_offset <= SHORT_OFFSET_MAX)
-                    {
-                        /* Short offset */
-                        LZS_DEBUG(("Short offset %"PRIuFAST16"\n", best_offset));
-                        pParams->bitFieldQueue <<= (1u + SHORT_OFFSET_BITS);
-                        /* Initial 1 bit indicates short offset */
-                        pParams->bitFieldQueue |= (1u << SHORT_OFFSET_BITS) | best_offset;
-                        pParams->bitFieldQueueLen += (1u + SHORT_OFFSET_BITS);
-                    }
-                    else
-                    {
-                        /* Long offset */
-                        LZS_DEBUG(("Long offset %"PRIuFAST16"\n", best_offset));
-                        pParams->bitFieldQueue <<= (1u + LONG_OFFSET_BITS);
-                        /* Initial 0 bit indicates long offset */
-                        pParams->bitFieldQueue |= best_offset;
-                        pParams->bitFieldQueueLen += (1u + LONG_OFFSET_BITS);
-                    }
-                    /* Encode length */
                     length = LZSMIN(best_length, MAX_SHORT_LENGTH);
-                    LZS_DEBUG(("Length %"PRIuFAST8"\n", length));
-                    temp8 = length_width[length];
-                    pParams->bitFieldQueue <<= temp8;
-                    pParams->bitFieldQueue |= length_value[length];
-                    pParams->bitFieldQueueLen += temp8;
+                    LZS_DEBUG(("Offset %"PRIuFAST16" length %"PRIuFAST8"\n", best_offset, length));
+                    pTokenCode = &tokenEncodeTable[best_offset > SHORT_OFFSET_MAX][length];
+                    pParams->bitFieldQueue = lzs_bit_queue_token(pParams->bitFieldQueue, pTokenCode, best_offset);
+                    pParams->bitFieldQueueLen += pTokenCode->width;
 
                     if (length == MAX_SHORT_LENGTH)
                     {
@@ -546,6 +531,15 @@ size_t lzs_simple_compress_incremental(LzsSimpleCompressParameters_t * pParams,
                 break;
         }
         // 'length' contains number of input bytes encoded.
+        // Add those positions that have a following byte to the hash table.
+        if (pParams->pHashTable != NULL)
+        {
+            for (temp8 = 0; temp8 < length && temp8 + 1u < pParams->lookAheadLen; temp8++)
+            {
+                simple_hash_insert(pParams, lzs_idx_inc_wrap(pParams->historyLatestIdx, temp8,
+                                                             sizeof(pParams->historyBuffer)));
+            }
+        }
         pParams->historyLatestIdx = lzs_idx_inc_wrap(pParams->historyLatestIdx, length,
                                                     sizeof(pParams->historyBuffer));
         pParams->historyLen = LZSMIN(pParams->historyLen + length, LZS_MAX_HISTORY_SIZE);
@@ -566,13 +560,11 @@ size_t lzs_simple_compress_incremental(LzsSimpleCompressParameters_t * pParams,
         pParams->bitFieldQueueLen += (2u + SHORT_OFFSET_BITS + 7u);
         pParams->bitFieldQueue |= (3u << (SHORT_OFFSET_BITS + 7u));
         /* Copy output bits to output buffer */
-        while (pParams->bitFieldQueueLen >= 8u)
-        {
-            *pParams->outPtr++ = (pParams->bitFieldQueue >> (pParams->bitFieldQueueLen - 8u));
-            pParams->outLength--;
-            pParams->bitFieldQueueLen -= 8u;
-            ++outCount;
-        }
+        temp8 = lzs_bit_queue_flush(pParams->outPtr, pParams->outLength,
+                                    pParams->bitFieldQueue, pParams->bitFieldQueueLen);
+        pParams->outPtr += temp8;
+        pParams->outLength -= temp8;
+        outCount += temp8;
         pParams->bitFieldQueueLen = 0;
         pParams->status |= LZS_C_STATUS_END_MARKER;
     }
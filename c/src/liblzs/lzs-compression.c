@@ -72,6 +72,40 @@
 
 #define ARRAY_ENTRIES(a)            (sizeof(a)/sizeof((a)[0]))
 
+// hashTable[] entries hold a history buffer index, XORed with a tag of the
+// generation number in the upper bits. Entries from an older generation, or
+// cleared to all 1s, then decode to an invalid index. Generation
+// HASH_GENERATION_MAX + 1 is not used, so cleared entries are never valid.
+// historyHash[] entries are stored decoded. They are only reached by following
+// a valid hashTable[] entry, so they are from the current generation too.
+#define HASH_INDEX_BITS             12u
+#define HASH_GENERATION_MAX         ((1u << (16u - HASH_INDEX_BITS)) - 2u)
+
+#if LZS_COMPRESS_HISTORY_SIZE > (1u << HASH_INDEX_BITS)
+#error LZS_COMPRESS_HISTORY_SIZE is too large for HASH_INDEX_BITS
+#endif
+
+// Single-call compression of input up to this size uses a hash table sized to
+// the input. The history never wraps around, so chains are indexed by input position.
+#define SMALL_INPUT_MAX             LZS_MAX_HISTORY_SIZE
+// Hash table entries per input byte, for small input. Fewer gives more false match candidates.
+#define SMALL_INPUT_HASH_RATIO      4u
+
+// A saved compression dictionary has this layout, with all multi-byte fields
+// little-endian:
+//     magic               4   'L' 'Z' 'D' '1', which also identifies the layout version
+//     dictionary length   2
+//     hash type           1   LzsHashType_t
+//     hash bits           1   Hash table has (1 << hash bits) entries
+//     hash chain entries  2 * dictionary length, historyHash[]
+//     hash table entries  2 * (1 << hash bits)
+//     dictionary data     dictionary length
+#define DICTIONARY_MAGIC_0          'L'
+#define DICTIONARY_MAGIC_1          'Z'
+#define DICTIONARY_MAGIC_2          'D'
+#define DICTIONARY_MAGIC_3          '1'
+#define DICTIONARY_HEADER_SIZE      8u
+
 
 /*****************************************************************************
  * Typedefs
@@ -83,44 +117,51 @@ typedef enum
     COMPRESS_EXTENDED
 } SimpleCompressState_t;
 
+// Search effort settings for one compression level
+typedef struct
+{
+    uint16_t            chainDepth;         // Maximum number of hash chain entries to try for each match
+    uint8_t             goodLength;         // Stop searching when a match at least this long is found
+    uint8_t             searchMax;          // Maximum match length to search for
+    uint8_t             insertMax;          // Only add positions within a match to the hash tables if the match is no longer than this
+    uint8_t             lazyDepth;          // Number of following positions to check for a better match, before taking a match
+} LzsCompressLevel_t;
+
+// Workspace for lzs_compress_ws(), followed by its hash table
+typedef struct
+{
+    uint16_t            hashTag;            // Generation number tag of hash table entries
+    uint8_t             hashType;           // LzsHashType_t
+    uint8_t             hashBits;           // Hash table has (1 << hashBits) entries
+    uint16_t            historyHash[LZS_MAX_HISTORY_SIZE];
+    uint16_t            hashTable[];
+} LzsCompressWorkspace_t;
+
 
 /*****************************************************************************
  * Tables
  ****************************************************************************/
 
-/* Length is encoded as:
- *  0b00 --> 2
- *  0b01 --> 3
- *  0b10 --> 4
- *  0b1100 --> 5
- *  0b1101 --> 6
- *  0b1110 --> 7
- *  0b1111 xxxx --> 8 (extended)
+/* Search effort for each compression level, from LZS_COMPRESS_LEVEL_MIN to
+ * LZS_COMPRESS_LEVEL_MAX. LZS_COMPRESS_LEVEL_DEFAULT does a full search of the
+ * hash chains, as lzs_compress() always has.
+ * The hash chains can't hold more than LZS_MAX_HISTORY_SIZE entries, so that
+ * chain depth means no limit.
+ * With lazyDepth > 0, a match is only taken if a longer match starting at one of
+ * the next lazyDepth positions doesn't save more bits (lazy matching).
  */
-static const uint8_t length_value[MAX_SHORT_LENGTH + 1u] =
-{
-    0,
-    0,
-    0x0,
-    0x1,
-    0x2,
-    0xC,
-    0xD,
-    0xE,
-    0xF
-};
-
-static const uint8_t length_width[MAX_SHORT_LENGTH + 1u] =
-{
-    0,
-    0,
-    2,
-    2,
-    2,
-    4,
-    4,
-    4,
-    4,
+static const LzsCompressLevel_t compressLevels[LZS_COMPRESS_LEVEL_MAX - LZS_COMPRESS_LEVEL_MIN + 1u] =
+{
+    /* chainDepth               goodLength              searchMax               insertMax               lazyDepth */
+    {  1u,                      4u,                     8u,                     4u,                     0       },  // 1
+    {  2u,                      6u,                     8u,                     6u,                     0       },  // 2
+    {  4u,                      8u,                     LZS_SEARCH_MATCH_MAX,   8u,                     0       },  // 3
+    {  8u,                      8u,                     LZS_SEARCH_MATCH_MAX,   LZS_MAX_LOOK_AHEAD_LEN, 0       },  // 4
+    {  32u,                     LZS_SEARCH_MATCH_MAX,   LZS_SEARCH_MATCH_MAX,   LZS_MAX_LOOK_AHEAD_LEN, 0       },  // 5
+    {  LZS_MAX_HISTORY_SIZE,    LZS_SEARCH_MATCH_MAX,   LZS_SEARCH_MATCH_MAX,   LZS_MAX_LOOK_AHEAD_LEN, 0       },  // 6
+    {  LZS_MAX_HISTORY_SIZE,    LZS_MAX_LOOK_AHEAD_LEN, LZS_MAX_LOOK_AHEAD_LEN, LZS_MAX_LOOK_AHEAD_LEN, 0       },  // 7
+    {  LZS_MAX_HISTORY_SIZE,    LZS_MAX_LOOK_AHEAD_LEN, LZS_MAX_LOOK_AHEAD_LEN, LZS_MAX_LOOK_AHEAD_LEN, 1u      },  // 8
+    {  LZS_MAX_HISTORY_SIZE,    LZS_MAX_LOOK_AHEAD_LEN, LZS_MAX_LOOK_AHEAD_LEN, LZS_MAX_LOOK_AHEAD_LEN, 2u      },  // 9
 };
 
 
@@ -128,65 +169,370 @@ static const uint8_t length_width[MAX_SHORT_LENGTH + 1u] =
  * Inline Functions
  ****************************************************************************/
 
-// Return hash of two input bytes, modulo INPUT_HASH_SIZE.
-static inline lzs_input_hash_t inputs_hash(uint8_t a, uint8_t b)
+// Return the search effort settings for a compression level.
+// Levels out of range are limited to the nearest valid level.
+static inline const LzsCompressLevel_t * compress_level(uint_fast8_t level)
+{
+    if (level < LZS_COMPRESS_LEVEL_MIN)
+    {
+        level = LZS_COMPRESS_LEVEL_MIN;
+    }
+    else if (level > LZS_COMPRESS_LEVEL_MAX)
+    {
+        level = LZS_COMPRESS_LEVEL_MAX;
+    }
+    return &compressLevels[level - LZS_COMPRESS_LEVEL_MIN];
+}
+
+// Return the number of input bytes that a hash type hashes.
+static inline uint_fast8_t inputs_hash_len(uint_fast8_t hashType)
+{
+    return (hashType == LZS_HASH_MULT3) ? 3u : 2u;
+}
+
+// Return hash of input bytes a, b and c, for a hash type with hashBits bits.
+// c is only used by LZS_HASH_MULT3.
+static inline lzs_input_hash_t inputs_hash_type(uint_fast8_t hashType, uint_fast8_t hashBits,
+                                                uint8_t a, uint8_t b, uint8_t c)
 {
-    return (((lzs_input_hash_t)a << 4u) ^ (lzs_input_hash_t)b) % INPUT_HASH_SIZE;
+    switch (hashType)
+    {
+        case LZS_HASH_DIRECT:
+            return ((lzs_input_hash_t)a << 8u) | b;
+        case LZS_HASH_MULT2:
+            return lzs_hash_mult2(a, b, hashBits);
+        case LZS_HASH_MULT3:
+            return (uint32_t)((((uint32_t)a << 16u) | ((uint32_t)b << 8u) | c) * HASH_MULT_MULTIPLIER)
+                    >> (32u - hashBits);
+        default:
+            return inputs_hash(a, b);
+    }
 }
 
-// Return hash of next two input bytes for incremental compression, modulo INPUT_HASH_SIZE.
-static inline lzs_input_hash_t inputs_hash_inc(const LzsCompressParameters_t * pParams)
+// Return hash of the input bytes at inPtr, for a hash type with hashBits bits.
+// Only inputs_hash_len(hashType) bytes are read.
+static inline lzs_input_hash_t inputs_hash_ptr(uint_fast8_t hashType, uint_fast8_t hashBits, const uint8_t * inPtr)
 {
-    uint_fast16_t   index0;
-    uint_fast16_t   index1;
+    return inputs_hash_type(hashType, hashBits, inPtr[0], inPtr[1], (hashType == LZS_HASH_MULT3) ? inPtr[2] : 0);
+}
 
-    index0 = pParams->historyLatestIdx;
-    index1 = index0 + 1u;
-    if (index1 >= sizeof(pParams->historyBuffer))
+// Validate a hash type and its number of bits, given whether there is a
+// caller-supplied hash table (otherwise the table has INPUT_HASH_SIZE entries).
+// LZS_HASH_DIRECT needs a caller-supplied table, so falls back to LZS_HASH_DEFAULT.
+static inline void hash_config(uint8_t * pHashType, uint8_t * pHashBits, bool haveTable)
+{
+    switch (*pHashType)
     {
-        index1 = 0;
+        case LZS_HASH_DIRECT:
+            if (haveTable)
+            {
+                *pHashBits = LZS_HASH_BITS_MAX;
+                return;
+            }
+            break;
+        case LZS_HASH_MULT2:
+        case LZS_HASH_MULT3:
+            *pHashBits = LZSMAX(*pHashBits, LZS_HASH_BITS_MIN);
+            *pHashBits = LZSMIN(*pHashBits, haveTable ? LZS_HASH_BITS_MAX : INPUT_HASH_BITS);
+            return;
+        default:
+            break;
     }
-    return inputs_hash(pParams->historyBuffer[index0], pParams->historyBuffer[index1]);
+    *pHashType = LZS_HASH_DEFAULT;
+    *pHashBits = INPUT_HASH_BITS;
+}
+
+// Advance the generation number tag of hash table entries. Return true if it
+// has wrapped around, in which case the hash tables must be cleared.
+static inline bool hash_tag_next(uint16_t * pHashTag)
+{
+    if ((*pHashTag >> HASH_INDEX_BITS) >= HASH_GENERATION_MAX)
+    {
+        *pHashTag = 0;
+        return true;
+    }
+    *pHashTag += (1u << HASH_INDEX_BITS);
+    return false;
+}
+
+// Index arithmetic for the history buffer for incremental compression. It is
+// circular, unless LZS_COMPRESS_LINEAR_HISTORY is set.
+static inline uint_fast16_t history_idx_inc(uint_fast16_t idx, uint_fast16_t inc)
+{
+#if LZS_COMPRESS_LINEAR_HISTORY
+    return idx + inc;
+#else
+    return lzs_idx_inc_wrap(idx, inc, LZS_COMPRESS_HISTORY_SIZE);
+#endif
+}
+
+static inline uint_fast16_t history_idx_dec(uint_fast16_t idx, uint_fast16_t dec)
+{
+#if LZS_COMPRESS_LINEAR_HISTORY
+    return idx - dec;
+#else
+    return lzs_idx_dec_wrap(idx, dec, LZS_COMPRESS_HISTORY_SIZE);
+#endif
+}
+
+// Return the offset of the history data at historyReadIdx, from the data at idx.
+// For a linear history buffer, data at or after idx gives an offset that is
+// too large to be valid.
+static inline uint_fast16_t history_offset(uint_fast16_t idx, uint_fast16_t historyReadIdx)
+{
+#if LZS_COMPRESS_LINEAR_HISTORY
+    return (historyReadIdx < idx) ? (idx - historyReadIdx) : LZS_COMPRESS_HISTORY_SIZE;
+#else
+    return lzs_idx_delta2_wrap(idx, historyReadIdx, LZS_COMPRESS_HISTORY_SIZE);
+#endif
+}
+
+// Return hash of input bytes for incremental compression, starting at index0
+// in the history buffer, for the hash type set at initialisation.
+static inline lzs_input_hash_t inputs_hash_inc(const LzsCompressParameters_t * pParams, uint_fast16_t index0)
+{
+    uint_fast16_t       index1;
+
+    index1 = history_idx_inc(index0, 1u);
+    return inputs_hash_type(pParams->hashType, pParams->hashBits,
+                            pParams->historyBuffer[index0], pParams->historyBuffer[index1],
+                            (pParams->hashType == LZS_HASH_MULT3) ?
+                                pParams->historyBuffer[history_idx_inc(index1, 1u)] : 0);
+}
+
+// Return the hash table for incremental compression.
+static inline uint16_t * hash_table_inc(LzsCompressParameters_t * pParams)
+{
+    return (pParams->pHashTable != NULL) ? pParams->pHashTable : pParams->hashTable;
+}
+
+// Add the history position idx to the hash tables for incremental compression.
+// There must be enough data after it to hash it.
+static inline void hash_insert_inc(LzsCompressParameters_t * pParams, uint16_t * hashTable, uint_fast16_t idx)
+{
+    lzs_input_hash_t    inputHash;
+
+    inputHash = inputs_hash_inc(pParams, idx);
+    pParams->historyHash[idx] = hashTable[inputHash] ^ pParams->hashTag;
+    hashTable[inputHash] = idx ^ pParams->hashTag;
 }
 
 static inline uint_fast8_t lzs_match_len(const uint8_t * aPtr, const uint8_t * bPtr, uint_fast8_t matchMax)
 {
-    uint_fast8_t    len;
+    return lzs_common_prefix(aPtr, bPtr, matchMax);
+}
 
+// Return length of match for incremental compression, of the data starting at
+// historyLookAheadIdx in the history buffer, with the data offset bytes before it.
+static inline uint_fast8_t lzs_inc_match_len(const LzsCompressParameters_t * pParams, uint_fast16_t historyLookAheadIdx,
+                                             uint_fast16_t offset, uint_fast8_t matchMax)
+{
+#if LZS_COMPRESS_LINEAR_HISTORY
+    return lzs_match_len(pParams->historyBuffer + historyLookAheadIdx,
+                         pParams->historyBuffer + historyLookAheadIdx - offset, matchMax);
+#else
+    return lzs_ring_common_prefix(pParams->historyBuffer, sizeof(pParams->historyBuffer), historyLookAheadIdx,
+                                  lzs_idx_dec_wrap(historyLookAheadIdx, offset, sizeof(pParams->historyBuffer)),
+                                  matchMax);
+#endif
+}
+
+#if LZS_COMPRESS_LINEAR_HISTORY
+
+// Return a hash table entry, adjusted for the history data being moved down by delta.
+// Entries for data that is moved out of the buffer become invalid.
+static inline uint16_t history_slide_idx(uint16_t historyIdx, uint_fast16_t delta)
+{
+    uint_fast16_t   newIdx;
+
+    // This relies on calculation overflows wrapping as expected, so that one
+    // compare finds entries that are either invalid already, or moved out.
+    newIdx = historyIdx - delta;
+    return (newIdx < LZS_COMPRESS_HISTORY_SIZE - delta) ? newIdx : (uint16_t)-1;
+}
+
+// Move the history and look-ahead data down to the start of the linear history
+// buffer, keeping LZS_MAX_HISTORY_SIZE bytes of history. Adjust the hash tables
+// to match.
+static void lzs_compress_slide(LzsCompressParameters_t * pParams)
+{
+    uint16_t      * hashTable;
+    uint_fast16_t   delta;
+    uint_fast16_t   len;
+    uint_fast32_t   i;
+
+
+    delta = pParams->historyLatestIdx - LZS_MAX_HISTORY_SIZE;
+    len = pParams->historyLookAheadIdx - delta;
+    memmove(pParams->historyBuffer, pParams->historyBuffer + delta, len);
+    for (i = 0; i < len; i++)
+    {
+        pParams->historyHash[i] = history_slide_idx(pParams->historyHash[i + delta], delta);
+    }
+    hashTable = hash_table_inc(pParams);
+    for (i = 0; i < LZS_HASH_TABLE_ENTRIES(pParams->hashBits); i++)
+    {
+        hashTable[i] = history_slide_idx(hashTable[i] ^ pParams->hashTag, delta) ^ pParams->hashTag;
+    }
+    pParams->historyLatestIdx -= delta;
+    pParams->historyLookAheadIdx -= delta;
+}
+
+#endif // LZS_COMPRESS_LINEAR_HISTORY
+
+// Return the number of bits saved by encoding (offset, length) as an
+// offset/length token, rather than as byte-literals.
+static inline uint_fast16_t lzs_match_gain(uint_fast16_t offset, uint_fast8_t length)
+{
+    uint_fast16_t   width;
+
+    width = 2u + ((offset <= SHORT_OFFSET_MAX) ? SHORT_OFFSET_BITS : LONG_OFFSET_BITS);
+    width += length_width[LZSMIN(length, MAX_SHORT_LENGTH)];
+    if (length >= MAX_SHORT_LENGTH)
+    {
+        width += EXTENDED_LENGTH_BITS * (1u + (length - MAX_SHORT_LENGTH) / MAX_EXTENDED_LENGTH);
+    }
+    return (1u + 8u) * length - width;
+}
+
+// Matches found by lzs_search_matches() are packed into 16 bits, with the
+// length above the offset.
+static inline uint16_t search_match_pack(uint_fast16_t offset, uint_fast8_t length)
+{
+    return (uint16_t)((length << LONG_OFFSET_BITS) | offset);
+}
+
+// Return the length of a packed match, and its offset via pOffset.
+static inline uint_fast8_t search_match_get(uint16_t match, uint_fast16_t * pOffset)
+{
+    *pOffset = match & LONG_OFFSET_MAX;
+    return match >> LONG_OFFSET_BITS;
+}
 
-    for (len = 0; len < matchMax; len++)
+// Find the best match for single-call compression, of the data at inPtr, by
+// searching the hash chains. inputHash is the hash of the data at inPtr, and
+// historyLatestIdx is its historyHash[] index. Hash table entries are tagged with hashTag.
+// Return the match length (0 if no match), and the match offset via pBestOffset.
+static inline uint_fast8_t lzs_find_match(const uint8_t * inPtr, uint_fast8_t matchMax, lzs_input_hash_t inputHash,
+                                          const uint16_t * hashTable, const uint16_t * historyHash, uint_fast16_t hashTag,
+                                          uint_fast16_t historyLatestIdx, size_t historyLen,
+                                          const LzsCompressLevel_t * pLevel, uint_fast16_t * pBestOffset)
+{
+    uint_fast16_t       historyReadIdx;
+    uint_fast16_t       offset;
+    uint_fast8_t        length;
+    uint_fast8_t        best_length;
+    uint_fast8_t        goodLength;
+    uint_fast16_t       chainRemaining;
+    uint16_t            temp16;
+
+
+    best_length = 0;
+    goodLength = LZSMIN(matchMax, pLevel->goodLength);
+    chainRemaining = pLevel->chainDepth;
+    historyReadIdx = hashTable[inputHash] ^ hashTag;
+    if (historyReadIdx < historyLen)
     {
-        if (*aPtr++ != *bPtr++)
+        offset = lzs_idx_delta2_wrap(historyLatestIdx, historyReadIdx, LZS_MAX_HISTORY_SIZE);
+
+        for ( ; offset <= historyLen; )
         {
-            return len;
+            length = lzs_match_len(inPtr, inPtr - offset, matchMax);
+            if (length > best_length)
+            {
+                *pBestOffset = offset;
+                best_length = length;
+                if (length >= goodLength)
+                {
+                    break;
+                }
+            }
+            if (--chainRemaining == 0)
+            {
+                break;
+            }
+
+            // Get next offset from historyHash[]
+            // This involves calculating historyReadIdx to index into it.
+            historyReadIdx = historyHash[historyReadIdx];
+            if (historyReadIdx >= historyLen)
+            {
+                break;
+            }
+            // Calculate new offset.
+            temp16 = lzs_idx_delta2_wrap(historyLatestIdx, historyReadIdx, LZS_MAX_HISTORY_SIZE);
+            if (temp16 <= offset)
+            {
+                break;
+            }
+            offset = temp16;
         }
     }
-    return len;
+    return best_length;
 }
 
-static inline uint_fast8_t lzs_inc_match_len(LzsCompressParameters_t * pParams, uint_fast16_t offset, uint_fast8_t matchMax)
+// Find the best match for incremental compression, of the data starting at
+// historyLookAheadIdx in the history buffer, by searching the hash chains.
+// Return the match length (0 if no match), and the match offset via pBestOffset.
+static inline uint_fast8_t lzs_inc_find_match(LzsCompressParameters_t * pParams, uint_fast16_t historyLookAheadIdx,
+                                              uint_fast8_t matchMax, uint_fast16_t historyLen,
+                                              const LzsCompressLevel_t * pLevel, uint_fast16_t * pBestOffset)
 {
-    uint_fast16_t   historyReadIdx;
-    uint_fast16_t   historyLookAheadIdx;
-    uint_fast8_t    len;
-
+    lzs_input_hash_t    inputHash;
+    uint_fast16_t       historyReadIdx;
+    uint_fast16_t       offset;
+    uint_fast8_t        length;
+    uint_fast8_t        best_length;
+    uint_fast8_t        goodLength;
+    uint_fast16_t       chainRemaining;
+    uint_fast16_t       temp16;
 
-    historyReadIdx = lzs_idx_dec_wrap(pParams->historyLatestIdx, offset,
-                                        sizeof(pParams->historyBuffer));
-    historyLookAheadIdx = pParams->historyLatestIdx;
 
-    for (len = 0; len < matchMax; ++len )
+    best_length = 0;
+    goodLength = LZSMIN(matchMax, pLevel->goodLength);
+    chainRemaining = pLevel->chainDepth;
+    inputHash = inputs_hash_inc(pParams, historyLookAheadIdx);
+    historyReadIdx = hash_table_inc(pParams)[inputHash] ^ pParams->hashTag;
+    if (historyReadIdx < ARRAY_ENTRIES(pParams->historyBuffer))
     {
-        if (pParams->historyBuffer[historyLookAheadIdx] != pParams->historyBuffer[historyReadIdx])
+        // Calculate offset from historyReadIdx.
+        offset = history_offset(historyLookAheadIdx, historyReadIdx);
+
+        for ( ; offset <= historyLen; )
         {
-            return len;
+            length = lzs_inc_match_len(pParams, historyLookAheadIdx, offset, matchMax);
+            if (length > best_length)
+            {
+                *pBestOffset = offset;
+                best_length = length;
+                if (length >= goodLength)
+                {
+                    break;
+                }
+            }
+            if (--chainRemaining == 0)
+            {
+                break;
+            }
+
+            // Get next offset from historyHash[]
+            // This involves calculating historyReadIdx to index into it.
+            historyReadIdx = pParams->historyHash[historyReadIdx];
+            if (historyReadIdx >= ARRAY_ENTRIES(pParams->historyBuffer))
+            {
+                break;
+            }
+
+            // Calculate new offset.
+            temp16 = history_offset(historyLookAheadIdx, historyReadIdx);
+            if (temp16 <= offset)
+            {
+                break;
+            }
+            offset = temp16;
         }
-        historyLookAheadIdx = lzs_idx_inc_wrap(historyLookAheadIdx, 1u,
-                                                sizeof(pParams->historyBuffer));
-        historyReadIdx = lzs_idx_inc_wrap(historyReadIdx, 1u,
-                                                sizeof(pParams->historyBuffer));
     }
-    return len;
+    return best_length;
 }
 
 
@@ -199,53 +545,73 @@ static inline uint_fast8_t lzs_inc_match_len(LzsCompressParameters_t * pParams,
  *
  * No state is kept between calls. Compression is expected to complete in a single call.
  * It will stop if/when it reaches the end of either the input or the output buffer.
+ *
+ * Output buffer space past the returned output length may be overwritten with rubbish.
  */
 size_t lzs_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen)
+{
+    return lzs_compress_level(a_pOutData, a_outBufferSize, a_pInData, a_inLen, LZS_COMPRESS_LEVEL_DEFAULT);
+}
+
+// Single-call compression, with the given search effort settings and hash
+// function. hashTable has LZS_HASH_TABLE_ENTRIES(hashBits) entries, and
+// historyHash has LZS_MAX_HISTORY_SIZE entries. hashTable entries are tagged with hashTag.
+// The primeLen (up to LZS_MAX_HISTORY_SIZE) bytes before a_pInData are put in
+// the history first. If pBitCount isn't NULL, no end marker is added; the last
+// byte is padded with zeros, and the length of the output in bits is returned via pBitCount.
+// If pMatches isn't NULL, matches are looked up in it, from lzs_search_matches(),
+// rather than searched for, and the hash tables aren't used.
+// This is inlined so that it is compiled separately for each constant hashType.
+static LZS_ALWAYS_INLINE size_t lzs_compress_single(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen,
+                                  const LzsCompressLevel_t * pLevel, uint_fast8_t hashType, uint_fast8_t hashBits,
+                                  uint16_t * hashTable, uint16_t * historyHash, uint_fast16_t hashTag,
+                                  size_t primeLen, size_t * pBitCount, const uint16_t * pMatches)
 {
     const uint8_t     * inPtr;
     uint8_t           * outPtr;
-    uint16_t            hashTable[INPUT_HASH_SIZE];
-    uint16_t            historyHash[LZS_MAX_HISTORY_SIZE];
     size_t              historyLen;
     size_t              inRemaining;        // Count of remaining bytes of input
     size_t              outCount;           // Count of output bytes that have been generated
-    uint32_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 31 when shifted left.
+    uint64_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 63 when shifted left.
+    const LzsTokenCode_t  * pTokenCode;
     lzs_input_hash_t    inputHash;
     uint_fast8_t        bitFieldQueueLen;
-    uint_fast16_t       historyReadIdx;
     uint_fast16_t       historyLatestIdx;
-    uint_fast16_t       offset;
+    uint_fast16_t       offset = 0;
     uint_fast8_t        matchMax;
     uint_fast8_t        length;
-    uint_fast16_t       best_offset;
+    uint_fast16_t       best_offset = 0;
     uint_fast8_t        best_length;
+    uint_fast16_t       gain;
+    uint_fast8_t        hashLen;            // Number of input bytes that are hashed
     uint16_t            temp16;
     uint8_t             temp8;
     SimpleCompressState_t state;
 
 
-#if 0
-    // TODO: Do initialisation of hash tables for consistency.
-    for (temp16 = 0; temp16 < ARRAY_ENTRIES(hashTable); temp16++)
-    {
-        hashTable[temp16] = (uint16_t)-1;
-    }
-
-    historyLen = ARRAY_ENTRIES(historyHash);
-    if (historyLen > a_inLen)
-    {
-        historyLen = a_inLen;
-    }
-    for (temp16 = 0; temp16 < historyLen; temp16++)
-    {
-        historyHash[temp16] = (uint16_t)-1;
-    }
-#endif
+    // The caller has cleared hashTable[], or reused it with a new hashTag, so
+    // entries from earlier calls are invalid (see HASH_INDEX_BITS).
+    // historyHash[] needs no initialisation.
 
-    historyLen = 0;
+    hashLen = inputs_hash_len(hashType);
     bitFieldQueue = 0;
     bitFieldQueueLen = 0;
     historyLatestIdx = 0;
+
+    /* Prime the history with the data before the input */
+    for (inPtr = a_pInData - primeLen; inPtr < a_pInData; inPtr++)
+    {
+        if ((size_t)(a_pInData - inPtr) + a_inLen >= hashLen)
+        {
+            inputHash = inputs_hash_ptr(hashType, hashBits, inPtr);
+
+            historyHash[historyLatestIdx] = hashTable[inputHash] ^ hashTag;
+            hashTable[inputHash] = historyLatestIdx ^ hashTag;
+        }
+        historyLatestIdx = lzs_idx_inc_wrap(historyLatestIdx, 1u, LZS_MAX_HISTORY_SIZE);
+    }
+    historyLen = primeLen;
+
     inPtr = a_pInData;
     outPtr = a_pOutData;
     inRemaining = a_inLen;
@@ -254,16 +620,18 @@ size_t lzs_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t
 
     for (;;)
     {
-        /* Copy output bits to output buffer */
-        while (bitFieldQueueLen >= 8u)
+        /* Copy output bits to output buffer, when there are enough of them */
+        if (bitFieldQueueLen >= BIT_QUEUE_FLUSH_BITS)
         {
-            if (outCount >= a_outBufferSize)
+            temp8 = lzs_bit_queue_flush(outPtr, a_outBufferSize - outCount, bitFieldQueue, bitFieldQueueLen);
+            outPtr += temp8;
+            outCount += temp8;
+            bitFieldQueueLen -= 8u * temp8;
+            if (bitFieldQueueLen >= 8u)
             {
+                // We're out of space in the output buffer.
                 return outCount;
             }
-            *outPtr++ = (bitFieldQueue >> (bitFieldQueueLen - 8u));
-            bitFieldQueueLen -= 8u;
-            outCount++;
         }
         if (inRemaining == 0 && state == COMPRESS_NORMAL)
         {
@@ -276,42 +644,53 @@ size_t lzs_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t
             case COMPRESS_NORMAL:
                 /* Look for a match in history */
                 best_length = 0;
-                matchMax = LZSMIN(inRemaining, LZS_SEARCH_MATCH_MAX);
-                if (matchMax >= 2u)
+                matchMax = LZSMIN(inRemaining, pLevel->searchMax);
+                if (pMatches != NULL)
                 {
-                    inputHash = inputs_hash(*inPtr, *(inPtr + 1));
-                    historyReadIdx = hashTable[inputHash];
-                    if (historyReadIdx < historyLen)
+                    best_length = search_match_get(pMatches[inPtr - a_pInData], &best_offset);
+                }
+                else if (matchMax >= hashLen)
+                {
+                    best_length = lzs_find_match(inPtr, matchMax, inputs_hash_ptr(hashType, hashBits, inPtr),
+                                                 hashTable, historyHash, hashTag,
+                                                 historyLatestIdx, historyLen, pLevel, &best_offset);
+                }
+                /* Lazy matching. If a longer match at one of the next positions saves more
+                 * bits, then output a literal now, and consider that match at the next position.
+                 * The saving is compared to taking the current match, then the rest of the
+                 * longer match after it. Extended length matches are taken straight away. */
+                if ((best_length >= MIN_LENGTH) && (best_length < LZSMIN(matchMax, MAX_SHORT_LENGTH)))
+                {
+                    gain = lzs_match_gain(best_offset, best_length);
+                    for (temp8 = 1u; temp8 <= pLevel->lazyDepth; temp8++)
                     {
-                        offset = lzs_idx_delta2_wrap(historyLatestIdx, historyReadIdx, ARRAY_ENTRIES(historyHash));
-
-                        for ( ; offset <= historyLen; )
+                        matchMax = LZSMIN(inRemaining - temp8, pLevel->searchMax);
+                        if (matchMax < hashLen)
                         {
-                            length = lzs_match_len(inPtr, inPtr - offset, matchMax);
-                            if (length > best_length)
-                            {
-                                best_offset = offset;
-                                best_length = length;
-                                if (length >= matchMax)
-                                {
-                                    break;
-                                }
-                            }
-
-                            // Get next offset from historyHash[]
-                            // This involves calculating historyReadIdx to index into it.
-                            historyReadIdx = historyHash[historyReadIdx];
-                            if (historyReadIdx >= historyLen)
-                            {
-                                break;
-                            }
-                            // Calculate new offset.
-                            temp16 = lzs_idx_delta2_wrap(historyLatestIdx, historyReadIdx, ARRAY_ENTRIES(historyHash));
-                            if (temp16 <= offset)
+                            break;
+                        }
+                        if (pMatches != NULL)
+                        {
+                            length = search_match_get(pMatches[temp8 * a_inLen + (inPtr - a_pInData) + temp8], &offset);
+                        }
+                        else
+                        {
+                            length = lzs_find_match(inPtr + temp8, matchMax,
+                                                    inputs_hash_ptr(hashType, hashBits, inPtr + temp8),
+                                                    hashTable, historyHash, hashTag,
+                                                    lzs_idx_inc_wrap(historyLatestIdx, temp8, LZS_MAX_HISTORY_SIZE),
+                                                    LZSMIN(historyLen + temp8, LZS_MAX_HISTORY_SIZE), pLevel, &offset);
+                        }
+                        if (length > best_length)
+                        {
+                            // Length of the rest of this match, after the current match
+                            temp16 = length + temp8 - best_length;
+                            if (lzs_match_gain(offset, length) >
+                                    gain + ((temp16 >= MIN_LENGTH) ? lzs_match_gain(offset, temp16) : 0))
                             {
+                                best_length = 0;
                                 break;
                             }
-                            offset = temp16;
                         }
                     }
                 }
@@ -331,36 +710,11 @@ size_t lzs_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t
                 {
                     LZS_DEBUG(("Best offset %"PRIuFAST16" length %"PRIuFAST8"\n", best_offset, best_length));
                     /* Offset/length token */
-                    /* 1 bit indicates offset/length token */
-                    bitFieldQueue <<= 1u;
-                    bitFieldQueueLen++;
-                    bitFieldQueue |= 1u;
-                    /* Encode offset */
-                    if (best_offset <= SHORT_OFFSET_MAX)
-                    {
-                        /* Short offset */
-                        LZS_DEBUG(("Short offset %"PRIuFAST16"\n", best_offset));
-                        bitFieldQueue <<= (1u + SHORT_OFFSET_BITS);
-                        /* Initial 1 bit indicates short offset */
-                        bitFieldQueue |= (1u << SHORT_OFFSET_BITS) | best_offset;
-                        bitFieldQueueLen += (1u + SHORT_OFFSET_BITS);
-                    }
-                    else
-                    {
-                        /* Long offset */
-                        LZS_DEBUG(("Long offset %"PRIuFAST16"\n", best_offset));
-                        bitFieldQueue <<= (1u + LONG_OFFSET_BITS);
-                        /* Initial 0 bit indicates long offset */
-                        bitFieldQueue |= best_offset;
-                        bitFieldQueueLen += (1u + LONG_OFFSET_BITS);
-                    }
-                    /* Encode length */
                     length = LZSMIN(best_length, MAX_SHORT_LENGTH);
-                    LZS_DEBUG(("Length %"PRIuFAST8"\n", length));
-                    temp8 = length_width[length];
-                    bitFieldQueue <<= temp8;
-                    bitFieldQueue |= length_value[length];
-                    bitFieldQueueLen += temp8;
+                    LZS_DEBUG(("Offset %"PRIuFAST16" length %"PRIuFAST8"\n", best_offset, length));
+                    pTokenCode = &tokenEncodeTable[best_offset > SHORT_OFFSET_MAX][length];
+                    bitFieldQueue = lzs_bit_queue_token(bitFieldQueue, pTokenCode, best_offset);
+                    bitFieldQueueLen += pTokenCode->width;
 
                     if (length == MAX_SHORT_LENGTH)
                     {
@@ -386,49 +740,348 @@ size_t lzs_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t
         }
         // 'length' contains number of input bytes encoded.
         // Update inPtr, inRemaining and hash tables accordingly.
-        for (temp8 = 0; temp8 < length; temp8++)
+        // For a long match, only the first position might be added to the hash tables, depending on level.
+        // Positions too near the end of the input to be hashed are not added.
+        temp16 = (length <= pLevel->insertMax) ? length : 1u;
+        for (temp8 = 0; temp8 < temp16; temp8++)
         {
-            inputHash = inputs_hash(*inPtr, *(inPtr + 1));
-            inPtr++;
+            if (pMatches == NULL && inRemaining - temp8 >= hashLen)
+            {
+                inputHash = inputs_hash_ptr(hashType, hashBits, inPtr);
 
-            historyHash[historyLatestIdx] = hashTable[inputHash];
-            hashTable[inputHash] = historyLatestIdx;
-            historyLatestIdx = lzs_idx_inc_wrap(historyLatestIdx, 1u, ARRAY_ENTRIES(historyHash));
+                historyHash[historyLatestIdx] = hashTable[inputHash] ^ hashTag;
+                hashTable[inputHash] = historyLatestIdx ^ hashTag;
+            }
+            inPtr++;
+            historyLatestIdx = lzs_idx_inc_wrap(historyLatestIdx, 1u, LZS_MAX_HISTORY_SIZE);
         }
+        inPtr += length - temp16;
+        historyLatestIdx = lzs_idx_inc_wrap(historyLatestIdx, length - temp16, LZS_MAX_HISTORY_SIZE);
 
         inRemaining -= length;
 
         historyLen = LZSMIN(historyLen + length, LZS_MAX_HISTORY_SIZE);
     }
-    /* Make end marker, which is like a short offset with value 0, padded out
-     * with 0 to 7 extra zeros to reach a byte boundary. That is,
-     * 0b110000000 */
-    bitFieldQueue <<= (2u + SHORT_OFFSET_BITS + 7u);
-    bitFieldQueueLen += (2u + SHORT_OFFSET_BITS + 7u);
-    bitFieldQueue |= (3u << (SHORT_OFFSET_BITS + 7u));
+    if (pBitCount != NULL)
+    {
+        /* No end marker. Pad out with 0 to 7 zeros to reach a byte boundary. */
+        *pBitCount = 8u * outCount + bitFieldQueueLen;
+        bitFieldQueue <<= 7u;
+        bitFieldQueueLen += 7u;
+    }
+    else
+    {
+        /* Make end marker, which is like a short offset with value 0, padded out
+         * with 0 to 7 extra zeros to reach a byte boundary. That is,
+         * 0b110000000 */
+        bitFieldQueue <<= (2u + SHORT_OFFSET_BITS + 7u);
+        bitFieldQueueLen += (2u + SHORT_OFFSET_BITS + 7u);
+        bitFieldQueue |= (3u << (SHORT_OFFSET_BITS + 7u));
+    }
     /* Copy output bits to output buffer */
-    while (bitFieldQueueLen >= 8u)
+    outCount += lzs_bit_queue_flush(outPtr, a_outBufferSize - outCount, bitFieldQueue, bitFieldQueueLen);
+    return outCount;
+}
+
+// Single-call compression, with the given compression level and hash function,
+// which must already be validated. Otherwise it is the same as lzs_compress_single().
+static size_t lzs_compress_tables(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen,
+                                  uint8_t level, uint_fast8_t hashType, uint_fast8_t hashBits,
+                                  uint16_t * hashTable, uint16_t * historyHash, uint_fast16_t hashTag,
+                                  size_t primeLen, size_t * pBitCount)
+{
+    switch (hashType)
+    {
+        case LZS_HASH_DIRECT:
+            return lzs_compress_single(a_pOutData, a_outBufferSize, a_pInData, a_inLen, compress_level(level),
+                                       LZS_HASH_DIRECT, hashBits, hashTable, historyHash, hashTag,
+                                       primeLen, pBitCount, NULL);
+        case LZS_HASH_MULT2:
+            return lzs_compress_single(a_pOutData, a_outBufferSize, a_pInData, a_inLen, compress_level(level),
+                                       LZS_HASH_MULT2, hashBits, hashTable, historyHash, hashTag,
+                                       primeLen, pBitCount, NULL);
+        case LZS_HASH_MULT3:
+            return lzs_compress_single(a_pOutData, a_outBufferSize, a_pInData, a_inLen, compress_level(level),
+                                       LZS_HASH_MULT3, hashBits, hashTable, historyHash, hashTag,
+                                       primeLen, pBitCount, NULL);
+        default:
+            return lzs_compress_single(a_pOutData, a_outBufferSize, a_pInData, a_inLen, compress_level(level),
+                                       LZS_HASH_DEFAULT, hashBits, hashTable, historyHash, hashTag,
+                                       primeLen, pBitCount, NULL);
+    }
+}
+
+/*
+ * Single-call compression, at a given compression level
+ *
+ * Level is from LZS_COMPRESS_LEVEL_MIN (fastest) to LZS_COMPRESS_LEVEL_MAX (best
+ * compression). Otherwise it is the same as lzs_compress().
+ *
+ * Input no longer than the history window is hashed into a table sized to the
+ * input, which is initialised. So setup time and
+ * cache use scale with the input size, which suits compressing small packets.
+ * Larger input uses a table of INPUT_HASH_SIZE entries, which is initialised
+ * too, so the output depends only on the input and level.
+ */
+size_t lzs_compress_level(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen,
+                          uint8_t level)
+{
+    uint16_t            hashTable[INPUT_HASH_SIZE];
+    uint16_t            historyHash[LZS_MAX_HISTORY_SIZE];
+    uint_fast8_t        hashBits;
+
+    if (a_inLen <= SMALL_INPUT_MAX)
     {
-        if (outCount >= a_outBufferSize)
+        hashBits = LZS_HASH_BITS_MIN;
+        while (hashBits < INPUT_HASH_BITS && SMALL_INPUT_HASH_RATIO * a_inLen > (1u << hashBits))
         {
-            return outCount;
+            hashBits++;
         }
-        *outPtr++ = (bitFieldQueue >> (bitFieldQueueLen - 8u));
-        bitFieldQueueLen -= 8u;
-        outCount++;
+        memset(hashTable, 0xFF, LZS_HASH_TABLE_ENTRIES(hashBits) * sizeof(hashTable[0]));
+        return lzs_compress_tables(a_pOutData, a_outBufferSize, a_pInData, a_inLen, level,
+                                   LZS_HASH_MULT2, hashBits, hashTable, historyHash, 0, 0, NULL);
     }
-    return outCount;
+    memset(hashTable, 0xFF, sizeof(hashTable));
+    return lzs_compress_tables(a_pOutData, a_outBufferSize, a_pInData, a_inLen, level,
+                               LZS_HASH_DEFAULT, INPUT_HASH_BITS, hashTable, historyHash, 0, 0, NULL);
 }
 
 /*
- * \brief Initialise incremental compression
+ * Single-call compression, at a given compression level, with a given hash
+ * function for the match finder
  *
- * This does not initialise the hash tables. The algorithm can still operate
- * correctly regardless of what uninitialised data might be in the hash tables,
- * but execution time would vary depending on the contents of the data in the
- * hash tables.
+ * hashType is one of LzsHashType_t. For LZS_HASH_MULT2 and LZS_HASH_MULT3, hashBits
+ * is the number of bits of hash, from LZS_HASH_BITS_MIN to LZS_HASH_BITS_MAX.
+ * pHashTable points to a hash table of LZS_HASH_TABLE_ENTRIES(hashBits) entries
+ * (LZS_HASH_TABLE_ENTRIES(LZS_HASH_BITS_MAX) for LZS_HASH_DIRECT), which is
+ * initialised by this function. If it is NULL, a table of INPUT_HASH_SIZE
+ * entries on the stack is used instead; then hashBits is limited to
+ * INPUT_HASH_BITS, and LZS_HASH_DIRECT falls back to LZS_HASH_DEFAULT.
+ * Otherwise it is the same as lzs_compress_level().
  */
-void lzs_compress_init_quick(LzsCompressParameters_t * pParams)
+size_t lzs_compress_hash(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen,
+                         uint8_t level, uint8_t hashType, uint8_t hashBits, uint16_t * pHashTable)
+{
+    uint16_t            hashTable[INPUT_HASH_SIZE];
+    uint16_t            historyHash[LZS_MAX_HISTORY_SIZE];
+
+    hash_config(&hashType, &hashBits, pHashTable != NULL);
+    if (pHashTable == NULL)
+    {
+        pHashTable = hashTable;
+    }
+    memset(pHashTable, 0xFF, LZS_HASH_TABLE_ENTRIES(hashBits) * sizeof(pHashTable[0]));
+    return lzs_compress_tables(a_pOutData, a_outBufferSize, a_pInData, a_inLen, level,
+                               hashType, hashBits, pHashTable, historyHash, 0, 0, NULL);
+}
+
+/*
+ * Single-call compression of a segment of a larger input, for lzs_compress_parallel()
+ *
+ * The primeLen (up to LZS_MAX_HISTORY_SIZE) bytes before the segment are put in
+ * the history first, so matches can refer to them. No end marker is added, so
+ * that segments can be joined. The last byte is padded with zeros, and the
+ * length of the output in bits is returned via pBitCount.
+ */
+size_t lzs_compress_segment(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen,
+                            size_t primeLen, uint8_t level, size_t * pBitCount)
+{
+    uint16_t            hashTable[INPUT_HASH_SIZE];
+    uint16_t            historyHash[LZS_MAX_HISTORY_SIZE];
+
+    *pBitCount = 0;
+    memset(hashTable, 0xFF, sizeof(hashTable));
+    return lzs_compress_tables(a_pOutData, a_outBufferSize, a_pInData, a_inLen, level,
+                               LZS_HASH_DEFAULT, INPUT_HASH_BITS, hashTable, historyHash, 0,
+                               LZSMIN(primeLen, LZS_MAX_HISTORY_SIZE), pBitCount);
+}
+
+/*
+ * Number of matches that lzs_search_matches() finds for each input position,
+ * at a compression level: one, and one more for each position that lazy
+ * matching looks ahead. Returns 0 if lzs_compress_level() wouldn't use
+ * LZS_HASH_DEFAULT for input of this size, or the level doesn't add all
+ * positions to the hash tables, so they depend on the choice of matches, and
+ * can't be searched ahead of it.
+ */
+uint_fast8_t lzs_search_matches_per_position(uint8_t level, size_t a_inLen)
+{
+    const LzsCompressLevel_t  * pLevel = compress_level(level);
+
+    if (a_inLen <= SMALL_INPUT_MAX || pLevel->insertMax < LZS_MAX_LOOK_AHEAD_LEN)
+    {
+        return 0;
+    }
+    return 1u + pLevel->lazyDepth;
+}
+
+/*
+ * For each hash, set pHeads[hash] to the history index of the last input
+ * position in [start, end) with that hash, if there is one. This is the hash
+ * table of lzs_compress_level() after those positions, so a table for any
+ * position can be built from tables for the ranges before it.
+ */
+void lzs_search_heads(const uint8_t * a_pInData, size_t a_inLen, size_t start, size_t end, uint16_t * pHeads)
+{
+    size_t              pos;
+
+    for (pos = start; pos < end; pos++)
+    {
+        if (a_inLen - pos >= inputs_hash_len(LZS_HASH_DEFAULT))
+        {
+            pHeads[inputs_hash_ptr(LZS_HASH_DEFAULT, INPUT_HASH_BITS, a_pInData + pos)] = pos % LZS_MAX_HISTORY_SIZE;
+        }
+    }
+}
+
+/*
+ * Find the matches that lzs_compress_level() would find for input positions
+ * in [start, end), for lzs_compress_matches()
+ *
+ * pHeads is the hash table for the position LZS_MAX_HISTORY_SIZE before start,
+ * from lzs_search_heads(), or NULL if start is no more than
+ * LZS_MAX_HISTORY_SIZE. The hash chains are built from there, so
+ * the search sees the same hash chains that lzs_compress_level() would.
+ * For each position, the match for it is put in pMatches[pos], and for lazy
+ * matching, the match for the j'th position after it, searched before it is
+ * added to the hash tables, is put in pMatches[j * a_inLen + pos + j].
+ *
+ * This keeps no state between calls, so ranges can be searched on different
+ * threads at the same time.
+ */
+void lzs_search_matches(const uint8_t * a_pInData, size_t a_inLen, size_t start, size_t end, uint8_t level,
+                        const uint16_t * pHeads, uint16_t * pMatches)
+{
+    const LzsCompressLevel_t  * pLevel = compress_level(level);
+    uint16_t            hashTable[INPUT_HASH_SIZE];
+    uint16_t            historyHash[LZS_MAX_HISTORY_SIZE];
+    lzs_input_hash_t    inputHash;
+    size_t              pos;
+    size_t              queryPos;
+    uint_fast16_t       historyLatestIdx;
+    uint_fast16_t       offset;
+    uint_fast8_t        matchMax;
+    uint_fast8_t        length;
+    uint_fast8_t        hashLen;
+    uint_fast8_t        j;
+
+    hashLen = inputs_hash_len(LZS_HASH_DEFAULT);
+    if (pHeads != NULL)
+    {
+        memcpy(hashTable, pHeads, sizeof(hashTable));
+    }
+    else
+    {
+        memset(hashTable, 0xFF, sizeof(hashTable));
+    }
+    pos = (start > LZS_MAX_HISTORY_SIZE) ? (start - LZS_MAX_HISTORY_SIZE) : 0;
+    historyLatestIdx = pos % LZS_MAX_HISTORY_SIZE;
+    for ( ; pos < end; pos++)
+    {
+        if (pos >= start)
+        {
+            for (j = 0; j <= pLevel->lazyDepth; j++)
+            {
+                queryPos = pos + j;
+                if (queryPos >= a_inLen)
+                {
+                    break;
+                }
+                offset = 0;
+                length = 0;
+                matchMax = LZSMIN(a_inLen - queryPos, pLevel->searchMax);
+                if (matchMax >= hashLen)
+                {
+                    length = lzs_find_match(a_pInData + queryPos, matchMax,
+                                            inputs_hash_ptr(LZS_HASH_DEFAULT, INPUT_HASH_BITS, a_pInData + queryPos),
+                                            hashTable, historyHash, 0,
+                                            lzs_idx_inc_wrap(historyLatestIdx, j, LZS_MAX_HISTORY_SIZE),
+                                            LZSMIN(queryPos, LZS_MAX_HISTORY_SIZE), pLevel, &offset);
+                }
+                pMatches[j * a_inLen + queryPos] = search_match_pack(offset, length);
+            }
+        }
+        if (a_inLen - pos >= hashLen)
+        {
+            inputHash = inputs_hash_ptr(LZS_HASH_DEFAULT, INPUT_HASH_BITS, a_pInData + pos);
+
+            historyHash[historyLatestIdx] = hashTable[inputHash];
+            hashTable[inputHash] = historyLatestIdx;
+        }
+        historyLatestIdx = lzs_idx_inc_wrap(historyLatestIdx, 1u, LZS_MAX_HISTORY_SIZE);
+    }
+}
+
+/*
+ * Single-call compression with the matches found by lzs_search_matches(), for
+ * all of the input. The output is the same as for lzs_compress_level().
+ */
+size_t lzs_compress_matches(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen,
+                            uint8_t level, const uint16_t * pMatches)
+{
+    return lzs_compress_single(a_pOutData, a_outBufferSize, a_pInData, a_inLen, compress_level(level),
+                               LZS_HASH_DEFAULT, INPUT_HASH_BITS, NULL, NULL, 0, 0, NULL, pMatches);
+}
+
+/*
+ * \brief Return the size of the workspace needed by lzs_compress_ws(), for a
+ * given hash function
+ *
+ * hashType and hashBits are as for lzs_compress_hash().
+ */
+size_t lzs_compress_workspace_size(uint8_t hashType, uint8_t hashBits)
+{
+    hash_config(&hashType, &hashBits, true);
+    return sizeof(LzsCompressWorkspace_t) + LZS_HASH_TABLE_ENTRIES(hashBits) * sizeof(uint16_t);
+}
+
+/*
+ * \brief Initialise a workspace for lzs_compress_ws()
+ *
+ * pWorkspace must have the size given by lzs_compress_workspace_size() for the
+ * same hashType and hashBits, and be aligned as for malloc().
+ */
+void lzs_compress_workspace_init(void * pWorkspace, uint8_t hashType, uint8_t hashBits)
+{
+    LzsCompressWorkspace_t    * pWs = pWorkspace;
+
+    hash_config(&hashType, &hashBits, true);
+    pWs->hashType = hashType;
+    pWs->hashBits = hashBits;
+    pWs->hashTag = 0;
+    memset(pWs->historyHash, 0xFF, sizeof(pWs->historyHash));
+    memset(pWs->hashTable, 0xFF, LZS_HASH_TABLE_ENTRIES(hashBits) * sizeof(pWs->hashTable[0]));
+}
+
+/*
+ * Single-call compression, at a given compression level, using a workspace
+ *
+ * The hash tables are kept in the workspace, which has been initialised by
+ * lzs_compress_workspace_init(), rather than on the stack. The workspace can
+ * be reused for any number of calls, without being initialised again, but must
+ * not be used by more than one call at a time. Hash table entries from earlier
+ * calls are made invalid by a generation number, so the output is the same as
+ * for a newly initialised workspace, and tables stay warm in the cache.
+ * Otherwise it is the same as lzs_compress_hash().
+ */
+size_t lzs_compress_ws(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen,
+                       uint8_t level, void * pWorkspace)
+{
+    LzsCompressWorkspace_t    * pWs = pWorkspace;
+    size_t                      outCount;
+
+    outCount = lzs_compress_tables(a_pOutData, a_outBufferSize, a_pInData, a_inLen, level,
+                                   pWs->hashType, pWs->hashBits, pWs->hashTable, pWs->historyHash, pWs->hashTag, 0, NULL);
+    if (hash_tag_next(&pWs->hashTag))
+    {
+        memset(pWs->hashTable, 0xFF, LZS_HASH_TABLE_ENTRIES(pWs->hashBits) * sizeof(pWs->hashTable[0]));
+    }
+    return outCount;
+}
+
+// Initialise the state of incremental compression, apart from the settings
+// and the hash tables.
+static void lzs_compress_init_state(LzsCompressParameters_t * pParams)
 {
     pParams->status = LZS_C_STATUS_NONE;
 
@@ -442,6 +1095,45 @@ void lzs_compress_init_quick(LzsCompressParameters_t * pParams)
     pParams->offset = 0;
 }
 
+/*
+ * \brief Initialise incremental compression
+ *
+ * This does not initialise the hash tables. The algorithm can still operate
+ * correctly regardless of what uninitialised data might be in the hash tables,
+ * but execution time would vary depending on the contents of the data in the
+ * hash tables.
+ */
+void lzs_compress_init_quick(LzsCompressParameters_t * pParams)
+{
+    lzs_compress_init_state(pParams);
+    pParams->level = LZS_COMPRESS_LEVEL_DEFAULT;
+    pParams->pHashTable = NULL;
+    pParams->hashType = LZS_HASH_DEFAULT;
+    pParams->hashBits = INPUT_HASH_BITS;
+    pParams->hashTag = 0;
+}
+
+// Initialise the hash tables for incremental compression, for the hash
+// function that is set, and start the first generation.
+static void lzs_compress_init_tables(LzsCompressParameters_t * pParams)
+{
+    uint16_t      * hashTable;
+    uint_fast32_t   i;
+
+    pParams->hashTag = 0;
+
+    hashTable = hash_table_inc(pParams);
+    for (i = 0; i < LZS_HASH_TABLE_ENTRIES(pParams->hashBits); i++)
+    {
+        hashTable[i] = (uint16_t)-1;
+    }
+
+    for (i = 0; i < ARRAY_ENTRIES(pParams->historyHash); i++)
+    {
+        pParams->historyHash[i] = (uint16_t)-1;
+    }
+}
+
 /*
  * \brief Initialise incremental compression
  *
@@ -450,58 +1142,386 @@ void lzs_compress_init_quick(LzsCompressParameters_t * pParams)
  */
 void lzs_compress_init_full(LzsCompressParameters_t * pParams)
 {
-    uint16_t        temp16;
+    lzs_compress_init_quick(pParams);
+    lzs_compress_init_tables(pParams);
+}
+
+/*
+ * \brief Initialise incremental compression, at a given compression level
+ *
+ * Level is from LZS_COMPRESS_LEVEL_MIN (fastest) to LZS_COMPRESS_LEVEL_MAX (best
+ * compression). Otherwise it is the same as lzs_compress_init_full().
+ */
+void lzs_compress_init_level(LzsCompressParameters_t * pParams, uint8_t level)
+{
+    lzs_compress_init_full(pParams);
+    pParams->level = level;
+}
 
-    for (temp16 = 0; temp16 < ARRAY_ENTRIES(pParams->hashTable); temp16++)
+/*
+ * \brief Initialise incremental compression, at a given compression level, with
+ * a given hash function for the match finder
+ *
+ * hashType, hashBits and pHashTable are as for lzs_compress_hash(). The hash
+ * table must remain valid until compression is finished. Otherwise it is the
+ * same as lzs_compress_init_level().
+ */
+void lzs_compress_init_hash(LzsCompressParameters_t * pParams, uint8_t level,
+                            uint8_t hashType, uint8_t hashBits, uint16_t * pHashTable)
+{
+    lzs_compress_init_quick(pParams);
+    hash_config(&hashType, &hashBits, pHashTable != NULL);
+    pParams->level = level;
+    pParams->pHashTable = pHashTable;
+    pParams->hashType = hashType;
+    pParams->hashBits = hashBits;
+    lzs_compress_init_tables(pParams);
+}
+
+/*
+ * \brief Reset incremental compression, to start compressing new independent data
+ *
+ * pParams must already have been initialised by lzs_compress_init_full(),
+ * lzs_compress_init_level() or lzs_compress_init_hash(). The compression level
+ * and hash function are kept.
+ *
+ * This is as deterministic as those, but much faster, which suits compressing
+ * many small packets each with their own history (as in RFC 1974 or RFC 2395).
+ * Rather than clearing the hash tables, it advances a generation number that
+ * tags the hash table entries, which makes all older entries invalid. The hash
+ * tables are only cleared when the generation number wraps around.
+ */
+void lzs_compress_reset(LzsCompressParameters_t * pParams)
+{
+    lzs_compress_init_state(pParams);
+    if (hash_tag_next(&pParams->hashTag))
     {
-        pParams->hashTable[temp16] = (uint16_t)-1;
+        lzs_compress_init_tables(pParams);
     }
+}
+
+/*
+ * \brief Set a dictionary for incremental compression
+ *
+ * This must be done after initialisation or lzs_compress_reset(), before any
+ * data is compressed. The last LZS_MAX_HISTORY_SIZE bytes of the dictionary
+ * are put in the history, so that matches can be found in them. This improves
+ * compression of small data that is similar to the dictionary. It must be
+ * decompressed with the same dictionary, set by lzs_decompress_set_dictionary().
+ *
+ * To use the same dictionary for many small data, it is faster to set it once
+ * and save the result with lzs_compress_save_dictionary(), then load that with
+ * lzs_compress_load_dictionary() for each one.
+ */
+void lzs_compress_set_dictionary(LzsCompressParameters_t * pParams, const uint8_t * pDict, size_t dictLen)
+{
+    uint16_t          * hashTable;
+    uint_fast16_t       i;
 
-    for (temp16 = 0; temp16 < ARRAY_ENTRIES(pParams->historyHash); temp16++)
+    if (dictLen > LZS_MAX_HISTORY_SIZE)
     {
-        pParams->historyHash[temp16] = (uint16_t)-1;
+        pDict += dictLen - LZS_MAX_HISTORY_SIZE;
+        dictLen = LZS_MAX_HISTORY_SIZE;
     }
+    memcpy(pParams->historyBuffer, pDict, dictLen);
+    pParams->historyLatestIdx = dictLen;
+    pParams->historyLookAheadIdx = history_idx_inc(0, dictLen);
+    pParams->historyLen = dictLen;
+
+    // Add the positions that can be hashed. The rest are added when input arrives.
+    hashTable = hash_table_inc(pParams);
+    for (i = 0; i + inputs_hash_len(pParams->hashType) <= dictLen; i++)
+    {
+        hash_insert_inc(pParams, hashTable, i);
+    }
+}
 
-    lzs_compress_init_quick(pParams);
+/*
+ * \brief Return the size of a saved dictionary for incremental compression
+ *
+ * This is the buffer size that lzs_compress_save_dictionary() needs for the
+ * dictionary that is set in pParams, with its hash function.
+ */
+size_t lzs_compress_dictionary_size(const LzsCompressParameters_t * pParams)
+{
+    return DICTIONARY_HEADER_SIZE +
+           pParams->historyLen * sizeof(uint16_t) +
+           LZS_HASH_TABLE_ENTRIES(pParams->hashBits) * sizeof(uint16_t) +
+           pParams->historyLen;
+}
+
+/*
+ * \brief Save a dictionary for incremental compression
+ *
+ * This saves the dictionary that has just been set in pParams by
+ * lzs_compress_set_dictionary(), with its hash tables, to pBuffer. Return the
+ * size of it, or 0 if bufferSize is too small, or data has already been
+ * compressed.
+ *
+ * It can be loaded with lzs_compress_load_dictionary(), by contexts with the
+ * same hash function. It is little-endian, so it can be loaded on any host. It
+ * is position independent and only read when it is loaded, so it can be kept
+ * in a file that is mapped into memory by many processes.
+ */
+size_t lzs_compress_save_dictionary(const LzsCompressParameters_t * pParams, void * pBuffer, size_t bufferSize)
+{
+    uint8_t                   * pOut = pBuffer;
+    const uint16_t            * hashTable;
+    size_t                      size;
+    uint_fast32_t               entries;
+    uint_fast32_t               i;
+    uint_fast16_t               idx;
+
+    size = lzs_compress_dictionary_size(pParams);
+    if (size > bufferSize ||
+        pParams->historyLatestIdx != pParams->historyLen ||
+        pParams->lookAheadLen != 0 ||
+        pParams->bitFieldQueueLen != 0)
+    {
+        return 0;
+    }
+    pOut[0] = DICTIONARY_MAGIC_0;
+    pOut[1] = DICTIONARY_MAGIC_1;
+    pOut[2] = DICTIONARY_MAGIC_2;
+    pOut[3] = DICTIONARY_MAGIC_3;
+    lzs_store_le16(pOut + 4u, pParams->historyLen);
+    pOut[6] = pParams->hashType;
+    pOut[7] = pParams->hashBits;
+    pOut += DICTIONARY_HEADER_SIZE;
+
+    // Save hash table entries without the generation number tag. Make any
+    // that aren't valid for the dictionary clearly invalid.
+    for (i = 0; i < pParams->historyLen; i++)
+    {
+        idx = pParams->historyHash[i];
+        lzs_store_le16(pOut, (idx < i) ? idx : (uint16_t)-1);
+        pOut += sizeof(uint16_t);
+    }
+    hashTable = (pParams->pHashTable != NULL) ? pParams->pHashTable : pParams->hashTable;
+    entries = LZS_HASH_TABLE_ENTRIES(pParams->hashBits);
+    for (i = 0; i < entries; i++)
+    {
+        idx = hashTable[i] ^ pParams->hashTag;
+        lzs_store_le16(pOut, (idx < pParams->historyLen) ? idx : (uint16_t)-1);
+        pOut += sizeof(uint16_t);
+    }
+    memcpy(pOut, pParams->historyBuffer, pParams->historyLen);
+    return size;
+}
+
+/*
+ * \brief Load a dictionary for incremental compression
+ *
+ * This starts compressing new independent data, as lzs_compress_reset() does,
+ * with the dictionary that was saved by lzs_compress_save_dictionary(). It
+ * copies the saved hash tables, rather than hashing the dictionary, so it is
+ * much faster than lzs_compress_set_dictionary().
+ *
+ * pParams must already have been initialised with the same hash function as
+ * when the dictionary was saved. Otherwise, or if the saved dictionary isn't
+ * valid, return false, and reset without a dictionary. Each saved hash chain
+ * entry must be before its own position, and each hash table entry in the
+ * dictionary, unless it is 0xFFFF for none.
+ */
+bool lzs_compress_load_dictionary(LzsCompressParameters_t * pParams, const void * pBuffer, size_t bufferSize)
+{
+    const uint8_t     * pIn = pBuffer;
+    uint16_t          * hashTable;
+    uint_fast32_t       entries;
+    uint_fast32_t       i;
+    uint_fast16_t       dictLen;
+    uint_fast16_t       idx;
+
+    entries = LZS_HASH_TABLE_ENTRIES(pParams->hashBits);
+    if (bufferSize < DICTIONARY_HEADER_SIZE ||
+        pIn[0] != DICTIONARY_MAGIC_0 ||
+        pIn[1] != DICTIONARY_MAGIC_1 ||
+        pIn[2] != DICTIONARY_MAGIC_2 ||
+        pIn[3] != DICTIONARY_MAGIC_3 ||
+        lzs_load_le16(pIn + 4u) > LZS_MAX_HISTORY_SIZE ||
+        pIn[6] != pParams->hashType ||
+        pIn[7] != pParams->hashBits ||
+        bufferSize < DICTIONARY_HEADER_SIZE + lzs_load_le16(pIn + 4u) * 3u + entries * sizeof(uint16_t))
+    {
+        lzs_compress_reset(pParams);
+        return false;
+    }
+    dictLen = lzs_load_le16(pIn + 4u);
+    pIn += DICTIONARY_HEADER_SIZE;
+
+    // Check the hash chains, then the hash table, before anything is changed
+    for (i = 0; i < dictLen + entries; i++)
+    {
+        idx = lzs_load_le16(pIn + i * sizeof(uint16_t));
+        if (idx != (uint16_t)-1 && idx >= ((i < dictLen) ? i : dictLen))
+        {
+            lzs_compress_reset(pParams);
+            return false;
+        }
+    }
+
+    // All of the hash table is replaced, so the generation number can start again.
+    lzs_compress_init_state(pParams);
+    pParams->hashTag = 0;
+
+    for (i = 0; i < dictLen; i++)
+    {
+        pParams->historyHash[i] = lzs_load_le16(pIn);
+        pIn += sizeof(uint16_t);
+    }
+    hashTable = hash_table_inc(pParams);
+    for (i = 0; i < entries; i++)
+    {
+        hashTable[i] = lzs_load_le16(pIn);
+        pIn += sizeof(uint16_t);
+    }
+    memcpy(pParams->historyBuffer, pIn, dictLen);
+    pParams->historyLatestIdx = dictLen;
+    pParams->historyLookAheadIdx = history_idx_inc(0, dictLen);
+    pParams->historyLen = dictLen;
+    return true;
+}
+
+/*
+ * \brief Move incremental compression to the "simple" version
+ *
+ * This copies the state of incremental compression in pParams, including its
+ * history, to pSimpleParams, so that compression of the same stream can
+ * continue with lzs_simple_compress_incremental(). It is for moving an idle
+ * stream to a smaller memory tier (see LzsSimpleCompressParameters_t).
+ *
+ * pSimpleParams doesn't need to be initialised. Its hash table is not set; it
+ * can be set afterwards by lzs_simple_compress_set_hash(). inPtr, outPtr,
+ * inLength and outLength are copied too.
+ */
+void lzs_compress_to_simple(const LzsCompressParameters_t * pParams, LzsSimpleCompressParameters_t * pSimpleParams)
+{
+    uint_fast16_t       idx;
+    uint_fast16_t       count;
+    uint_fast16_t       i;
+
+    lzs_simple_compress_init(pSimpleParams);
+    pSimpleParams->inPtr = pParams->inPtr;
+    pSimpleParams->outPtr = pParams->outPtr;
+    pSimpleParams->inLength = pParams->inLength;
+    pSimpleParams->outLength = pParams->outLength;
+
+    // Copy the history and look-ahead data to the start of the history buffer.
+    count = pParams->historyLen + pParams->lookAheadLen;
+    idx = history_idx_dec(pParams->historyLatestIdx, pParams->historyLen);
+    for (i = 0; i < count; i++)
+    {
+        pSimpleParams->historyBuffer[i] = pParams->historyBuffer[idx];
+        idx = history_idx_inc(idx, 1u);
+    }
+    pSimpleParams->historyLatestIdx = pParams->historyLen;
+    pSimpleParams->historyLookAheadIdx = lzs_idx_inc_wrap(0, count, sizeof(pSimpleParams->historyBuffer));
+    pSimpleParams->historyLen = pParams->historyLen;
+    pSimpleParams->lookAheadLen = pParams->lookAheadLen;
+    pSimpleParams->bitFieldQueue = pParams->bitFieldQueue;
+    pSimpleParams->bitFieldQueueLen = pParams->bitFieldQueueLen;
+    pSimpleParams->offset = pParams->offset;
+    pSimpleParams->state = pParams->state;
 }
 
+/*
+ * \brief Move incremental compression from the "simple" version
+ *
+ * This is the reverse of lzs_compress_to_simple(). It copies the state of
+ * compression in pSimpleParams, including its history, to pParams, and adds
+ * the history to the hash tables, so that compression of the same stream can
+ * continue with lzs_compress_incremental().
+ *
+ * pParams must already have been initialised by lzs_compress_init_full(),
+ * lzs_compress_init_level() or lzs_compress_init_hash(). The compression level
+ * and hash function are kept, as for lzs_compress_reset().
+ */
+void lzs_compress_from_simple(LzsCompressParameters_t * pParams, const LzsSimpleCompressParameters_t * pSimpleParams)
+{
+    uint16_t          * hashTable;
+    uint_fast16_t       idx;
+    uint_fast16_t       count;
+    uint_fast16_t       i;
+
+    lzs_compress_reset(pParams);
+    pParams->inPtr = pSimpleParams->inPtr;
+    pParams->outPtr = pSimpleParams->outPtr;
+    pParams->inLength = pSimpleParams->inLength;
+    pParams->outLength = pSimpleParams->outLength;
+
+    // Copy the history and look-ahead data to the start of the history buffer.
+    count = pSimpleParams->historyLen + pSimpleParams->lookAheadLen;
+    idx = lzs_idx_dec_wrap(pSimpleParams->historyLatestIdx, pSimpleParams->historyLen,
+                           sizeof(pSimpleParams->historyBuffer));
+    for (i = 0; i < count; i++)
+    {
+        pParams->historyBuffer[i] = pSimpleParams->historyBuffer[idx];
+        idx = lzs_idx_inc_wrap(idx, 1u, sizeof(pSimpleParams->historyBuffer));
+    }
+    pParams->historyLatestIdx = pSimpleParams->historyLen;
+    pParams->historyLookAheadIdx = history_idx_inc(0, count);
+    pParams->historyLen = pSimpleParams->historyLen;
+    pParams->lookAheadLen = pSimpleParams->lookAheadLen;
+    pParams->bitFieldQueue = pSimpleParams->bitFieldQueue;
+    pParams->bitFieldQueueLen = pSimpleParams->bitFieldQueueLen;
+    pParams->offset = pSimpleParams->offset;
+    pParams->state = pSimpleParams->state;
+
+    // Add the history positions, oldest first, that have enough data after
+    // them to hash. The rest are added when more input arrives.
+    hashTable = hash_table_inc(pParams);
+    for (i = 0; i < pParams->historyLen && count - i >= inputs_hash_len(pParams->hashType); i++)
+    {
+        hash_insert_inc(pParams, hashTable, i);
+    }
+}
+
+/*
+ * \brief Incremental compression
+ *
+ * Output buffer space past the final outPtr may be overwritten with rubbish.
+ */
 size_t lzs_compress_incremental(LzsCompressParameters_t * pParams, bool add_end_marker)
 {
+    const LzsCompressLevel_t  * pLevel;
     size_t              outCount;           // Count of output bytes that have been generated
-    lzs_input_hash_t    inputHash;
     uint_fast16_t       historyReadIdx;
-    uint_fast16_t       offset;
+    uint_fast16_t       offset = 0;
     uint_fast8_t        matchMax;
     uint_fast8_t        length;
-    uint_fast16_t       best_offset;
+    uint_fast16_t       best_offset = 0;
     uint_fast8_t        best_length;
+    uint_fast16_t       gain;
     uint_fast16_t       temp16;
     uint_fast8_t        temp8;
+    const LzsTokenCode_t  * pTokenCode;
+    uint16_t          * hashTable;
+    uint_fast8_t        hashLen;            // Number of input bytes that are hashed
 
 
     pParams->status = LZS_C_STATUS_NONE;
+    pLevel = compress_level(pParams->level);
+    hashTable = hash_table_inc(pParams);
+    hashLen = inputs_hash_len(pParams->hashType);
     outCount = 0;
 
     for (;;)
     {
         length = 0;
         // Write data from the bit field queue to output
-        while (pParams->bitFieldQueueLen >= 8u)
+        temp8 = lzs_bit_queue_flush(pParams->outPtr, pParams->outLength,
+                                    pParams->bitFieldQueue, pParams->bitFieldQueueLen);
+        pParams->outPtr += temp8;
+        pParams->outLength -= temp8;
+        pParams->bitFieldQueueLen -= 8u * temp8;
+        outCount += temp8;
+        if (pParams->bitFieldQueueLen >= 8u)
         {
-            // Check if we have space in the output buffer
-            if (pParams->outLength == 0)
-            {
-                // We're out of space in the output buffer.
-                // Set status, exit this inner copying loop, but maintain the current state.
-                pParams->status |= LZS_C_STATUS_NO_OUTPUT_BUFFER_SPACE;
-                break;
-            }
-            *pParams->outPtr++ = (pParams->bitFieldQueue >> (pParams->bitFieldQueueLen - 8u));
-            pParams->outLength--;
-            pParams->bitFieldQueueLen -= 8u;
-            ++outCount;
+            // We're out of space in the output buffer.
+            // Set status, but maintain the current state.
+            pParams->status |= LZS_C_STATUS_NO_OUTPUT_BUFFER_SPACE;
         }
-        if (pParams->bitFieldQueueLen > BIT_QUEUE_BITS)
+        if (pParams->bitFieldQueueLen > BIT_QUEUE64_BITS)
         {
             // It is an error if we ever get here.
             LZS_ASSERT(0);
@@ -525,35 +1545,49 @@ size_t lzs_compress_incremental(LzsCompressParameters_t * pParams, bool add_end_
         }
 
         // Try to fill look-ahead buffer in history buffer
-        temp8 = LZSMIN(LZS_MAX_LOOK_AHEAD_LEN - pParams->lookAheadLen, pParams->inLength);
-        // temp8 holds number of bytes that can be copied from input to look-ahead area of historyBuffer[].
-        // Copy 'temp8' bytes from input into look-ahead area of historyBuffer[].
-        // But before that, update the last entry of the hash tables if needed.
-        if (pParams->lookAheadLen == 0 && pParams->historyLen && temp8)
+#if LZS_COMPRESS_LINEAR_HISTORY
+        // Fill it in blocks, only when it runs low. Make space first if needed.
+        temp8 = 0;
+        if (pParams->lookAheadLen < LZS_MAX_LOOK_AHEAD_LEN && pParams->inLength)
         {
-            historyReadIdx = lzs_idx_dec_wrap(pParams->historyLatestIdx, 1u,
-                                                sizeof(pParams->historyBuffer));
-            inputHash = inputs_hash(pParams->historyBuffer[historyReadIdx],
-                                    *pParams->inPtr);
-
-            pParams->historyHash[historyReadIdx] = pParams->hashTable[inputHash];
-            pParams->hashTable[inputHash] = historyReadIdx;
+            if (sizeof(pParams->historyBuffer) - pParams->historyLookAheadIdx < LZS_COMPRESS_LINEAR_LOOK_AHEAD_LEN)
+            {
+                lzs_compress_slide(pParams);
+            }
+            temp8 = LZSMIN(LZS_COMPRESS_LINEAR_LOOK_AHEAD_LEN - pParams->lookAheadLen, pParams->inLength);
         }
+#else
+        temp8 = LZSMIN(LZS_MAX_LOOK_AHEAD_LEN - pParams->lookAheadLen, pParams->inLength);
+#endif
+        // temp8 holds number of bytes that can be copied from input to look-ahead area of historyBuffer[].
+        // Note how many of the latest history positions couldn't be hashed yet, for lack of following data.
+        temp16 = (pParams->lookAheadLen < hashLen - 1u) ? LZSMIN(hashLen - 1u - pParams->lookAheadLen, pParams->historyLen) : 0;
         pParams->lookAheadLen += temp8;
         pParams->inLength -= temp8;
         // Copy 'temp8' bytes from input into look-ahead area of historyBuffer[].
+#if LZS_COMPRESS_LINEAR_HISTORY
+        memcpy(pParams->historyBuffer + pParams->historyLookAheadIdx, pParams->inPtr, temp8);
+        pParams->inPtr += temp8;
+        pParams->historyLookAheadIdx += temp8;
+#else
         while (temp8--)
         {
             pParams->historyBuffer[pParams->historyLookAheadIdx] = *pParams->inPtr++;
             pParams->historyLookAheadIdx = lzs_idx_inc_wrap(pParams->historyLookAheadIdx, 1u,
                                                             sizeof(pParams->historyBuffer));
         }
+#endif
+        // Add those positions to the hash tables, oldest first, now that there is enough data to hash them.
+        for ( ; temp16 != 0 && temp16 + pParams->lookAheadLen >= hashLen; temp16--)
+        {
+            hash_insert_inc(pParams, hashTable, history_idx_dec(pParams->historyLatestIdx, temp16));
+        }
 
         // Process input data in a state machine
         switch (pParams->state)
         {
             case COMPRESS_NORMAL:
-                matchMax = add_end_marker ? 1u : LZS_SEARCH_MATCH_MAX;
+                matchMax = add_end_marker ? 1u : pLevel->searchMax;
                 if (pParams->lookAheadLen < matchMax)
                 {
                     // We don't have enough input data, so we're done for now.
@@ -563,46 +1597,40 @@ size_t lzs_compress_incremental(LzsCompressParameters_t * pParams, bool add_end_
 
                 // Look for a match in history.
                 best_length = 0;
-                matchMax = LZSMIN(pParams->lookAheadLen, LZS_SEARCH_MATCH_MAX);
-                if (matchMax >= 2u)
+                matchMax = LZSMIN(pParams->lookAheadLen, pLevel->searchMax);
+                if (matchMax >= hashLen)
+                {
+                    best_length = lzs_inc_find_match(pParams, pParams->historyLatestIdx, matchMax,
+                                                     pParams->historyLen, pLevel, &best_offset);
+                }
+                // Lazy matching. If a longer match at one of the next positions saves more
+                // bits, then output a literal now, and consider that match at the next position.
+                // The saving is compared to taking the current match, then the rest of the
+                // longer match after it. Extended length matches are taken straight away.
+                if ((best_length >= MIN_LENGTH) && (best_length < LZSMIN(matchMax, MAX_SHORT_LENGTH)))
                 {
-                    inputHash = inputs_hash_inc(pParams);
-                    historyReadIdx = pParams->hashTable[inputHash];
-                    if (historyReadIdx < ARRAY_ENTRIES(pParams->historyBuffer))
+                    gain = lzs_match_gain(best_offset, best_length);
+                    for (temp8 = 1u; temp8 <= pLevel->lazyDepth; temp8++)
                     {
-                        // Calculate offset from historyReadIdx.
-                        offset = lzs_idx_delta2_wrap(pParams->historyLatestIdx, historyReadIdx,
-                                                     ARRAY_ENTRIES(pParams->historyHash));
-
-                        for ( ; offset <= pParams->historyLen; )
+                        matchMax = LZSMIN(pParams->lookAheadLen - temp8, pLevel->searchMax);
+                        if (matchMax < hashLen)
                         {
-                            length = lzs_inc_match_len(pParams, offset, matchMax);
-                            if (length > best_length)
-                            {
-                                best_offset = offset;
-                                best_length = length;
-                                if (length >= matchMax)
-                                {
-                                    break;
-                                }
-                            }
-
-                            // Get next offset from historyHash[]
-                            // This involves calculating historyReadIdx to index into it.
-                            historyReadIdx = pParams->historyHash[historyReadIdx];
-                            if (historyReadIdx >= ARRAY_ENTRIES(pParams->historyBuffer))
-                            {
-                                break;
-                            }
-
-                            // Calculate new offset.
-                            temp16 = lzs_idx_delta2_wrap(pParams->historyLatestIdx, historyReadIdx,
-                                                        ARRAY_ENTRIES(pParams->historyHash));
-                            if (temp16 <= offset)
+                            break;
+                        }
+                        length = lzs_inc_find_match(pParams,
+                                                    history_idx_inc(pParams->historyLatestIdx, temp8),
+                                                    matchMax, LZSMIN(pParams->historyLen + temp8, LZS_MAX_HISTORY_SIZE),
+                                                    pLevel, &offset);
+                        if (length > best_length)
+                        {
+                            // Length of the rest of this match, after the current match
+                            temp16 = length + temp8 - best_length;
+                            if (lzs_match_gain(offset, length) >
+                                    gain + ((temp16 >= MIN_LENGTH) ? lzs_match_gain(offset, temp16) : 0))
                             {
+                                best_length = 0;
                                 break;
                             }
-                            offset = temp16;
                         }
                     }
                 }
@@ -623,36 +1651,11 @@ size_t lzs_compress_incremental(LzsCompressParameters_t * pParams, bool add_end_
                 {
                     LZS_DEBUG(("Best offset %"PRIuFAST16" length %"PRIuFAST8"\n", best_offset, best_length));
                     /* Offset/length token */
-                    /* 1 bit indicates offset/length token */
-                    pParams->bitFieldQueue <<= 1u;
-                    pParams->bitFieldQueueLen++;
-                    pParams->bitFieldQueue |= 1u;
-                    /* Encode offset */
-                    if (best_offset <= SHORT_OFFSET_MAX)
-                    {
-                        /* Short offset */
-                        LZS_DEBUG(("Short offset %"PRIuFAST16"\n", best_offset));
-                        pParams->bitFieldQueue <<= (1u + SHORT_OFFSET_BITS);
-                        /* Initial 1 bit indicates short offset */
-                        pParams->bitFieldQueue |= (1u << SHORT_OFFSET_BITS) | best_offset;
-                        pParams->bitFieldQueueLen += (1u + SHORT_OFFSET_BITS);
-                    }
-                    else
-                    {
-                        /* Long offset */
-                        LZS_DEBUG(("Long offset %"PRIuFAST16"\n", best_offset));
-                        pParams->bitFieldQueue <<= (1u + LONG_OFFSET_BITS);
-                        /* Initial 0 bit indicates long offset */
-                        pParams->bitFieldQueue |= best_offset;
-                        pParams->bitFieldQueueLen += (1u + LONG_OFFSET_BITS);
-                    }
-                    /* Encode length */
                     length = LZSMIN(best_length, MAX_SHORT_LENGTH);
-                    LZS_DEBUG(("Length %"PRIuFAST8"\n", length));
-                    temp8 = length_width[length];
-                    pParams->bitFieldQueue <<= temp8;
-                    pParams->bitFieldQueue |= length_value[length];
-                    pParams->bitFieldQueueLen += temp8;
+                    LZS_DEBUG(("Offset %"PRIuFAST16" length %"PRIuFAST8"\n", best_offset, length));
+                    pTokenCode = &tokenEncodeTable[best_offset > SHORT_OFFSET_MAX][length];
+                    pParams->bitFieldQueue = lzs_bit_queue_token(pParams->bitFieldQueue, pTokenCode, best_offset);
+                    pParams->bitFieldQueueLen += pTokenCode->width;
 
                     if (length == MAX_SHORT_LENGTH)
                     {
@@ -674,7 +1677,7 @@ size_t lzs_compress_incremental(LzsCompressParameters_t * pParams, bool add_end_
 
                 // Get next length of extended match.
                 matchMax = LZSMIN(pParams->lookAheadLen, MAX_EXTENDED_LENGTH);
-                length = lzs_inc_match_len(pParams, pParams->offset, matchMax);
+                length = lzs_inc_match_len(pParams, pParams->historyLatestIdx, pParams->offset, matchMax);
                 LZS_DEBUG(("Extended length %"PRIuFAST8"\n", length));
 
                 /* Encode length */
@@ -689,18 +1692,15 @@ size_t lzs_compress_incremental(LzsCompressParameters_t * pParams, bool add_end_
                 break;
         }
         // 'length' contains number of input bytes encoded.
+        // For a long match, only the first position might be added to the hash tables, depending on level.
+        temp16 = (length <= pLevel->insertMax) ? length : 1u;
         for (temp8 = 0; temp8 < length; temp8++)
         {
-            historyReadIdx = lzs_idx_inc_wrap(pParams->historyLatestIdx, 1u,
-                                                sizeof(pParams->historyBuffer));
+            historyReadIdx = history_idx_inc(pParams->historyLatestIdx, 1u);
             pParams->lookAheadLen--;
-            if (pParams->lookAheadLen)
+            if (pParams->lookAheadLen >= hashLen - 1u && temp8 < temp16)
             {
-                inputHash = inputs_hash(pParams->historyBuffer[pParams->historyLatestIdx],
-                                        pParams->historyBuffer[historyReadIdx]);
-
-                pParams->historyHash[pParams->historyLatestIdx] = pParams->hashTable[inputHash];
-                pParams->hashTable[inputHash] = pParams->historyLatestIdx;
+                hash_insert_inc(pParams, hashTable, pParams->historyLatestIdx);
             }
             pParams->historyLatestIdx = historyReadIdx;
         }
@@ -723,13 +1723,11 @@ size_t lzs_compress_incremental(LzsCompressParameters_t * pParams, bool add_end_
         pParams->bitFieldQueueLen += (2u + SHORT_OFFSET_BITS + 7u);
         pParams->bitFieldQueue |= (3u << (SHORT_OFFSET_BITS + 7u));
         /* Copy output bits to output buffer */
-        while (pParams->bitFieldQueueLen >= 8u)
-        {
-            *pParams->outPtr++ = (pParams->bitFieldQueue >> (pParams->bitFieldQueueLen - 8u));
-            pParams->outLength--;
-            pParams->bitFieldQueueLen -= 8u;
-            ++outCount;
-        }
+        temp8 = lzs_bit_queue_flush(pParams->outPtr, pParams->outLength,
+                                    pParams->bitFieldQueue, pParams->bitFieldQueueLen);
+        pParams->outPtr += temp8;
+        pParams->outLength -= temp8;
+        outCount += temp8;
         pParams->bitFieldQueueLen = 0;
         pParams->status |= LZS_C_STATUS_END_MARKER;
     }
@@ -62,6 +62,44 @@
 // Choose which method to use
 #define LENGTH_DECODE_METHOD        LENGTH_DECODE_METHOD_TABLE
 
+// Input is loaded into the bit field queue when it has fewer bits than this.
+// Then each load tops it up with several bytes at once. This must be more
+// than the widest field that is decoded in one step (see TOKEN_DECODE_BITS).
+#define BIT_QUEUE_REFILL_LEN        32u
+
+// lzs_decompress_incremental() uses its fast inner loop while at least this much
+// input and output buffer space remains. A token never needs more than 8 bytes of
+// input (after a refill) and never produces more than MAX_EXTENDED_LENGTH bytes of
+// output (plus the match copy slack), so no buffer checks are needed within a
+// single token.
+#define INCREMENTAL_FAST_MIN_INPUT  sizeof(uint64_t)
+#define INCREMENTAL_FAST_MIN_OUTPUT (MAX_EXTENDED_LENGTH + MATCH_COPY_SLACK)
+
+// lzs_match_copy() copies in chunks of this many bytes. So it may write up to
+// this many bytes past the end of the match, which must be within the output buffer.
+#define MATCH_COPY_WIDTH            8u
+#define MATCH_COPY_SLACK            MATCH_COPY_WIDTH
+
+// LZS_DECOMPRESS_IN_PLACE_MARGIN() allows for the match copy slack.
+#if LZS_DECOMPRESS_IN_PLACE_MARGIN(0) != 2u + MATCH_COPY_SLACK
+#error "LZS_DECOMPRESS_IN_PLACE_MARGIN() must allow for MATCH_COPY_SLACK"
+#endif
+
+// lzs_decompress_skip() uses its fast inner loop while at least this many bytes
+// remain to be skipped. It writes only to the history buffer, so there's no
+// match copy slack.
+#define SKIP_FAST_MIN_OUTPUT        MAX_EXTENDED_LENGTH
+
+// Number of leading bits of a token used to index tokenDecodeTable[].
+// This covers a short-offset token with a 4-bit length (1 + 1 + 7 + 4 bits).
+#define TOKEN_DECODE_BITS           (2u + SHORT_OFFSET_BITS + LENGTH_MAX_BIT_WIDTH)
+
+// Token classes in the upper nibble of a tokenDecodeTable[] entry.
+// Values 2 to 8 in the upper nibble are the length of a short-offset token.
+#define TOKEN_CLASS_LITERAL         0
+#define TOKEN_CLASS_END_MARKER      1u
+#define TOKEN_CLASS_LONG_OFFSET     0xFu
+
 //#define LZS_DEBUG(X)    printf X
 #define LZS_DEBUG(X)
 
@@ -78,21 +116,6 @@ typedef enum
     DECOMPRESS_EXTENDED
 } SimpleDecompressState_t;
 
-typedef enum
-{
-    DECOMPRESS_COPY_DATA,           // Must come before DECOMPRESS_GET_TOKEN_TYPE, so state transition can be done by increment
-    DECOMPRESS_GET_TOKEN_TYPE,
-    DECOMPRESS_GET_LITERAL,
-    DECOMPRESS_GET_OFFSET_TYPE,
-    DECOMPRESS_GET_OFFSET_SHORT,
-    DECOMPRESS_GET_OFFSET_LONG,
-    DECOMPRESS_GET_LENGTH,
-    DECOMPRESS_COPY_EXTENDED_DATA,  // Must come before DECOMPRESS_GET_EXTENDED_LENGTH, so state transition can be done by increment
-    DECOMPRESS_GET_EXTENDED_LENGTH,
-
-    NUM_DECOMPRESS_STATES
-} LzsDecompressState_t;
-
 
 /*****************************************************************************
  * Tables
@@ -121,6 +144,53 @@ static const uint8_t lengthDecodeTable[(1u << LENGTH_MAX_BIT_WIDTH)] =
 #endif
 
 
+/* Whole-token decode table, indexed by the next TOKEN_DECODE_BITS bits of input.
+ * Each entry maps the token to a class and a number of bits used for it.
+ * High 4 bits are the token class (see TOKEN_CLASS_...), or the length of a
+ * short-offset token. Low 4 bits are the width of the token in bits.
+ *
+ *  0b0xxxxxxxx --> literal, 9 bits
+ *  0b110000000 --> end marker, 9 bits
+ *  0b11 ooooooo LL --> short offset and length 2, 3 or 4, 11 bits
+ *  0b11 ooooooo 11LL --> short offset and length 5, 6, 7 or 8 (extended), 13 bits
+ *  0b10 ooooooooooo --> long offset, 13 bits, with length to follow
+ *
+ * The table is generated by the preprocessor, from the expression in
+ * TOKEN_DECODE_ENTRY(). It takes 8 kB.
+ */
+#define TOKEN_SHORT_LENGTH_ENTRY(L) \
+    (((L) < 0xCu) ? \
+        (((((L) >> 2u) + 2u) << 4u) | (2u + SHORT_OFFSET_BITS + 2u)) : \
+        ((((L) - 0xCu + 5u) << 4u) | (2u + SHORT_OFFSET_BITS + 4u)))
+#define TOKEN_DECODE_ENTRY(I) \
+    ((((I) & 0x1000u) == 0) ? ((TOKEN_CLASS_LITERAL << 4u) | (1u + 8u)) : \
+     (((I) & 0x0800u) == 0) ? ((TOKEN_CLASS_LONG_OFFSET << 4u) | (2u + LONG_OFFSET_BITS)) : \
+     (((I) & 0x07F0u) == 0) ? ((TOKEN_CLASS_END_MARKER << 4u) | (2u + SHORT_OFFSET_BITS)) : \
+     TOKEN_SHORT_LENGTH_ENTRY((I) & 0xFu))
+#define TOKEN_DECODE_ENTRIES_4(I)       TOKEN_DECODE_ENTRY(I), TOKEN_DECODE_ENTRY((I) + 1u), \
+                                        TOKEN_DECODE_ENTRY((I) + 2u), TOKEN_DECODE_ENTRY((I) + 3u)
+#define TOKEN_DECODE_ENTRIES_16(I)      TOKEN_DECODE_ENTRIES_4(I), TOKEN_DECODE_ENTRIES_4((I) + 0x4u), \
+                                        TOKEN_DECODE_ENTRIES_4((I) + 0x8u), TOKEN_DECODE_ENTRIES_4((I) + 0xCu)
+#define TOKEN_DECODE_ENTRIES_64(I)      TOKEN_DECODE_ENTRIES_16(I), TOKEN_DECODE_ENTRIES_16((I) + 0x10u), \
+                                        TOKEN_DECODE_ENTRIES_16((I) + 0x20u), TOKEN_DECODE_ENTRIES_16((I) + 0x30u)
+#define TOKEN_DECODE_ENTRIES_256(I)     TOKEN_DECODE_ENTRIES_64(I), TOKEN_DECODE_ENTRIES_64((I) + 0x40u), \
+                                        TOKEN_DECODE_ENTRIES_64((I) + 0x80u), TOKEN_DECODE_ENTRIES_64((I) + 0xC0u)
+#define TOKEN_DECODE_ENTRIES_1024(I)    TOKEN_DECODE_ENTRIES_256(I), TOKEN_DECODE_ENTRIES_256((I) + 0x100u), \
+                                        TOKEN_DECODE_ENTRIES_256((I) + 0x200u), TOKEN_DECODE_ENTRIES_256((I) + 0x300u)
+#define TOKEN_DECODE_ENTRIES_4096(I)    TOKEN_DECODE_ENTRIES_1024(I), TOKEN_DECODE_ENTRIES_1024((I) + 0x400u), \
+                                        TOKEN_DECODE_ENTRIES_1024((I) + 0x800u), TOKEN_DECODE_ENTRIES_1024((I) + 0xC00u)
+
+#if TOKEN_DECODE_BITS != 13u
+#error tokenDecodeTable[] generation assumes 13-bit index
+#endif
+
+static const uint8_t tokenDecodeTable[(1u << TOKEN_DECODE_BITS)] =
+{
+    TOKEN_DECODE_ENTRIES_4096(0u),
+    TOKEN_DECODE_ENTRIES_4096(0x1000u),
+};
+
+
 static const uint_fast8_t StateBitMinimumWidth[NUM_DECOMPRESS_STATES] =
 {
     0,                          // DECOMPRESS_COPY_DATA,
@@ -139,12 +209,56 @@ static const uint_fast8_t StateBitMinimumWidth[NUM_DECOMPRESS_STATES] =
  * Functions
  ****************************************************************************/
 
+/*
+ * Copy a match of (offset, length) bytes within the output buffer.
+ *
+ * The whole match must be within the output data, ie offset must be no more than
+ * the number of bytes already written before pOut. It copies MATCH_COPY_WIDTH bytes
+ * at a time, so it may write up to MATCH_COPY_SLACK bytes of rubbish past the end
+ * of the match. The caller must make sure that is still within the output buffer.
+ */
+static inline void lzs_match_copy(uint8_t * pOut, uint_fast16_t offset, uint_fast8_t length)
+{
+    const uint8_t     * pEnd;
+    uint_fast16_t       i;
+
+
+    pEnd = pOut + length;
+    if (offset == 1u)
+    {
+        // Run of a single byte value
+        memset(pOut, *(pOut - 1), length);
+        return;
+    }
+    if (offset < MATCH_COPY_WIDTH)
+    {
+        // The match overlaps its source within one chunk. Copy the first chunk by
+        // bytes, to replicate the pattern. After that, copy whole chunks from a
+        // multiple of offset back, which is far enough back not to overlap.
+        for (i = 0; i < MATCH_COPY_WIDTH; i++)
+        {
+            pOut[i] = *(pOut + i - offset);
+        }
+        pOut += MATCH_COPY_WIDTH;
+        offset *= (MATCH_COPY_WIDTH + offset - 1u) / offset;
+    }
+    for ( ; pOut < pEnd; pOut += MATCH_COPY_WIDTH)
+    {
+        memcpy(pOut, pOut - offset, MATCH_COPY_WIDTH);
+    }
+}
+
 /*
  * Single-call decompression
  *
  * No state is kept between calls. Decompression is expected to complete in a single call.
  * It will stop if/when it reaches the end of either the input or the output buffer,
  * or when it reaches an end-marker.
+ *
+ * Output buffer space past the returned output length may be overwritten with rubbish.
+ *
+ * The input and output buffers must not overlap, except as done by
+ * lzs_decompress_in_place().
  */
 size_t lzs_decompress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen)
 {
@@ -152,10 +266,11 @@ size_t lzs_decompress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_
     uint8_t           * outPtr;
     size_t              inRemaining;        // Count of remaining bytes of input
     size_t              outCount;           // Count of output bytes that have been generated
-    uint32_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 31 when shifted left.
+    uint64_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 63 when shifted left.
     uint_fast8_t        bitFieldQueueLen;
     uint_fast16_t       offset = 0;
     uint_fast8_t        length;
+    uint_fast16_t       width;
     uint8_t             temp8;
     SimpleDecompressState_t state;
 
@@ -171,19 +286,35 @@ size_t lzs_decompress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_
     for (;;)
     {
         // Load input data into the bit field queue
-        while ((inRemaining > 0) && (bitFieldQueueLen <= BIT_QUEUE_BITS - 8u))
+        if (bitFieldQueueLen < BIT_QUEUE_REFILL_LEN)
         {
-            bitFieldQueue |= (*inPtr++ << (BIT_QUEUE_BITS - 8u - bitFieldQueueLen));
-            bitFieldQueueLen += 8u;
-            //LZS_DEBUG(("Load queue: %04X\n", bitFieldQueue));
-            inRemaining--;
+            if (inRemaining >= sizeof(uint64_t))
+            {
+                // Load as many whole bytes as fit, in one step
+                width = (BIT_QUEUE64_BITS - bitFieldQueueLen) & ~7u;
+                bitFieldQueue |= lzs_load_be64_bits(inPtr, width) >> bitFieldQueueLen;
+                bitFieldQueueLen += width;
+                inPtr += width / 8u;
+                inRemaining -= width / 8u;
+            }
+            else
+            {
+                // Near the end of input, load one byte at a time
+                while ((inRemaining > 0) && (bitFieldQueueLen <= BIT_QUEUE64_BITS - 8u))
+                {
+                    bitFieldQueue |= ((uint64_t)*inPtr++ << (BIT_QUEUE64_BITS - 8u - bitFieldQueueLen));
+                    bitFieldQueueLen += 8u;
+                    //LZS_DEBUG(("Load queue: %016"PRIX64"\n", bitFieldQueue));
+                    inRemaining--;
+                }
+            }
         }
         // Check if we've reached the end of our input data
         if (bitFieldQueueLen == 0)
         {
             break;
         }
-        if (bitFieldQueueLen > BIT_QUEUE_BITS)
+        if (bitFieldQueueLen > BIT_QUEUE64_BITS)
         {
             // It is an error if we ever get here.
             LZS_ASSERT(0);
@@ -198,179 +329,119 @@ size_t lzs_decompress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_
         switch (state)
         {
             case DECOMPRESS_NORMAL:
-                // Get token-type bit
-                //      0 means literal byte
-                //      1 means offset/length token
-
-                // We don't need to check bitFieldQueueLen here because
-                // we already checked above that there is at least 1 bit.
-                temp8 = (bitFieldQueue & (1u << (BIT_QUEUE_BITS - 1u))) ? 1u : 0;
-                bitFieldQueue <<= 1u;
-                bitFieldQueueLen--;
-                if (temp8 == 0)
-                {
-                    // Literal
-                    if (bitFieldQueueLen < 8u)
+                if ((bitFieldQueue & ((uint64_t)1u << (BIT_QUEUE64_BITS - 1u))) == 0)
+                {
+                    // Literal. Byte value follows the 0 token-type bit.
+                    if (bitFieldQueueLen < 1u + 8u)
                     {
                         goto finish;
                     }
-                    temp8 = (uint8_t) (bitFieldQueue >> (BIT_QUEUE_BITS - 8u));
-                    bitFieldQueue <<= 8u;
-                    bitFieldQueueLen -= 8u;
+                    temp8 = (uint8_t) (bitFieldQueue >> (BIT_QUEUE64_BITS - 1u - 8u));
+                    bitFieldQueue <<= (1u + 8u);
+                    bitFieldQueueLen -= (1u + 8u);
                     LZS_DEBUG(("Literal %c (%02X)\n", isprint(temp8) ? temp8 : '?', temp8));
 
                     // Write to output
                     // Not necessary to check for space, because that was done at the top of the main loop.
                     *outPtr++ = temp8;
                     outCount++;
+                    break;
+                }
+                // Offset+length token.
+                // Look up the whole token from its leading bits. This gives the token
+                // class, its bit width, and for short-offset tokens the length too.
+                // Bits beyond the end of the queue are zero, so the look-up is safe
+                // even when the queue is short; the width check below catches that.
+                temp8 = tokenDecodeTable[bitFieldQueue >> (BIT_QUEUE64_BITS - TOKEN_DECODE_BITS)];
+                width = temp8 & 0xF;
+                if (bitFieldQueueLen < width)
+                {
+                    goto finish;
+                }
+                length = temp8 >> 4u;
+                if (length == TOKEN_CLASS_END_MARKER)
+                {
+                    LZS_DEBUG(("End marker\n"));
+                    // Stop at end marker
+                    goto finish;
+                }
+                if (length != TOKEN_CLASS_LONG_OFFSET)
+                {
+                    // Short offset, with the length already decoded by the table look-up.
+                    offset = (bitFieldQueue >> (BIT_QUEUE64_BITS - 2u - SHORT_OFFSET_BITS)) & SHORT_OFFSET_MAX;
+                    bitFieldQueue <<= width;
+                    bitFieldQueueLen -= width;
                 }
                 else
                 {
-                    // Offset+length token
-                    // Decode offset
-                    if (bitFieldQueueLen < 1u)
+                    // Long offset. The table look-up only covers the offset; the length
+                    // follows it, so it is decoded separately.
+                    offset = (bitFieldQueue >> (BIT_QUEUE64_BITS - 2u - LONG_OFFSET_BITS)) & LONG_OFFSET_MAX;
+                    bitFieldQueue <<= width;
+                    bitFieldQueueLen -= width;
+                    if (offset == 0)
                     {
-                        goto finish;
+                        // Not a valid token. Skip it.
+                        break;
                     }
-                    temp8 = (bitFieldQueue & (1u << (BIT_QUEUE_BITS - 1u))) ? 1u : 0;
-                    bitFieldQueue <<= 1u;
-                    bitFieldQueueLen--;
-                    if (temp8)
+#if LENGTH_DECODE_METHOD == LENGTH_DECODE_METHOD_CODE
+                    /* Length is encoded as:
+                     *  0b00 --> 2
+                     *  0b01 --> 3
+                     *  0b10 --> 4
+                     *  0b1100 --> 5
+                     *  0b1101 --> 6
+                     *  0b1110 --> 7
+                     *  0b1111 xxxx --> 8 (extended)
+                     */
+                    // Get 4 bits
+                    temp8 = (uint8_t) (bitFieldQueue >> (BIT_QUEUE64_BITS - 4u));
+                    if (temp8 < 0xC)    // 0xC is 0b1100
                     {
-                        // Short offset
-                        if (bitFieldQueueLen < SHORT_OFFSET_BITS)
-                        {
-                            goto finish;
-                        }
-                        offset = bitFieldQueue >> (BIT_QUEUE_BITS - SHORT_OFFSET_BITS);
-                        bitFieldQueue <<= SHORT_OFFSET_BITS;
-                        bitFieldQueueLen -= SHORT_OFFSET_BITS;
-                        if (offset == 0)
-                        {
-                            LZS_DEBUG(("End marker\n"));
-#if 1
-                            // Stop at end marker
-                            goto finish;
-#else
-                            // Discard any bits that are fractions of a byte, to align with a byte boundary
-                            temp8 = bitFieldQueueLen % 8u;
-                            bitFieldQueue <<= temp8;
-                            bitFieldQueueLen -= temp8;
-#endif
-                        }
+                        // Length of 2, 3 or 4, encoded in 2 bits
+                        length = (temp8 >> 2u) + 2u;
+                        width = 2u;
                     }
                     else
                     {
-                        // Long offset
-                        if (bitFieldQueueLen < LONG_OFFSET_BITS)
-                        {
-                            goto finish;
-                        }
-                        offset = bitFieldQueue >> (BIT_QUEUE_BITS - LONG_OFFSET_BITS);
-                        bitFieldQueue <<= LONG_OFFSET_BITS;
-                        bitFieldQueueLen -= LONG_OFFSET_BITS;
+                        // Length (encoded in 4 bits) of 5, 6, 7, or (8 + extended)
+                        length = (temp8 - 0xC + 5u);
+                        width = 4u;
                     }
-                    if (offset != 0)
-                    {
-                        // Decode length and copy characters
-#if LENGTH_DECODE_METHOD == LENGTH_DECODE_METHOD_CODE
-                        /* Length is encoded as:
-                         *  0b00 --> 2
-                         *  0b01 --> 3
-                         *  0b10 --> 4
-                         *  0b1100 --> 5
-                         *  0b1101 --> 6
-                         *  0b1110 --> 7
-                         *  0b1111 xxxx --> 8 (extended)
-                         */
-                        // Get 4 bits
-                        temp8 = (uint8_t) (bitFieldQueue >> (BIT_QUEUE_BITS - 4u));
-                        if (temp8 < 0xC)    // 0xC is 0b1100
-                        {
-                            // Length of 2, 3 or 4, encoded in 2 bits
-                            if (bitFieldQueueLen < 2u)
-                            {
-                                goto finish;
-                            }
-                            length = (temp8 >> 2u) + 2u;
-                            bitFieldQueue <<= 2u;
-                            bitFieldQueueLen -= 2u;
-                        }
-                        else
-                        {
-                            // Length (encoded in 4 bits) of 5, 6, 7, or (8 + extended)
-                            if (bitFieldQueueLen < 4u)
-                            {
-                                goto finish;
-                            }
-                            length = (temp8 - 0xC + 5u);
-                            bitFieldQueue <<= 4u;
-                            bitFieldQueueLen -= 4u;
-                            if (length == 8u)
-                            {
-                                // We must go into extended length decode mode
-                                state = DECOMPRESS_EXTENDED;
-                            }
-                        }
 #endif
 #if LENGTH_DECODE_METHOD == LENGTH_DECODE_METHOD_TABLE
-                        // Get 4 bits, then look up decode data
-                        temp8 = lengthDecodeTable[
-                                                  (uint8_t) (bitFieldQueue >> (BIT_QUEUE_BITS - LENGTH_MAX_BIT_WIDTH))
-                                                 ];
-                        // Length value is in upper nibble
-                        length = temp8 >> 4u;
-                        // Number of bits for this length token is in the lower nibble
-                        temp8 &= 0xF;
-                        if (bitFieldQueueLen < temp8)
-                        {
-                            goto finish;
-                        }
-                        bitFieldQueue <<= temp8;
-                        bitFieldQueueLen -= temp8;
-                        if (length == MAX_SHORT_LENGTH)
-                        {
-                            // We must go into extended length decode mode
-                            state = DECOMPRESS_EXTENDED;
-                        }
+                    // Get 4 bits, then look up decode data
+                    temp8 = lengthDecodeTable[
+                                              (uint8_t) (bitFieldQueue >> (BIT_QUEUE64_BITS - LENGTH_MAX_BIT_WIDTH))
+                                             ];
+                    // Length value is in upper nibble
+                    length = temp8 >> 4u;
+                    // Number of bits for this length token is in the lower nibble
+                    width = temp8 & 0xF;
 #endif
-                        LZS_DEBUG(("(%"PRIuFAST16", %"PRIuFAST8")\n", offset, length));
-                        // Now copy (offset, length) bytes
-                        for (temp8 = 0; temp8 < length; temp8++)
-                        {
-                            // Check offset is within range of valid history.
-                            // If it's not, then write zeros. Avoid information leak.
-                            if (outPtr - offset >= a_pOutData)
-                            {
-                                *outPtr = *(outPtr - offset);
-                            }
-                            else
-                            {
-                                *outPtr = 0;
-                            }
-                            ++outPtr;
-                            ++outCount;
-
-                            if (outCount >= a_outBufferSize)
-                            {
-                                goto finish;
-                            }
-                        }
+                    if (bitFieldQueueLen < width)
+                    {
+                        goto finish;
                     }
+                    bitFieldQueue <<= width;
+                    bitFieldQueueLen -= width;
                 }
-                break;
-
-            case DECOMPRESS_EXTENDED:
-                // Extended length token
-                // Get 4 bits
-                if (bitFieldQueueLen < LENGTH_MAX_BIT_WIDTH)
+                if (length == MAX_SHORT_LENGTH)
                 {
-                    goto finish;
+                    // We must go into extended length decode mode
+                    state = DECOMPRESS_EXTENDED;
+                }
+                LZS_DEBUG(("(%"PRIuFAST16", %"PRIuFAST8")\n", offset, length));
+                // Now copy (offset, length) bytes.
+                // Use the fast copy if the source is all within the output data, and
+                // there's room in the output buffer for the whole match and the slack.
+                if ((offset <= outCount) && (a_outBufferSize - outCount >= length + MATCH_COPY_SLACK))
+                {
+                    lzs_match_copy(outPtr, offset, length);
+                    outPtr += length;
+                    outCount += length;
+                    break;
                 }
-                length = (uint8_t) (bitFieldQueue >> (BIT_QUEUE_BITS - LENGTH_MAX_BIT_WIDTH));
-                bitFieldQueue <<= LENGTH_MAX_BIT_WIDTH;
-                bitFieldQueueLen -= LENGTH_MAX_BIT_WIDTH;
-                // Now copy (offset, length) bytes
                 for (temp8 = 0; temp8 < length; temp8++)
                 {
                     // Check offset is within range of valid history.
@@ -391,6 +462,48 @@ size_t lzs_decompress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_
                         goto finish;
                     }
                 }
+                break;
+
+            case DECOMPRESS_EXTENDED:
+                // Extended length token
+                // Get 4 bits
+                if (bitFieldQueueLen < LENGTH_MAX_BIT_WIDTH)
+                {
+                    goto finish;
+                }
+                length = (uint8_t) (bitFieldQueue >> (BIT_QUEUE64_BITS - LENGTH_MAX_BIT_WIDTH));
+                bitFieldQueue <<= LENGTH_MAX_BIT_WIDTH;
+                bitFieldQueueLen -= LENGTH_MAX_BIT_WIDTH;
+                // Now copy (offset, length) bytes
+                if ((offset <= outCount) && (a_outBufferSize - outCount >= length + MATCH_COPY_SLACK))
+                {
+                    lzs_match_copy(outPtr, offset, length);
+                    outPtr += length;
+                    outCount += length;
+                }
+                else
+                {
+                    for (temp8 = 0; temp8 < length; temp8++)
+                    {
+                        // Check offset is within range of valid history.
+                        // If it's not, then write zeros. Avoid information leak.
+                        if (outPtr - offset >= a_pOutData)
+                        {
+                            *outPtr = *(outPtr - offset);
+                        }
+                        else
+                        {
+                            *outPtr = 0;
+                        }
+                        ++outPtr;
+                        ++outCount;
+
+                        if (outCount >= a_outBufferSize)
+                        {
+                            goto finish;
+                        }
+                    }
+                }
                 if (length != MAX_EXTENDED_LENGTH)
                 {
                     // We're finished with extended length decode mode; go back to normal
@@ -405,6 +518,228 @@ finish:
 }
 
 
+/*
+ * \brief Single-call decompression, in place
+ *
+ * The compressed data is the last inLen bytes of the buffer, and it is
+ * decompressed to the start of the buffer, over the top of it. So only one
+ * buffer is needed, a little bigger than the decompressed data, rather than
+ * one for each.
+ *
+ * lzs_decompress() reads the input in order, and no token takes more than 9
+ * bits for each byte it outputs (a literal), apart from the end marker. So the
+ * compressed data that is still to be read is never more than 9/8 of the size
+ * of the output still to be written, plus 2 bytes. If bufferSize is at least
+ * LZS_DECOMPRESS_IN_PLACE_SIZE() of the decompressed size, the output
+ * (including the rubbish past the end of a match) stays before the input that
+ * hasn't been read yet. lzs_decompressed_size() can get
+ * the decompressed size first, if it isn't known.
+ *
+ * If the buffer is smaller than that, or the data isn't a valid LZS stream,
+ * the output may be rubbish, but nothing outside the buffer is written.
+ *
+ * Return value is the number of decompressed bytes, at the start of the buffer.
+ */
+size_t lzs_decompress_in_place(uint8_t * pBuffer, size_t bufferSize, size_t inLen)
+{
+    if (inLen > bufferSize)
+    {
+        return 0;
+    }
+    return lzs_decompress(pBuffer, bufferSize, pBuffer + bufferSize - inLen, inLen);
+}
+
+
+/*
+ * Get the size of decompressed data, without decompressing it
+ *
+ * This parses the compressed data up to the first end marker (or the end of the
+ * input data), and returns the number of bytes that lzs_decompress() would
+ * generate from it, given a big enough output buffer. Nothing is written
+ * except the status, so it is much quicker than decompression.
+ *
+ * If a_pStatus is not NULL, then it is set to one or more flags of
+ * LzsDecompressStatus_t, to show whether the compressed data is valid:
+ *     LZS_D_STATUS_END_MARKER if an end marker was found.
+ *     LZS_D_STATUS_INPUT_FINISHED if the input data ended without an end marker.
+ *     LZS_D_STATUS_INPUT_STARVED if the input data ended part-way through a token.
+ *     LZS_D_STATUS_ERROR if there is an offset beyond the available history
+ *         (which lzs_decompress() fills with zeros), or an invalid token.
+ */
+size_t lzs_decompressed_size(const uint8_t * a_pInData, size_t a_inLen, uint8_t * a_pStatus)
+{
+    const uint8_t     * inPtr;
+    size_t              inRemaining;        // Count of remaining bytes of input
+    size_t              outCount;           // Count of output bytes that would be generated
+    uint64_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 63 when shifted left.
+    uint_fast8_t        bitFieldQueueLen;
+    uint_fast16_t       offset;
+    uint_fast8_t        length;
+    uint_fast16_t       width;
+    uint8_t             temp8;
+    uint8_t             status;
+    SimpleDecompressState_t state;
+
+
+    bitFieldQueue = 0;
+    bitFieldQueueLen = 0;
+    inPtr = a_pInData;
+    inRemaining = a_inLen;
+    outCount = 0;
+    status = LZS_D_STATUS_NONE;
+    state = DECOMPRESS_NORMAL;
+
+    for (;;)
+    {
+        // Load input data into the bit field queue
+        if (bitFieldQueueLen < BIT_QUEUE_REFILL_LEN)
+        {
+            if (inRemaining >= sizeof(uint64_t))
+            {
+                // Load as many whole bytes as fit, in one step
+                width = (BIT_QUEUE64_BITS - bitFieldQueueLen) & ~7u;
+                bitFieldQueue |= lzs_load_be64_bits(inPtr, width) >> bitFieldQueueLen;
+                bitFieldQueueLen += width;
+                inPtr += width / 8u;
+                inRemaining -= width / 8u;
+            }
+            else
+            {
+                // Near the end of input, load one byte at a time
+                while ((inRemaining > 0) && (bitFieldQueueLen <= BIT_QUEUE64_BITS - 8u))
+                {
+                    bitFieldQueue |= ((uint64_t)*inPtr++ << (BIT_QUEUE64_BITS - 8u - bitFieldQueueLen));
+                    bitFieldQueueLen += 8u;
+                    inRemaining--;
+                }
+            }
+        }
+        // Check if we've reached the end of our input data
+        if (bitFieldQueueLen == 0)
+        {
+            status |= LZS_D_STATUS_INPUT_FINISHED;
+            break;
+        }
+
+        if (state == DECOMPRESS_EXTENDED)
+        {
+            // Extended length token
+            if (bitFieldQueueLen < LENGTH_MAX_BIT_WIDTH)
+            {
+                status |= LZS_D_STATUS_INPUT_FINISHED | LZS_D_STATUS_INPUT_STARVED;
+                break;
+            }
+            length = (uint8_t) (bitFieldQueue >> (BIT_QUEUE64_BITS - LENGTH_MAX_BIT_WIDTH));
+            bitFieldQueue <<= LENGTH_MAX_BIT_WIDTH;
+            bitFieldQueueLen -= LENGTH_MAX_BIT_WIDTH;
+            if (length != MAX_EXTENDED_LENGTH)
+            {
+                // We're finished with extended length decode mode; go back to normal
+                state = DECOMPRESS_NORMAL;
+            }
+        }
+        else if ((bitFieldQueue & ((uint64_t)1u << (BIT_QUEUE64_BITS - 1u))) == 0)
+        {
+            // Literal
+            if (bitFieldQueueLen < 1u + 8u)
+            {
+                status |= LZS_D_STATUS_INPUT_FINISHED | LZS_D_STATUS_INPUT_STARVED;
+                break;
+            }
+            bitFieldQueue <<= (1u + 8u);
+            bitFieldQueueLen -= (1u + 8u);
+            outCount++;
+            continue;
+        }
+        else
+        {
+            // Offset+length token. Look up the whole token from its leading bits.
+            temp8 = tokenDecodeTable[bitFieldQueue >> (BIT_QUEUE64_BITS - TOKEN_DECODE_BITS)];
+            width = temp8 & 0xF;
+            if (bitFieldQueueLen < width)
+            {
+                status |= LZS_D_STATUS_INPUT_FINISHED | LZS_D_STATUS_INPUT_STARVED;
+                break;
+            }
+            length = temp8 >> 4u;
+            if (length == TOKEN_CLASS_END_MARKER)
+            {
+                status |= LZS_D_STATUS_END_MARKER;
+                break;
+            }
+            if (length != TOKEN_CLASS_LONG_OFFSET)
+            {
+                // Short offset, with the length already decoded by the table look-up.
+                offset = (bitFieldQueue >> (BIT_QUEUE64_BITS - 2u - SHORT_OFFSET_BITS)) & SHORT_OFFSET_MAX;
+                bitFieldQueue <<= width;
+                bitFieldQueueLen -= width;
+            }
+            else
+            {
+                // Long offset, then the length follows it.
+                offset = (bitFieldQueue >> (BIT_QUEUE64_BITS - 2u - LONG_OFFSET_BITS)) & LONG_OFFSET_MAX;
+                bitFieldQueue <<= width;
+                bitFieldQueueLen -= width;
+                if (offset == 0)
+                {
+                    // Not a valid token. lzs_decompress() skips it.
+                    status |= LZS_D_STATUS_ERROR;
+                    continue;
+                }
+#if LENGTH_DECODE_METHOD == LENGTH_DECODE_METHOD_CODE
+                // Get 4 bits
+                temp8 = (uint8_t) (bitFieldQueue >> (BIT_QUEUE64_BITS - 4u));
+                if (temp8 < 0xC)    // 0xC is 0b1100
+                {
+                    // Length of 2, 3 or 4, encoded in 2 bits
+                    length = (temp8 >> 2u) + 2u;
+                    width = 2u;
+                }
+                else
+                {
+                    // Length (encoded in 4 bits) of 5, 6, 7, or (8 + extended)
+                    length = (temp8 - 0xC + 5u);
+                    width = 4u;
+                }
+#endif
+#if LENGTH_DECODE_METHOD == LENGTH_DECODE_METHOD_TABLE
+                // Get 4 bits, then look up decode data
+                temp8 = lengthDecodeTable[
+                                          (uint8_t) (bitFieldQueue >> (BIT_QUEUE64_BITS - LENGTH_MAX_BIT_WIDTH))
+                                         ];
+                length = temp8 >> 4u;
+                width = temp8 & 0xF;
+#endif
+                if (bitFieldQueueLen < width)
+                {
+                    status |= LZS_D_STATUS_INPUT_FINISHED | LZS_D_STATUS_INPUT_STARVED;
+                    break;
+                }
+                bitFieldQueue <<= width;
+                bitFieldQueueLen -= width;
+            }
+            if (offset > outCount)
+            {
+                // Offset is beyond the available history
+                status |= LZS_D_STATUS_ERROR;
+            }
+            if (length == MAX_SHORT_LENGTH)
+            {
+                // We must go into extended length decode mode
+                state = DECOMPRESS_EXTENDED;
+            }
+        }
+        outCount += length;
+    }
+
+    if (a_pStatus != NULL)
+    {
+        *a_pStatus = status;
+    }
+    return outCount;
+}
+
+
 /*
  * \brief Initialise incremental decompression
  */
@@ -414,23 +749,551 @@ void lzs_decompress_init(LzsDecompressParameters_t * pParams)
     pParams->bitFieldQueue = 0;
     pParams->bitFieldQueueLen = 0;
     pParams->state = DECOMPRESS_GET_TOKEN_TYPE;
+    // Not used until there's a match, but saved in checkpoints
+    pParams->length = 0;
+    pParams->offset = 0;
     pParams->historyLatestIdx = 0;
     pParams->historyLen = 0;
 }
 
+/*
+ * \brief Set a dictionary for incremental decompression
+ *
+ * This must be done after lzs_decompress_init(), before any data is
+ * decompressed. The last LZS_MAX_HISTORY_SIZE bytes of the dictionary are put
+ * in the history, so that the compressed data can refer to them. The data must
+ * have been compressed with the same dictionary (see lzs_compress_set_dictionary()).
+ */
+void lzs_decompress_set_dictionary(LzsDecompressParameters_t * pParams, const uint8_t * pDict, size_t dictLen)
+{
+    if (dictLen > LZS_MAX_HISTORY_SIZE)
+    {
+        pDict += dictLen - LZS_MAX_HISTORY_SIZE;
+        dictLen = LZS_MAX_HISTORY_SIZE;
+    }
+    memcpy(pParams->historyBuffer, pDict, dictLen);
+    pParams->historyLatestIdx = lzs_idx_inc_wrap(0, dictLen, sizeof(pParams->historyBuffer));
+    pParams->historyLen = dictLen;
+}
+
 
 /*
- * \brief Incremental decompression
+ * \brief Save the state of incremental decompression as a checkpoint
  *
- * State is kept between calls, so decompression can be done gradually, and flexibly
- * depending on the application's needs for input/output buffer handling.
+ * This can be done between any two calls of lzs_decompress_incremental().
+ * inPos is the position in the compressed data of pParams->inPtr, and outPos
+ * is the number of bytes that have been decompressed. Input that has been
+ * loaded but not decoded yet is counted back, so pCheckpoint->inPos can be
+ * before inPos.
+ */
+void lzs_decompress_save_checkpoint(const LzsDecompressParameters_t * pParams, uint64_t inPos, uint64_t outPos,
+                                    LzsCheckpoint_t * pCheckpoint)
+{
+    uint_fast16_t       historyIdx;
+    uint_fast16_t       width;
+
+    // Whole bytes in the bit field queue are given back to the input. What's
+    // left is the end of a byte that has been partly decoded.
+    pCheckpoint->outPos = outPos;
+    pCheckpoint->inPos = inPos - pParams->bitFieldQueueLen / 8u;
+    pCheckpoint->bitCount = pParams->bitFieldQueueLen % 8u;
+    pCheckpoint->bits = (uint8_t)(pParams->bitFieldQueue >> (BIT_QUEUE64_BITS - 8u)) &
+                        (uint8_t)(0xFFu << (8u - pCheckpoint->bitCount));
+    pCheckpoint->state = pParams->state;
+    pCheckpoint->length = pParams->length;
+    pCheckpoint->offset = pParams->offset;
+
+    // Copy the history, oldest first
+    pCheckpoint->historyLen = pParams->historyLen;
+    historyIdx = lzs_idx_dec_wrap(pParams->historyLatestIdx, pParams->historyLen, sizeof(pParams->historyBuffer));
+    width = LZSMIN(sizeof(pParams->historyBuffer) - historyIdx, pParams->historyLen);
+    memcpy(pCheckpoint->history, &pParams->historyBuffer[historyIdx], width);
+    memcpy(pCheckpoint->history + width, pParams->historyBuffer, pParams->historyLen - width);
+}
+
+/*
+ * \brief Resume incremental decompression from a checkpoint
  *
- * It will stop if/when it reaches the end of either the input or the output buffer.
- * It will also stop if/when it reaches an end marker.
+ * This initialises pParams to the state that was saved by
+ * lzs_decompress_save_checkpoint(). Then the compressed data should be input
+ * from pCheckpoint->inPos. Returns false, with pParams unchanged, if the
+ * checkpoint isn't valid. That includes a checkpoint part way through a match
+ * whose offset is beyond the history, which a valid stream can't have.
  */
-size_t lzs_decompress_incremental(LzsDecompressParameters_t * pParams)
+bool lzs_decompress_restore_checkpoint(LzsDecompressParameters_t * pParams, const LzsCheckpoint_t * pCheckpoint)
+{
+    uint_fast16_t       offset;
+
+    if (
+            (pCheckpoint->state >= NUM_DECOMPRESS_STATES) ||
+            (pCheckpoint->bitCount >= 8u) ||
+            (pCheckpoint->length > MAX_EXTENDED_LENGTH) ||
+            (pCheckpoint->offset > LONG_OFFSET_MAX) ||
+            (pCheckpoint->historyLen > LZS_MAX_HISTORY_SIZE)
+       )
+    {
+        return false;
+    }
+    if (
+            (pCheckpoint->state == DECOMPRESS_GET_LENGTH) ||
+            (pCheckpoint->state == DECOMPRESS_COPY_DATA) ||
+            (pCheckpoint->state == DECOMPRESS_COPY_EXTENDED_DATA) ||
+            (pCheckpoint->state == DECOMPRESS_GET_EXTENDED_LENGTH)
+       )
+    {
+        // The offset of the match is in use. An offset of 0 is the same as the full history size.
+        offset = (pCheckpoint->offset == 0) ? LZS_MAX_HISTORY_SIZE : pCheckpoint->offset;
+        if (offset > pCheckpoint->historyLen)
+        {
+            return false;
+        }
+    }
+    lzs_decompress_init(pParams);
+    lzs_decompress_set_dictionary(pParams, pCheckpoint->history, pCheckpoint->historyLen);
+    pParams->bitFieldQueue = (uint64_t)pCheckpoint->bits << (BIT_QUEUE64_BITS - 8u);
+    pParams->bitFieldQueueLen = pCheckpoint->bitCount;
+    pParams->state = pCheckpoint->state;
+    pParams->length = pCheckpoint->length;
+    pParams->offset = pCheckpoint->offset;
+    // Needed if the checkpoint is part way through copying a match
+    pParams->historyReadIdx = lzs_idx_dec_wrap(pParams->historyLatestIdx, pParams->offset,
+                                               sizeof(pParams->historyBuffer));
+    return true;
+}
+
+/*
+ * \brief Fast inner loop of incremental decompression
+ *
+ * This is used by lzs_decompress_incremental() while there is plenty of input
+ * data and output buffer space. It decodes whole tokens at a time, keeping all
+ * the state in local variables, in the style of lzs_decompress(). Output is
+ * written only to the output buffer; the history buffer is brought up to date
+ * once, on return.
+ *
+ * It is only entered in state DECOMPRESS_GET_TOKEN_TYPE or
+ * DECOMPRESS_GET_EXTENDED_LENGTH, and it returns in one of those states. It
+ * returns when the input or output buffer is near its end, and also before an
+ * end marker or any other unusual token, leaving those for the state machine.
+ *
+ * Return value is the number of output bytes that were generated.
+ */
+static size_t lzs_decompress_incremental_fast(LzsDecompressParameters_t * pParams)
+{
+    const uint8_t     * inPtr;
+    uint8_t           * outPtr;
+    uint8_t           * outStart;
+    size_t              inRemaining;        // Count of remaining bytes of input
+    size_t              outRemaining;       // Count of remaining space in the output buffer
+    size_t              outCount;           // Count of output bytes that have been generated
+    size_t              historyOffset;
+    uint64_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 63 when shifted left.
+    uint_fast8_t        bitFieldQueueLen;
+    uint_fast16_t       offset;
+    uint_fast16_t       width;
+    uint_fast16_t       historyIdx;
+    uint_fast16_t       historyLen;         // Number of output bytes to write to the history buffer
+    uint_fast8_t        length;
+    uint_fast8_t        state;
+    uint8_t             temp8;
+
+
+    inPtr = pParams->inPtr;
+    inRemaining = pParams->inLength;
+    outPtr = pParams->outPtr;
+    outStart = outPtr;
+    outRemaining = pParams->outLength;
+    bitFieldQueue = pParams->bitFieldQueue;
+    bitFieldQueueLen = pParams->bitFieldQueueLen;
+    offset = pParams->offset;
+    state = pParams->state;
+
+    while ((inRemaining >= INCREMENTAL_FAST_MIN_INPUT) && (outRemaining >= INCREMENTAL_FAST_MIN_OUTPUT))
+    {
+        // Load input data into the bit field queue.
+        // After this there are enough bits for any whole token.
+        if (bitFieldQueueLen < BIT_QUEUE_REFILL_LEN)
+        {
+            width = (BIT_QUEUE64_BITS - bitFieldQueueLen) & ~7u;
+            bitFieldQueue |= lzs_load_be64_bits(inPtr, width) >> bitFieldQueueLen;
+            bitFieldQueueLen += width;
+            inPtr += width / 8u;
+            inRemaining -= width / 8u;
+        }
+
+        if (state == DECOMPRESS_GET_EXTENDED_LENGTH)
+        {
+            if (offset == 0)
+            {
+                // Not a valid offset. Leave it for the state machine.
+                break;
+            }
+            // Extended length token
+            length = (uint8_t) (bitFieldQueue >> (BIT_QUEUE64_BITS - LENGTH_MAX_BIT_WIDTH));
+            bitFieldQueue <<= LENGTH_MAX_BIT_WIDTH;
+            bitFieldQueueLen -= LENGTH_MAX_BIT_WIDTH;
+            LZS_DEBUG(("Extended length %"PRIuFAST8"\n", length));
+            if (length != MAX_EXTENDED_LENGTH)
+            {
+                // We're finished with extended length decode mode; go back to normal
+                state = DECOMPRESS_GET_TOKEN_TYPE;
+            }
+        }
+        else if ((bitFieldQueue & ((uint64_t)1u << (BIT_QUEUE64_BITS - 1u))) == 0)
+        {
+            // Literal. Byte value follows the 0 token-type bit.
+            temp8 = (uint8_t) (bitFieldQueue >> (BIT_QUEUE64_BITS - 1u - 8u));
+            bitFieldQueue <<= (1u + 8u);
+            bitFieldQueueLen -= (1u + 8u);
+            LZS_DEBUG(("Literal %c (%02X)\n", isprint(temp8) ? temp8 : '?', temp8));
+
+            *outPtr++ = temp8;
+            outRemaining--;
+            continue;
+        }
+        else
+        {
+            // Offset+length token. Look up the whole token from its leading bits.
+            temp8 = tokenDecodeTable[bitFieldQueue >> (BIT_QUEUE64_BITS - TOKEN_DECODE_BITS)];
+            width = temp8 & 0xF;
+            length = temp8 >> 4u;
+            if (length == TOKEN_CLASS_END_MARKER)
+            {
+                // Leave the end marker for the state machine.
+                break;
+            }
+            if (length != TOKEN_CLASS_LONG_OFFSET)
+            {
+                // Short offset, with the length already decoded by the table look-up.
+                offset = (bitFieldQueue >> (BIT_QUEUE64_BITS - 2u - SHORT_OFFSET_BITS)) & SHORT_OFFSET_MAX;
+                bitFieldQueue <<= width;
+                bitFieldQueueLen -= width;
+            }
+            else
+            {
+                // Long offset, then the length follows it.
+                offset = (bitFieldQueue >> (BIT_QUEUE64_BITS - 2u - LONG_OFFSET_BITS)) & LONG_OFFSET_MAX;
+                if (offset == 0)
+                {
+                    // Not a valid offset. Leave it for the state machine.
+                    break;
+                }
+                bitFieldQueue <<= width;
+                bitFieldQueueLen -= width;
+#if LENGTH_DECODE_METHOD == LENGTH_DECODE_METHOD_CODE
+                temp8 = (uint8_t) (bitFieldQueue >> (BIT_QUEUE64_BITS - 4u));
+                if (temp8 < 0xC)    // 0xC is 0b1100
+                {
+                    // Length of 2, 3 or 4, encoded in 2 bits
+                    length = (temp8 >> 2u) + 2u;
+                    width = 2u;
+                }
+                else
+                {
+                    // Length (encoded in 4 bits) of 5, 6, 7, or (8 + extended)
+                    length = (temp8 - 0xC + 5u);
+                    width = 4u;
+                }
+#endif
+#if LENGTH_DECODE_METHOD == LENGTH_DECODE_METHOD_TABLE
+                temp8 = lengthDecodeTable[
+                                          (uint8_t) (bitFieldQueue >> (BIT_QUEUE64_BITS - LENGTH_MAX_BIT_WIDTH))
+                                         ];
+                length = temp8 >> 4u;
+                width = temp8 & 0xF;
+#endif
+                bitFieldQueue <<= width;
+                bitFieldQueueLen -= width;
+            }
+            if (length == MAX_SHORT_LENGTH)
+            {
+                // We must go into extended length decode mode
+                state = DECOMPRESS_GET_EXTENDED_LENGTH;
+            }
+        }
+
+        LZS_DEBUG(("(%"PRIuFAST16", %"PRIuFAST8")\n", offset, length));
+        // Now copy (offset, length) bytes
+        outRemaining -= length;
+        if (offset <= (size_t)(outPtr - outStart))
+        {
+            // All the data is in the output buffer
+            lzs_match_copy(outPtr, offset, length);
+            outPtr += length;
+        }
+        else
+        {
+            // Some of the data is from before this output buffer, in the history buffer
+            for (; length != 0; length--)
+            {
+                if (offset <= (size_t)(outPtr - outStart))
+                {
+                    temp8 = *(outPtr - offset);
+                }
+                else
+                {
+                    historyOffset = offset - (size_t)(outPtr - outStart);
+                    // Check offset is within range of valid history.
+                    // If it's not, then write zeros. Avoid information leak.
+                    if (historyOffset <= pParams->historyLen)
+                    {
+                        temp8 = pParams->historyBuffer[lzs_idx_dec_wrap(pParams->historyLatestIdx, historyOffset,
+                                                                        sizeof(pParams->historyBuffer))];
+                    }
+                    else
+                    {
+                        temp8 = 0;
+                    }
+                }
+                *outPtr++ = temp8;
+            }
+        }
+    }
+
+    outCount = outPtr - outStart;
+
+    // Write the last of the output data to the history buffer
+    historyLen = LZSMIN(outCount, sizeof(pParams->historyBuffer));
+    historyIdx = (pParams->historyLatestIdx + (outCount - historyLen)) % sizeof(pParams->historyBuffer);
+    width = LZSMIN(sizeof(pParams->historyBuffer) - historyIdx, historyLen);
+    memcpy(&pParams->historyBuffer[historyIdx], outPtr - historyLen, width);
+    memcpy(&pParams->historyBuffer[0], outPtr - historyLen + width, historyLen - width);
+    pParams->historyLatestIdx = lzs_idx_inc_wrap(historyIdx, historyLen, sizeof(pParams->historyBuffer));
+    pParams->historyLen = LZSMIN(pParams->historyLen + outCount, LZS_MAX_HISTORY_SIZE);
+    // Needed if we stopped in extended length decode mode
+    pParams->historyReadIdx = lzs_idx_dec_wrap(pParams->historyLatestIdx, offset,
+                                                sizeof(pParams->historyBuffer));
+
+    pParams->inPtr = inPtr;
+    pParams->inLength = inRemaining;
+    pParams->outPtr = outPtr;
+    pParams->outLength = outRemaining;
+    pParams->bitFieldQueue = bitFieldQueue;
+    pParams->bitFieldQueueLen = bitFieldQueueLen;
+    pParams->offset = offset;
+    pParams->state = state;
+
+    return outCount;
+}
+
+
+/*
+ * \brief Fast inner loop of skipping in incremental decompression
+ *
+ * This is like lzs_decompress_incremental_fast(), but for lzs_decompress_skip().
+ * Decompressed data is written only to the history buffer, and
+ * pParams->outLength is the count of bytes that remain to be skipped.
+ *
+ * Return value is the number of bytes that were skipped.
+ */
+static size_t lzs_decompress_skip_fast(LzsDecompressParameters_t * pParams)
+{
+    const uint8_t     * inPtr;
+    size_t              inRemaining;        // Count of remaining bytes of input
+    size_t              skipRemaining;      // Count of remaining bytes to skip
+    size_t              skipCount;          // Count of bytes that have been skipped
+    uint64_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 63 when shifted left.
+    uint_fast8_t        bitFieldQueueLen;
+    uint_fast16_t       offset;
+    uint_fast16_t       width;
+    uint_fast16_t       historyLatestIdx;
+    uint_fast16_t       historyReadIdx;
+    uint_fast16_t       historyLen;
+    uint_fast8_t        length;
+    uint_fast8_t        state;
+    uint8_t             temp8;
+
+
+    inPtr = pParams->inPtr;
+    inRemaining = pParams->inLength;
+    skipRemaining = pParams->outLength;
+    bitFieldQueue = pParams->bitFieldQueue;
+    bitFieldQueueLen = pParams->bitFieldQueueLen;
+    offset = pParams->offset;
+    state = pParams->state;
+    historyLatestIdx = pParams->historyLatestIdx;
+    historyLen = pParams->historyLen;
+    skipCount = 0;
+
+    while ((inRemaining >= INCREMENTAL_FAST_MIN_INPUT) && (skipRemaining >= SKIP_FAST_MIN_OUTPUT))
+    {
+        // Load input data into the bit field queue.
+        // After this there are enough bits for any whole token.
+        if (bitFieldQueueLen < BIT_QUEUE_REFILL_LEN)
+        {
+            width = (BIT_QUEUE64_BITS - bitFieldQueueLen) & ~7u;
+            bitFieldQueue |= lzs_load_be64_bits(inPtr, width) >> bitFieldQueueLen;
+            bitFieldQueueLen += width;
+            inPtr += width / 8u;
+            inRemaining -= width / 8u;
+        }
+
+        if (state == DECOMPRESS_GET_EXTENDED_LENGTH)
+        {
+            if (offset == 0)
+            {
+                // Not a valid offset. Leave it for the state machine.
+                break;
+            }
+            // Extended length token
+            length = (uint8_t) (bitFieldQueue >> (BIT_QUEUE64_BITS - LENGTH_MAX_BIT_WIDTH));
+            bitFieldQueue <<= LENGTH_MAX_BIT_WIDTH;
+            bitFieldQueueLen -= LENGTH_MAX_BIT_WIDTH;
+            if (length != MAX_EXTENDED_LENGTH)
+            {
+                // We're finished with extended length decode mode; go back to normal
+                state = DECOMPRESS_GET_TOKEN_TYPE;
+            }
+        }
+        else if ((bitFieldQueue & ((uint64_t)1u << (BIT_QUEUE64_BITS - 1u))) == 0)
+        {
+            // Literal. Byte value follows the 0 token-type bit.
+            pParams->historyBuffer[historyLatestIdx] = (uint8_t) (bitFieldQueue >> (BIT_QUEUE64_BITS - 1u - 8u));
+            bitFieldQueue <<= (1u + 8u);
+            bitFieldQueueLen -= (1u + 8u);
+
+            historyLatestIdx = lzs_idx_inc_wrap(historyLatestIdx, 1u, sizeof(pParams->historyBuffer));
+            historyLen = LZSMIN(historyLen + 1u, LZS_MAX_HISTORY_SIZE);
+            skipRemaining--;
+            skipCount++;
+            continue;
+        }
+        else
+        {
+            // Offset+length token. Look up the whole token from its leading bits.
+            temp8 = tokenDecodeTable[bitFieldQueue >> (BIT_QUEUE64_BITS - TOKEN_DECODE_BITS)];
+            width = temp8 & 0xF;
+            length = temp8 >> 4u;
+            if (length == TOKEN_CLASS_END_MARKER)
+            {
+                // Leave the end marker for the state machine.
+                break;
+            }
+            if (length != TOKEN_CLASS_LONG_OFFSET)
+            {
+                // Short offset, with the length already decoded by the table look-up.
+                offset = (bitFieldQueue >> (BIT_QUEUE64_BITS - 2u - SHORT_OFFSET_BITS)) & SHORT_OFFSET_MAX;
+                bitFieldQueue <<= width;
+                bitFieldQueueLen -= width;
+            }
+            else
+            {
+                // Long offset, then the length follows it.
+                offset = (bitFieldQueue >> (BIT_QUEUE64_BITS - 2u - LONG_OFFSET_BITS)) & LONG_OFFSET_MAX;
+                if (offset == 0)
+                {
+                    // Not a valid offset. Leave it for the state machine.
+                    break;
+                }
+                bitFieldQueue <<= width;
+                bitFieldQueueLen -= width;
+#if LENGTH_DECODE_METHOD == LENGTH_DECODE_METHOD_CODE
+                temp8 = (uint8_t) (bitFieldQueue >> (BIT_QUEUE64_BITS - 4u));
+                if (temp8 < 0xC)    // 0xC is 0b1100
+                {
+                    // Length of 2, 3 or 4, encoded in 2 bits
+                    length = (temp8 >> 2u) + 2u;
+                    width = 2u;
+                }
+                else
+                {
+                    // Length (encoded in 4 bits) of 5, 6, 7, or (8 + extended)
+                    length = (temp8 - 0xC + 5u);
+                    width = 4u;
+                }
+#endif
+#if LENGTH_DECODE_METHOD == LENGTH_DECODE_METHOD_TABLE
+                temp8 = lengthDecodeTable[
+                                          (uint8_t) (bitFieldQueue >> (BIT_QUEUE64_BITS - LENGTH_MAX_BIT_WIDTH))
+                                         ];
+                length = temp8 >> 4u;
+                width = temp8 & 0xF;
+#endif
+                bitFieldQueue <<= width;
+                bitFieldQueueLen -= width;
+            }
+            if (length == MAX_SHORT_LENGTH)
+            {
+                // We must go into extended length decode mode
+                state = DECOMPRESS_GET_EXTENDED_LENGTH;
+            }
+        }
+
+        // Now copy (offset, length) bytes, within the history buffer
+        skipRemaining -= length;
+        skipCount += length;
+        historyReadIdx = lzs_idx_dec_wrap(historyLatestIdx, offset, sizeof(pParams->historyBuffer));
+        if ((offset <= historyLen) &&
+            (historyReadIdx + length <= sizeof(pParams->historyBuffer)) &&
+            (historyLatestIdx + length <= sizeof(pParams->historyBuffer)))
+        {
+            // Neither end wraps around the end of the history buffer
+            if (offset >= length)
+            {
+                // The source and destination may only overlap when the source is ahead
+                memmove(&pParams->historyBuffer[historyLatestIdx], &pParams->historyBuffer[historyReadIdx], length);
+            }
+            else
+            {
+                // The match overlaps itself, so copy byte-by-byte
+                for (width = 0; width < length; width++)
+                {
+                    pParams->historyBuffer[historyLatestIdx + width] = pParams->historyBuffer[historyReadIdx + width];
+                }
+            }
+            historyLatestIdx = lzs_idx_inc_wrap(historyLatestIdx, length, sizeof(pParams->historyBuffer));
+            historyLen = LZSMIN(historyLen + length, LZS_MAX_HISTORY_SIZE);
+            length = 0;
+        }
+        for (; length != 0; length--)
+        {
+            // Check offset is within range of valid history.
+            // If it's not, then write zeros. Avoid information leak.
+            if (offset <= historyLen)
+            {
+                temp8 = pParams->historyBuffer[lzs_idx_dec_wrap(historyLatestIdx, offset,
+                                                                sizeof(pParams->historyBuffer))];
+            }
+            else
+            {
+                temp8 = 0;
+            }
+            pParams->historyBuffer[historyLatestIdx] = temp8;
+            historyLatestIdx = lzs_idx_inc_wrap(historyLatestIdx, 1u, sizeof(pParams->historyBuffer));
+            historyLen = LZSMIN(historyLen + 1u, LZS_MAX_HISTORY_SIZE);
+        }
+    }
+
+    pParams->historyLatestIdx = historyLatestIdx;
+    pParams->historyLen = historyLen;
+    // Needed if we stopped in extended length decode mode
+    pParams->historyReadIdx = lzs_idx_dec_wrap(historyLatestIdx, offset, sizeof(pParams->historyBuffer));
+
+    pParams->inPtr = inPtr;
+    pParams->inLength = inRemaining;
+    pParams->outLength = skipRemaining;
+    pParams->bitFieldQueue = bitFieldQueue;
+    pParams->bitFieldQueueLen = bitFieldQueueLen;
+    pParams->offset = offset;
+    pParams->state = state;
+
+    return skipCount;
+}
+
+
+/*
+ * \brief The state machine of incremental decompression
+ *
+ * This is the body of lzs_decompress_incremental() and lzs_decompress_skip().
+ * If discard is true, decompressed data is written only to the history buffer,
+ * pParams->outPtr is not used, and pParams->outLength is the count of bytes
+ * that remain to be skipped.
+ *
+ * Return value is the number of output (or skipped) bytes.
+ */
+static inline size_t lzs_decompress_incremental_mode(LzsDecompressParameters_t * pParams, bool discard)
 {
     size_t              outCount;           // Count of output bytes that have been generated
+    size_t              width;
     uint_fast16_t       offset;
     uint_fast8_t        temp8;
 
@@ -440,20 +1303,53 @@ size_t lzs_decompress_incremental(LzsDecompressParameters_t * pParams)
 
     for (;;)
     {
+        // Use the fast inner loop while there's plenty of input data and output buffer space.
+        // Not once the state machine has set a status, such as for an end marker.
+        if ((pParams->status == LZS_D_STATUS_NONE) &&
+            (pParams->inLength >= INCREMENTAL_FAST_MIN_INPUT) &&
+            (pParams->outLength >= (discard ? SKIP_FAST_MIN_OUTPUT : INCREMENTAL_FAST_MIN_OUTPUT)) &&
+            ((pParams->state == DECOMPRESS_GET_TOKEN_TYPE) || (pParams->state == DECOMPRESS_GET_EXTENDED_LENGTH)))
+        {
+            if (discard)
+            {
+                outCount += lzs_decompress_skip_fast(pParams);
+            }
+            else
+            {
+                outCount += lzs_decompress_incremental_fast(pParams);
+            }
+        }
+
         // Load input data into the bit field queue
-        while ((pParams->inLength > 0) && (pParams->bitFieldQueueLen <= BIT_QUEUE_BITS - 8u))
+        if (pParams->bitFieldQueueLen < BIT_QUEUE_REFILL_LEN)
         {
-            pParams->bitFieldQueue |= (*pParams->inPtr++ << (BIT_QUEUE_BITS - 8u - pParams->bitFieldQueueLen));
-            pParams->bitFieldQueueLen += 8u;
-            //LZS_DEBUG(("Load queue: %04X\n", pParams->bitFieldQueue));
-            pParams->inLength--;
+            if (pParams->inLength >= sizeof(uint64_t))
+            {
+                // Load as many whole bytes as fit, in one step
+                temp8 = (BIT_QUEUE64_BITS - pParams->bitFieldQueueLen) & ~7u;
+                pParams->bitFieldQueue |= lzs_load_be64_bits(pParams->inPtr, temp8) >> pParams->bitFieldQueueLen;
+                pParams->bitFieldQueueLen += temp8;
+                pParams->inPtr += temp8 / 8u;
+                pParams->inLength -= temp8 / 8u;
+            }
+            else
+            {
+                // Near the end of input, load one byte at a time
+                while ((pParams->inLength > 0) && (pParams->bitFieldQueueLen <= BIT_QUEUE64_BITS - 8u))
+                {
+                    pParams->bitFieldQueue |= ((uint64_t)*pParams->inPtr++ << (BIT_QUEUE64_BITS - 8u - pParams->bitFieldQueueLen));
+                    pParams->bitFieldQueueLen += 8u;
+                    //LZS_DEBUG(("Load queue: %016"PRIX64"\n", pParams->bitFieldQueue));
+                    pParams->inLength--;
+                }
+            }
         }
         // Check if we've reached the end of our input data
         if (pParams->bitFieldQueueLen == 0)
         {
             pParams->status |= LZS_D_STATUS_INPUT_FINISHED | LZS_D_STATUS_INPUT_STARVED;
         }
-        if (pParams->bitFieldQueueLen > BIT_QUEUE_BITS)
+        if (pParams->bitFieldQueueLen > BIT_QUEUE64_BITS)
         {
             // It is an error if we ever get here.
             LZS_ASSERT(0);
@@ -478,7 +1374,7 @@ size_t lzs_decompress_incremental(LzsDecompressParameters_t * pParams)
         {
             case DECOMPRESS_GET_TOKEN_TYPE:
                 // Get token-type bit
-                if (pParams->bitFieldQueue & (1u << (BIT_QUEUE_BITS - 1u)))
+                if (pParams->bitFieldQueue & ((uint64_t)1u << (BIT_QUEUE64_BITS - 1u)))
                 {
                     pParams->state = DECOMPRESS_GET_OFFSET_TYPE;
                 }
@@ -499,12 +1395,15 @@ size_t lzs_decompress_incremental(LzsDecompressParameters_t * pParams)
                 }
                 else
                 {
-                    temp8 = (uint8_t) (pParams->bitFieldQueue >> (BIT_QUEUE_BITS - 8u));
+                    temp8 = (uint8_t) (pParams->bitFieldQueue >> (BIT_QUEUE64_BITS - 8u));
                     pParams->bitFieldQueue <<= 8u;
                     pParams->bitFieldQueueLen -= 8u;
                     LZS_DEBUG(("Literal %c (%02X)\n", isprint(temp8) ? temp8 : '?', temp8));
 
-                    *pParams->outPtr++ = temp8;
+                    if (!discard)
+                    {
+                        *pParams->outPtr++ = temp8;
+                    }
                     pParams->outLength--;
                     outCount++;
 
@@ -522,7 +1421,7 @@ size_t lzs_decompress_incremental(LzsDecompressParameters_t * pParams)
             case DECOMPRESS_GET_OFFSET_TYPE:
                 // Offset+length token
                 // Decode offset
-                temp8 = (pParams->bitFieldQueue & (1u << (BIT_QUEUE_BITS - 1u))) ? 1u : 0;
+                temp8 = (pParams->bitFieldQueue & ((uint64_t)1u << (BIT_QUEUE64_BITS - 1u))) ? 1u : 0;
                 pParams->bitFieldQueue <<= 1u;
                 pParams->bitFieldQueueLen--;
                 pParams->state = temp8 ? DECOMPRESS_GET_OFFSET_SHORT : DECOMPRESS_GET_OFFSET_LONG;
@@ -530,7 +1429,7 @@ size_t lzs_decompress_incremental(LzsDecompressParameters_t * pParams)
 
             case DECOMPRESS_GET_OFFSET_SHORT:
                 // Short offset
-                offset = pParams->bitFieldQueue >> (BIT_QUEUE_BITS - SHORT_OFFSET_BITS);
+                offset = pParams->bitFieldQueue >> (BIT_QUEUE64_BITS - SHORT_OFFSET_BITS);
                 pParams->bitFieldQueue <<= SHORT_OFFSET_BITS;
                 pParams->bitFieldQueueLen -= SHORT_OFFSET_BITS;
                 if (offset == 0)
@@ -556,7 +1455,7 @@ size_t lzs_decompress_incremental(LzsDecompressParameters_t * pParams)
 
         case DECOMPRESS_GET_OFFSET_LONG:
                 // Long offset
-                pParams->offset = pParams->bitFieldQueue >> (BIT_QUEUE_BITS - LONG_OFFSET_BITS);
+                pParams->offset = pParams->bitFieldQueue >> (BIT_QUEUE64_BITS - LONG_OFFSET_BITS);
                 LZS_DEBUG(("Long offset %"PRIuFAST16"\n", pParams->offset));
                 pParams->bitFieldQueue <<= LONG_OFFSET_BITS;
                 pParams->bitFieldQueueLen -= LONG_OFFSET_BITS;
@@ -577,7 +1476,7 @@ size_t lzs_decompress_incremental(LzsDecompressParameters_t * pParams)
                  *  0b1111 xxxx --> 8 (extended)
                  */
                 // Get 4 bits
-                temp8 = (uint8_t) (pParams->bitFieldQueue >> (BIT_QUEUE_BITS - 4u));
+                temp8 = (uint8_t) (pParams->bitFieldQueue >> (BIT_QUEUE64_BITS - 4u));
                 if (temp8 < 0xC)    // 0xC is 0b1100
                 {
                     // Length of 2, 3 or 4, encoded in 2 bits
@@ -594,7 +1493,7 @@ size_t lzs_decompress_incremental(LzsDecompressParameters_t * pParams)
 #if LENGTH_DECODE_METHOD == LENGTH_DECODE_METHOD_TABLE
                 // Get 4 bits, then look up decode data
                 temp8 = lengthDecodeTable[
-                                          pParams->bitFieldQueue >> (BIT_QUEUE_BITS - LENGTH_MAX_BIT_WIDTH)
+                                          pParams->bitFieldQueue >> (BIT_QUEUE64_BITS - LENGTH_MAX_BIT_WIDTH)
                                          ];
                 // Length value is in upper nibble
                 pParams->length = temp8 >> 4u;
@@ -635,57 +1534,86 @@ size_t lzs_decompress_incremental(LzsDecompressParameters_t * pParams)
                 // Copy (offset, length) bytes.
                 // Offset has already been used to calculate pParams->historyReadIdx.
                 offset = pParams->offset;
-                for (;;)
+                while ((pParams->length != 0) && (pParams->outLength != 0))
                 {
-                    if (pParams->length == 0)
-                    {
-                        // We're finished copying. Change state, and exit this inner copying loop.
-                        pParams->state++;   // Goes to either DECOMPRESS_GET_TOKEN_TYPE or DECOMPRESS_GET_EXTENDED_LENGTH
-                        break;
-                    }
-                    // Check if we have space in the output buffer
-                    if (pParams->outLength == 0)
+                    // Copy a chunk of bytes that doesn't wrap around the end of the history
+                    // buffer, either for reading or writing.
+                    width = LZSMIN(pParams->length, pParams->outLength);
+                    width = LZSMIN(width, sizeof(pParams->historyBuffer) - pParams->historyReadIdx);
+                    width = LZSMIN(width, sizeof(pParams->historyBuffer) - pParams->historyLatestIdx);
+                    // Don't go past the bytes that are already in history, in case the match
+                    // overlaps itself. An offset of 0 is the same as the full history size.
+                    if (offset != 0)
                     {
-                        // We're out of space in the output buffer.
-                        // Set status, exit this inner copying loop, but maintain the current state.
-                        pParams->status |= LZS_D_STATUS_NO_OUTPUT_BUFFER_SPACE;
-                        break;
+                        width = LZSMIN(width, offset);
                     }
 
-                    // Get byte from history.
+                    // Get bytes from history.
                     // Check offset is within range of valid history.
                     // If it's not, then write zeros. Avoid information leak.
-                    if (offset <= pParams->historyLen)
+                    if (discard)
                     {
-                        temp8 = pParams->historyBuffer[pParams->historyReadIdx];
+                        // Copy straight from history to history. For an offset of the full
+                        // history size, the read and write positions are the same, and
+                        // this is a no-op.
+                        if (offset <= pParams->historyLen)
+                        {
+                            memmove(&pParams->historyBuffer[pParams->historyLatestIdx],
+                                    &pParams->historyBuffer[pParams->historyReadIdx], width);
+                        }
+                        else
+                        {
+                            width = LZSMIN(width, offset - pParams->historyLen);
+                            memset(&pParams->historyBuffer[pParams->historyLatestIdx], 0, width);
+                        }
                     }
                     else
                     {
-                        temp8 = 0;
-                    }
-
-                    pParams->historyReadIdx = lzs_idx_inc_wrap(pParams->historyReadIdx, 1u,
-                                                                sizeof(pParams->historyBuffer));
+                        if (offset <= pParams->historyLen)
+                        {
+                            memcpy(pParams->outPtr, &pParams->historyBuffer[pParams->historyReadIdx], width);
+                        }
+                        else
+                        {
+                            // Only up to the point where the offset comes within range
+                            width = LZSMIN(width, offset - pParams->historyLen);
+                            memset(pParams->outPtr, 0, width);
+                        }
 
-                    // Write to output
-                    *pParams->outPtr++ = temp8;
-                    pParams->outLength--;
-                    pParams->length--;
-                    ++outCount;
+                        // Write to history
+                        memcpy(&pParams->historyBuffer[pParams->historyLatestIdx], pParams->outPtr, width);
 
-                    // Write to history
-                    pParams->historyBuffer[pParams->historyLatestIdx] = temp8;
+                        // Write to output
+                        pParams->outPtr += width;
+                    }
 
-                    pParams->historyLatestIdx = lzs_idx_inc_wrap(pParams->historyLatestIdx, 1u,
+                    pParams->historyReadIdx = lzs_idx_inc_wrap(pParams->historyReadIdx, width,
                                                                 sizeof(pParams->historyBuffer));
-                    pParams->historyLen = LZSMIN(pParams->historyLen + 1u, LZS_MAX_HISTORY_SIZE);
+                    pParams->historyLatestIdx = lzs_idx_inc_wrap(pParams->historyLatestIdx, width,
+                                                                sizeof(pParams->historyBuffer));
+                    pParams->historyLen = LZSMIN(pParams->historyLen + width, LZS_MAX_HISTORY_SIZE);
+
+                    pParams->outLength -= width;
+                    pParams->length -= width;
+                    outCount += width;
+                }
+                if (pParams->length == 0)
+                {
+                    // We're finished copying. Change state.
+                    pParams->state++;   // Goes to either DECOMPRESS_GET_TOKEN_TYPE or DECOMPRESS_GET_EXTENDED_LENGTH
+                }
+                else
+                {
+                    // We're out of space in the output buffer.
+                    // Set status, but maintain the current state.
+                    pParams->status |= LZS_D_STATUS_NO_OUTPUT_BUFFER_SPACE;
                 }
                 break;
 
             case DECOMPRESS_GET_EXTENDED_LENGTH:
                 // Extended length token
                 // Get 4 bits
-                pParams->length = (uint8_t) (pParams->bitFieldQueue >> (BIT_QUEUE_BITS - LENGTH_MAX_BIT_WIDTH));
+                pParams->length = (uint8_t) (pParams->bitFieldQueue >> (BIT_QUEUE64_BITS - LENGTH_MAX_BIT_WIDTH));
                 pParams->bitFieldQueue <<= LENGTH_MAX_BIT_WIDTH;
                 pParams->bitFieldQueueLen -= LENGTH_MAX_BIT_WIDTH;
                 LZS_DEBUG(("Extended length %"PRIuFAST8"\n", pParams->length));
@@ -713,3 +1641,53 @@ size_t lzs_decompress_incremental(LzsDecompressParameters_t * pParams)
 
     return outCount;
 }
+
+
+/*
+ * \brief Incremental decompression
+ *
+ * State is kept between calls, so decompression can be done gradually, and flexibly
+ * depending on the application's needs for input/output buffer handling.
+ *
+ * It will stop if/when it reaches the end of either the input or the output buffer.
+ * It will also stop if/when it reaches an end marker.
+ *
+ * Output buffer space past the final outPtr may be overwritten with rubbish.
+ */
+size_t lzs_decompress_incremental(LzsDecompressParameters_t * pParams)
+{
+    return lzs_decompress_incremental_mode(pParams, false);
+}
+
+
+/*
+ * \brief Skip over decompressed data in incremental decompression
+ *
+ * This is like lzs_decompress_incremental(), but the data isn't output.
+ * It is decompressed straight into the history buffer, so decompression can
+ * carry on after the skipped data, and no other buffer is needed.
+ * pParams->outPtr and pParams->outLength are not used or changed.
+ *
+ * It will stop when len bytes have been skipped, with
+ * LZS_D_STATUS_NO_OUTPUT_BUFFER_SPACE in pParams->status. It will also stop
+ * if/when it reaches the end of the input buffer, or an end marker.
+ *
+ * Return value is the number of bytes that were skipped.
+ */
+size_t lzs_decompress_skip(LzsDecompressParameters_t * pParams, size_t len)
+{
+    uint8_t           * outPtr;
+    size_t              outLength;
+    size_t              skipCount;
+
+
+    // In discard mode, outLength is the count of bytes to skip, and outPtr is not used
+    outPtr = pParams->outPtr;
+    outLength = pParams->outLength;
+    pParams->outLength = len;
+    skipCount = lzs_decompress_incremental_mode(pParams, true);
+    pParams->outPtr = outPtr;
+    pParams->outLength = outLength;
+
+    return skipCount;
+}
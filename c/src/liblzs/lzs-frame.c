@@ -0,0 +1,329 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief LZS Framed Container
+ *
+ * This implements a simple container for LZS compressed data, that splits the
+ * data into independent blocks. Each block is a standard LZS stream, with its
+ * own end marker, compressed with an empty history. So blocks can be
+ * compressed and decompressed in parallel, and a block can be decompressed
+ * without decompressing the blocks before it.
+ *
+ * Layout, with all multi-byte fields little-endian:
+ *
+ *     Frame header (LZS_FRAME_HEADER_SIZE bytes):
+ *         magic           4   0x89 'L' 'Z' 'F'
+ *         version         1   LZS_FRAME_VERSION
+ *         flags           1   LZS_FRAME_FLAG_*
+ *         reserved        2   0
+ *         block size      4   Uncompressed size of every block but the last
+ *
+ *     Blocks, each:
+ *         block header    LZS_FRAME_BLOCK_HEADER_SIZE bytes:
+ *             compressed length   4
+ *             raw length          4
+ *             checksum            4   Adler-32 of the raw data, or 0 if
+ *                                     LZS_FRAME_FLAG_CHECKSUM isn't set
+ *         LZS data        compressed length bytes
+ *
+ *     End of blocks:      a block header that is all zero
+ *
+ *     Index:              a copy of each block header, in order
+ *
+ *     Footer (LZS_FRAME_FOOTER_SIZE bytes):
+ *         block count     4
+ *         magic           4   0x89 'L' 'Z' 'X'
+ *
+ * A reader that streams the data can stop at the end of blocks. A reader that
+ * wants random access can read the footer at the end of the file, then the
+ * index before it, and add up the block sizes to find any block.
+ *
+ * This code is licensed according to the MIT license as follows:
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2017 Craig McQueen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ----------------------------------------------------------------------------
+ ****************************************************************************/
+
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include "lzs.h"
+#include "lzs-common.h"
+
+#include <stdint.h>
+
+
+/*****************************************************************************
+ * Defines
+ ****************************************************************************/
+
+#define FRAME_MAGIC_0               0x89u
+#define FRAME_MAGIC_1               'L'
+#define FRAME_MAGIC_2               'Z'
+#define FRAME_MAGIC_3               'F'
+#define FRAME_FOOTER_MAGIC_3        'X'
+
+#define FRAME_FLAGS_KNOWN           (LZS_FRAME_FLAG_CHECKSUM)
+
+// Adler-32 parameters. ADLER_NMAX is the most bytes that can be summed before
+// the sums must be reduced, to avoid overflowing 32 bits.
+#define ADLER_MOD                   65521u
+#define ADLER_NMAX                  5552u
+
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+/*
+ * \brief Update an Adler-32 checksum
+ *
+ * Start with LZS_FRAME_CHECKSUM_INIT.
+ */
+uint32_t lzs_frame_checksum(uint32_t checksum, const uint8_t * pData, size_t len)
+{
+    uint32_t    a = checksum & 0xFFFFu;
+    uint32_t    b = checksum >> 16u;
+    size_t      n;
+
+    while (len != 0)
+    {
+        n = LZSMIN(len, ADLER_NMAX);
+        len -= n;
+        while (n--)
+        {
+            a += *pData++;
+            b += a;
+        }
+        a %= ADLER_MOD;
+        b %= ADLER_MOD;
+    }
+    return (b << 16u) | a;
+}
+
+/*
+ * \brief Write a frame header
+ *
+ * Writes LZS_FRAME_HEADER_SIZE bytes, and returns that size.
+ */
+size_t lzs_frame_write_header(uint8_t * pOut, const LzsFrameHeader_t * pHeader)
+{
+    pOut[0] = FRAME_MAGIC_0;
+    pOut[1] = FRAME_MAGIC_1;
+    pOut[2] = FRAME_MAGIC_2;
+    pOut[3] = FRAME_MAGIC_3;
+    pOut[4] = LZS_FRAME_VERSION;
+    pOut[5] = pHeader->flags;
+    pOut[6] = 0;
+    pOut[7] = 0;
+    lzs_store_le32(pOut + 8u, pHeader->blockSize);
+    return LZS_FRAME_HEADER_SIZE;
+}
+
+/*
+ * \brief Read and check a frame header
+ *
+ * Returns false if there are fewer than LZS_FRAME_HEADER_SIZE bytes, or they
+ * aren't a frame header of a version and with flags and block size that this
+ * code supports.
+ *
+ * The first byte of the magic can't start a valid LZS stream, so this can also
+ * be used to tell framed data from a plain LZS stream.
+ */
+bool lzs_frame_read_header(const uint8_t * pIn, size_t inLen, LzsFrameHeader_t * pHeader)
+{
+    if (
+            (inLen < LZS_FRAME_HEADER_SIZE) ||
+            (pIn[0] != FRAME_MAGIC_0) ||
+            (pIn[1] != FRAME_MAGIC_1) ||
+            (pIn[2] != FRAME_MAGIC_2) ||
+            (pIn[3] != FRAME_MAGIC_3) ||
+            (pIn[4] != LZS_FRAME_VERSION) ||
+            ((pIn[5] & ~FRAME_FLAGS_KNOWN) != 0) ||
+            (pIn[6] != 0) ||
+            (pIn[7] != 0)
+       )
+    {
+        return false;
+    }
+    pHeader->flags = pIn[5];
+    pHeader->blockSize = lzs_load_le32(pIn + 8u);
+    return (pHeader->blockSize != 0) && (pHeader->blockSize <= LZS_FRAME_BLOCK_SIZE_MAX);
+}
+
+/*
+ * \brief Write a block header
+ *
+ * This is used for the header before each block's data, the all-zero header at
+ * the end of the blocks, and the entries of the index. Writes
+ * LZS_FRAME_BLOCK_HEADER_SIZE bytes, and returns that size.
+ */
+size_t lzs_frame_write_block_header(uint8_t * pOut, const LzsFrameBlock_t * pBlock)
+{
+    lzs_store_le32(pOut, pBlock->compressedLen);
+    lzs_store_le32(pOut + 4u, pBlock->rawLen);
+    lzs_store_le32(pOut + 8u, pBlock->checksum);
+    return LZS_FRAME_BLOCK_HEADER_SIZE;
+}
+
+/*
+ * \brief Read a block header
+ *
+ * Reads LZS_FRAME_BLOCK_HEADER_SIZE bytes. Returns false if the block header
+ * is the end of the blocks, or the lengths are too big for the frame's block
+ * size.
+ */
+bool lzs_frame_read_block_header(const uint8_t * pIn, const LzsFrameHeader_t * pHeader, LzsFrameBlock_t * pBlock)
+{
+    pBlock->compressedLen = lzs_load_le32(pIn);
+    pBlock->rawLen = lzs_load_le32(pIn + 4u);
+    pBlock->checksum = lzs_load_le32(pIn + 8u);
+    return (pBlock->rawLen != 0) &&
+            (pBlock->rawLen <= pHeader->blockSize) &&
+            (pBlock->compressedLen != 0) &&
+            (pBlock->compressedLen <= LZS_COMPRESSED_MAX(pHeader->blockSize));
+}
+
+/*
+ * \brief Write the footer that follows the index
+ *
+ * Writes LZS_FRAME_FOOTER_SIZE bytes, and returns that size.
+ */
+size_t lzs_frame_write_footer(uint8_t * pOut, uint32_t blockCount)
+{
+    lzs_store_le32(pOut, blockCount);
+    pOut[4] = FRAME_MAGIC_0;
+    pOut[5] = FRAME_MAGIC_1;
+    pOut[6] = FRAME_MAGIC_2;
+    pOut[7] = FRAME_FOOTER_MAGIC_3;
+    return LZS_FRAME_FOOTER_SIZE;
+}
+
+/*
+ * \brief Read and check the footer at the end of framed data
+ *
+ * Reads LZS_FRAME_FOOTER_SIZE bytes. The index of
+ * blockCount * LZS_FRAME_BLOCK_HEADER_SIZE bytes is just before it.
+ */
+bool lzs_frame_read_footer(const uint8_t * pIn, uint32_t * pBlockCount)
+{
+    if (
+            (pIn[4] != FRAME_MAGIC_0) ||
+            (pIn[5] != FRAME_MAGIC_1) ||
+            (pIn[6] != FRAME_MAGIC_2) ||
+            (pIn[7] != FRAME_FOOTER_MAGIC_3)
+       )
+    {
+        return false;
+    }
+    *pBlockCount = lzs_load_le32(pIn);
+    return true;
+}
+
+/*
+ * \brief Compress one block, with its block header
+ *
+ * The input is compressed with an empty history at the given compression
+ * level. The output buffer must have space for at least
+ * LZS_FRAME_BLOCK_MAX(inLen) bytes. Returns the size of the block header and
+ * data, or 0 if the input is empty or too big, or the output buffer is too
+ * small.
+ *
+ * This keeps no state between calls, so blocks can be compressed on different
+ * threads at the same time.
+ */
+size_t lzs_frame_compress_block(uint8_t * pOut, size_t outBufferSize, const uint8_t * pIn, size_t inLen,
+                                uint8_t level, uint8_t flags)
+{
+    LzsFrameBlock_t     block;
+
+    if (
+            (inLen == 0) ||
+            (inLen > LZS_FRAME_BLOCK_SIZE_MAX) ||
+            (outBufferSize < LZS_FRAME_BLOCK_MAX(inLen))
+       )
+    {
+        return 0;
+    }
+    block.compressedLen = lzs_compress_level(pOut + LZS_FRAME_BLOCK_HEADER_SIZE,
+                                             outBufferSize - LZS_FRAME_BLOCK_HEADER_SIZE,
+                                             pIn, inLen, level);
+    block.rawLen = inLen;
+    block.checksum = 0;
+    if (flags & LZS_FRAME_FLAG_CHECKSUM)
+    {
+        block.checksum = lzs_frame_checksum(LZS_FRAME_CHECKSUM_INIT, pIn, inLen);
+    }
+    lzs_frame_write_block_header(pOut, &block);
+    return LZS_FRAME_BLOCK_HEADER_SIZE + block.compressedLen;
+}
+
+/*
+ * \brief Decompress the data of one block
+ *
+ * pData points to the block's compressedLen bytes of LZS data, after its block
+ * header. The output buffer must have space for the block's rawLen bytes.
+ * Returns false if the data doesn't decompress to exactly rawLen bytes, if
+ * there is data after the end marker, or the checksum doesn't match when the
+ * frame has LZS_FRAME_FLAG_CHECKSUM. Only the byte with the end marker may
+ * have padding bits.
+ *
+ * It is decompressed incrementally, so that the end marker can be checked
+ * for after rawLen bytes, even without a checksum. The decompression state,
+ * with its history, is on the stack.
+ *
+ * This keeps no state between calls, so blocks can be decompressed on
+ * different threads at the same time.
+ */
+bool lzs_frame_decompress_block(uint8_t * pOut, size_t outBufferSize, const uint8_t * pData,
+                                const LzsFrameBlock_t * pBlock, uint8_t flags)
+{
+    LzsDecompressParameters_t   params;
+
+    if (pBlock->rawLen > outBufferSize)
+    {
+        return false;
+    }
+    lzs_decompress_init(&params);
+    params.inPtr = pData;
+    params.inLength = pBlock->compressedLen;
+    params.outPtr = pOut;
+    params.outLength = pBlock->rawLen;
+    if (
+            (lzs_decompress_incremental(&params) != pBlock->rawLen) ||
+            ((params.status & LZS_D_STATUS_END_MARKER) == 0) ||
+            // The end marker leaves the bit field queue at a byte boundary,
+            // so any bits left in it are whole bytes after the marker.
+            (params.inLength != 0) ||
+            (params.bitFieldQueueLen != 0)
+       )
+    {
+        return false;
+    }
+    if (flags & LZS_FRAME_FLAG_CHECKSUM)
+    {
+        return lzs_frame_checksum(LZS_FRAME_CHECKSUM_INIT, pOut, pBlock->rawLen) == pBlock->checksum;
+    }
+    return true;
+}
@@ -0,0 +1,441 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief LZS Parallel Compression
+ *
+ * This compresses a large input on several threads, to a single standard LZS
+ * stream, in one of two ways.
+ *
+ * lzs_compress_parallel() splits the input into segments, and each segment is
+ * compressed with the data before it (up to LZS_MAX_HISTORY_SIZE bytes) in its
+ * history, so matches can still refer back across the segment boundary.
+ * Segments are compressed without end markers, and then joined at whatever bit
+ * position the previous segment ended.
+ *
+ * lzs_compress_parallel_search() searches for the matches at every input
+ * position on several threads, and then chooses and encodes matches on one
+ * thread. The hash chains at each position don't depend on which matches are
+ * chosen, so the output is the same as for lzs_compress_level().
+ *
+ * This code is licensed according to the MIT license as follows:
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2017 Craig McQueen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ----------------------------------------------------------------------------
+ ****************************************************************************/
+
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "lzs.h"
+#include "lzs-common.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+
+/*****************************************************************************
+ * Defines
+ ****************************************************************************/
+
+// Most segments an input is split into. Larger inputs get larger segments, so
+// the per-segment state fits on the stack.
+#define PARALLEL_SEGMENTS_MAX       256u
+
+// Most threads used for one call
+#define PARALLEL_THREADS_MAX        64u
+
+// lzs_compress_parallel_search() searches ranges of at least this size.
+#define SEARCH_CHUNK_MIN            (64ul * 1024ul)
+
+// Worst-case size of a compressed segment of X bytes, which has no end marker.
+// Each segment is compressed into its own region of the output buffer, of this size.
+#define SEGMENT_BOUND(X)            ((X) + ((X) + 7u) / 8u)
+
+// Size of the end marker, padded to a byte boundary, with a byte of space for
+// joining it at any bit position.
+#define END_MARKER_BOUND            3u
+
+
+/*****************************************************************************
+ * Typedefs
+ ****************************************************************************/
+
+// A function that does one task of a parallel_run()
+typedef void (* LzsParallelTask_t)(void * pContext, size_t task);
+
+// State shared by the threads of one parallel_run()
+typedef struct
+{
+    LzsParallelTask_t   pTask;
+    void              * pContext;
+    size_t              numTasks;
+    size_t              nextTask;           // Next task for a thread to take
+#if HAVE_PTHREAD
+    pthread_mutex_t     mutex;              // Guards nextTask
+#endif
+} LzsParallelRun_t;
+
+// State of one lzs_compress_parallel() call
+typedef struct
+{
+    const uint8_t     * pInData;
+    size_t              inLen;
+    uint8_t           * pOutData;
+    size_t              segmentSize;
+    uint8_t             level;
+    size_t              bitCounts[PARALLEL_SEGMENTS_MAX];
+} LzsParallelCompress_t;
+
+// State of one lzs_compress_parallel_search() call. Search chunk k is the
+// input from k * chunkSize. pHeads[k] is the hash table for the position
+// LZS_MAX_HISTORY_SIZE before chunk k + 1, and pTails[k] is for chunk k + 1.
+typedef struct
+{
+    const uint8_t     * pInData;
+    size_t              inLen;
+    size_t              chunkSize;
+    uint16_t          * pMatches;
+    uint16_t          * pHeads;
+    uint16_t          * pTails;
+    uint8_t             level;
+} LzsParallelSearch_t;
+
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+// Take the next task. Return numTasks when there are no more.
+static size_t parallel_next_task(LzsParallelRun_t * pRun)
+{
+    size_t              task;
+
+#if HAVE_PTHREAD
+    pthread_mutex_lock(&pRun->mutex);
+#endif
+    task = pRun->nextTask;
+    if (task < pRun->numTasks)
+    {
+        pRun->nextTask++;
+    }
+#if HAVE_PTHREAD
+    pthread_mutex_unlock(&pRun->mutex);
+#endif
+    return task;
+}
+
+// Do tasks until there are none left. This runs on each thread, including the caller's.
+static void * parallel_worker(void * pArg)
+{
+    LzsParallelRun_t  * pRun = pArg;
+    size_t              task;
+
+    while ((task = parallel_next_task(pRun)) < pRun->numTasks)
+    {
+        pRun->pTask(pRun->pContext, task);
+    }
+    return NULL;
+}
+
+// Do tasks 0 to numTasks - 1 on up to numThreads threads, including the
+// caller's, and return when they are all done. Without POSIX threads, they
+// are done in turn on the caller's thread.
+static void parallel_run(unsigned numThreads, size_t numTasks, LzsParallelTask_t pTask, void * pContext)
+{
+    LzsParallelRun_t    run;
+#if HAVE_PTHREAD
+    pthread_t           threads[PARALLEL_THREADS_MAX];
+    unsigned            numCreated = 0;
+    unsigned            i;
+#endif
+
+    run.pTask = pTask;
+    run.pContext = pContext;
+    run.numTasks = numTasks;
+    run.nextTask = 0;
+#if HAVE_PTHREAD
+    pthread_mutex_init(&run.mutex, NULL);
+    numThreads = LZSMIN(LZSMIN(numThreads, PARALLEL_THREADS_MAX), numTasks);
+    for (i = 1u; i < numThreads; i++)
+    {
+        if (pthread_create(&threads[numCreated], NULL, parallel_worker, &run) == 0)
+        {
+            numCreated++;
+        }
+    }
+#else
+    (void)numThreads;
+#endif
+    parallel_worker(&run);
+#if HAVE_PTHREAD
+    for (i = 0; i < numCreated; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&run.mutex);
+#endif
+}
+
+// Compress one segment for lzs_compress_parallel()
+static void parallel_compress_task(void * pContext, size_t segment)
+{
+    LzsParallelCompress_t * pJob = pContext;
+    size_t              start;
+    size_t              len;
+
+    start = segment * pJob->segmentSize;
+    len = LZSMIN(pJob->segmentSize, pJob->inLen - start);
+    lzs_compress_segment(pJob->pOutData + segment * SEGMENT_BOUND(pJob->segmentSize), SEGMENT_BOUND(len),
+                         pJob->pInData + start, len, start, pJob->level, &pJob->bitCounts[segment]);
+}
+
+// Find the hash tables at the end of search chunk k, and LZS_MAX_HISTORY_SIZE
+// before it, for lzs_compress_parallel_search(). They only have the positions
+// in chunk k, until they are combined with the tables before them.
+static void parallel_heads_task(void * pContext, size_t chunk)
+{
+    LzsParallelSearch_t * pJob = pContext;
+    size_t              start = chunk * pJob->chunkSize;
+    size_t              end = start + pJob->chunkSize;
+    uint16_t          * pHeads = pJob->pHeads + chunk * INPUT_HASH_SIZE;
+    uint16_t          * pTails = pJob->pTails + chunk * INPUT_HASH_SIZE;
+
+    memset(pHeads, 0xFF, INPUT_HASH_SIZE * sizeof(pHeads[0]));
+    memset(pTails, 0xFF, INPUT_HASH_SIZE * sizeof(pTails[0]));
+    lzs_search_heads(pJob->pInData, pJob->inLen, start, end - LZS_MAX_HISTORY_SIZE, pHeads);
+    lzs_search_heads(pJob->pInData, pJob->inLen, end - LZS_MAX_HISTORY_SIZE, end, pTails);
+}
+
+// Search chunk k for lzs_compress_parallel_search()
+static void parallel_search_task(void * pContext, size_t chunk)
+{
+    LzsParallelSearch_t * pJob = pContext;
+    size_t              start = chunk * pJob->chunkSize;
+
+    lzs_search_matches(pJob->pInData, pJob->inLen, start, LZSMIN(start + pJob->chunkSize, pJob->inLen), pJob->level,
+                       (chunk != 0) ? (pJob->pHeads + (chunk - 1u) * INPUT_HASH_SIZE) : NULL, pJob->pMatches);
+}
+
+// Number of search chunks for lzs_compress_parallel_search(), and their size via pChunkSize
+static size_t parallel_search_chunks(size_t a_inLen, size_t * pChunkSize)
+{
+    *pChunkSize = LZSMAX(SEARCH_CHUNK_MIN, (a_inLen + PARALLEL_SEGMENTS_MAX - 1u) / PARALLEL_SEGMENTS_MAX);
+    return (a_inLen + *pChunkSize - 1u) / *pChunkSize;
+}
+
+// Copy numBits bits from pSrc to the output, starting at bit bitPos of it.
+// Bits after bitPos in its byte must be zero, and pSrc must not be before that
+// byte, so the bits can be moved down within the output buffer. Return the
+// bit position after them. The bits after that in the last byte are zero.
+static size_t parallel_splice_bits(uint8_t * pOut, size_t bitPos, const uint8_t * pSrc, size_t numBits)
+{
+    uint8_t           * pDst = pOut + bitPos / 8u;
+    uint_fast8_t        shift = bitPos % 8u;
+    size_t              numBytes = (numBits + 7u) / 8u;
+    size_t              i;
+    uint8_t             carry;
+    uint8_t             temp8;
+
+    if (shift == 0)
+    {
+        memmove(pDst, pSrc, numBytes);
+    }
+    else
+    {
+        // pDst is before pSrc, so each byte is read before it is written
+        carry = *pDst;
+        for (i = 0; i < numBytes; i++)
+        {
+            temp8 = pSrc[i];
+            pDst[i] = carry | (uint8_t)(temp8 >> shift);
+            carry = (uint8_t)(temp8 << (8u - shift));
+        }
+        pDst[numBytes] = carry;
+    }
+    return bitPos + numBits;
+}
+
+/*
+ * \brief Single-call compression on several threads
+ *
+ * The output is a single standard LZS stream, the same for any number of
+ * threads, that can be decompressed by lzs_decompress(). The input is split
+ * into segments of at least LZS_COMPRESS_PARALLEL_SEGMENT_SIZE bytes, that are
+ * compressed at the given level on up to numThreads threads, including the
+ * caller's. Each segment starts with the data before it in its history, so
+ * compression is nearly as good as for lzs_compress_level(). Only matches that
+ * would cross the end of a segment are lost.
+ *
+ * Each segment is compressed into its own region of the output buffer, so the
+ * output buffer should have space for LZS_COMPRESS_PARALLEL_MAX(a_inLen) bytes,
+ * a little more than LZS_COMPRESSED_MAX(a_inLen). If it doesn't, or the input
+ * is no more than one segment, this is the same as lzs_compress_level().
+ *
+ * Without POSIX threads, the segments are compressed in turn on the caller's
+ * thread, with the same output.
+ */
+size_t lzs_compress_parallel(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen,
+                             uint8_t level, unsigned numThreads)
+{
+    LzsParallelCompress_t   job;
+    size_t              numSegments;
+    size_t              segment;
+    size_t              bitPos;
+    static const uint8_t endMarker[2] = { 0xC0u, 0x00u };   // 0b110000000
+
+    job.segmentSize = LZSMAX(LZS_COMPRESS_PARALLEL_SEGMENT_SIZE,
+                             (a_inLen + PARALLEL_SEGMENTS_MAX - 1u) / PARALLEL_SEGMENTS_MAX);
+    if (
+            (a_inLen <= job.segmentSize) ||
+            (a_outBufferSize < SEGMENT_BOUND(job.segmentSize) * ((a_inLen - 1u) / job.segmentSize) +
+                               SEGMENT_BOUND((a_inLen - 1u) % job.segmentSize + 1u) + END_MARKER_BOUND)
+       )
+    {
+        return lzs_compress_level(a_pOutData, a_outBufferSize, a_pInData, a_inLen, level);
+    }
+    job.pInData = a_pInData;
+    job.inLen = a_inLen;
+    job.pOutData = a_pOutData;
+    job.level = level;
+    memset(job.bitCounts, 0, sizeof(job.bitCounts));
+    numSegments = (a_inLen + job.segmentSize - 1u) / job.segmentSize;
+    parallel_run(numThreads, numSegments, parallel_compress_task, &job);
+
+    // Join the segments. The first is already in place.
+    bitPos = job.bitCounts[0];
+    for (segment = 1u; segment < numSegments; segment++)
+    {
+        bitPos = parallel_splice_bits(a_pOutData, bitPos,
+                                      a_pOutData + segment * SEGMENT_BOUND(job.segmentSize), job.bitCounts[segment]);
+    }
+    bitPos = parallel_splice_bits(a_pOutData, bitPos, endMarker, 2u + SHORT_OFFSET_BITS);
+    return (bitPos + 7u) / 8u;
+}
+
+/*
+ * \brief Return the size of the workspace needed by
+ * lzs_compress_parallel_search(), for a given input size and compression level
+ *
+ * This is 2 bytes per input byte for each match that is searched for at each
+ * position (one, plus one for each position of lazy matching), and a few kB
+ * for each range of input that is searched on its own. Returns 0 if
+ * lzs_compress_parallel_search() would be the same as lzs_compress_level(),
+ * without a workspace.
+ */
+size_t lzs_compress_parallel_search_workspace_size(size_t a_inLen, uint8_t level)
+{
+    size_t              numChunks;
+    size_t              chunkSize;
+    uint_fast8_t        matchesPerPosition;
+
+    matchesPerPosition = lzs_search_matches_per_position(level, a_inLen);
+    if (matchesPerPosition == 0)
+    {
+        return 0;
+    }
+    numChunks = parallel_search_chunks(a_inLen, &chunkSize);
+    return (matchesPerPosition * a_inLen + 2u * (numChunks - 1u) * INPUT_HASH_SIZE) * sizeof(uint16_t);
+}
+
+/*
+ * \brief Single-call compression, with the search for matches done on several
+ * threads
+ *
+ * The matches at every input position are searched for on up to numThreads
+ * threads, including the caller's, and stored in the workspace. Then they are
+ * chosen and encoded on the caller's thread. The output is the same as for
+ * lzs_compress_level(), at the same level.
+ *
+ * pWorkspace must have the size given by
+ * lzs_compress_parallel_search_workspace_size() for the same input size and
+ * level, and be aligned as for malloc(). If that size is 0, as it is for
+ * levels that don't add every position to the hash tables, or input no longer
+ * than the history, this is the same as lzs_compress_level(), and pWorkspace
+ * isn't used.
+ *
+ * A match is searched for at every position, where lzs_compress_level() only
+ * searches where each match or literal starts, so the total work is several
+ * times greater. This is only faster with enough threads to make up for that.
+ *
+ * Without POSIX threads, the searches are done in turn on the caller's
+ * thread, with the same output.
+ */
+size_t lzs_compress_parallel_search(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen,
+                                    uint8_t level, unsigned numThreads, void * pWorkspace)
+{
+    LzsParallelSearch_t job;
+    size_t              numChunks;
+    size_t              chunk;
+    uint_fast16_t       i;
+    uint16_t          * pHeads;
+    uint16_t          * pTails;
+    uint16_t          * pPrevTails;
+    uint_fast8_t        matchesPerPosition;
+
+    matchesPerPosition = lzs_search_matches_per_position(level, a_inLen);
+    if (matchesPerPosition == 0)
+    {
+        return lzs_compress_level(a_pOutData, a_outBufferSize, a_pInData, a_inLen, level);
+    }
+    numChunks = parallel_search_chunks(a_inLen, &job.chunkSize);
+    job.pInData = a_pInData;
+    job.inLen = a_inLen;
+    job.level = level;
+    job.pMatches = pWorkspace;
+    job.pHeads = job.pMatches + matchesPerPosition * a_inLen;
+    job.pTails = job.pHeads + (numChunks - 1u) * INPUT_HASH_SIZE;
+
+    // Find the hash tables that each chunk's search starts from. Each chunk's
+    // own tables are found in parallel, then combined in order with the
+    // tables before them, where they have no entry.
+    parallel_run(numThreads, numChunks - 1u, parallel_heads_task, &job);
+    for (chunk = 0; chunk + 1u < numChunks; chunk++)
+    {
+        pHeads = job.pHeads + chunk * INPUT_HASH_SIZE;
+        pTails = job.pTails + chunk * INPUT_HASH_SIZE;
+        pPrevTails = pTails - INPUT_HASH_SIZE;
+        for (i = 0; i < INPUT_HASH_SIZE; i++)
+        {
+            if (chunk != 0 && pHeads[i] == UINT16_MAX)
+            {
+                pHeads[i] = pPrevTails[i];
+            }
+            if (pTails[i] == UINT16_MAX)
+            {
+                pTails[i] = pHeads[i];
+            }
+        }
+    }
+
+    parallel_run(numThreads, numChunks, parallel_search_task, &job);
+    return lzs_compress_matches(a_pOutData, a_outBufferSize, a_pInData, a_inLen, level, job.pMatches);
+}
@@ -45,6 +45,8 @@
  * Includes
  ****************************************************************************/
 
+#include "lzs-config.h"
+
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdlib.h>
@@ -59,13 +61,38 @@
 // LZS_MAX_HISTORY_SIZE is derived from LONG_OFFSET_BITS.
 #define LZS_MAX_HISTORY_SIZE        ((1u << 11u) - 1u)
 
+// LZS_COMPRESS_LINEAR_HISTORY is 1 if the history buffer for incremental
+// compression is linear, rather than circular. It is about twice the size, but
+// input can be copied into it in bulk, and matches are compared without
+// wrapping indexes. When it fills up, the data is moved down to the start.
+// This makes incremental compression faster, for about 6 kB more memory.
+// It changes the layout of LzsCompressParameters_t, so it is chosen when the
+// library is configured (--enable-linear-history), and set in lzs-config.h.
+
 // Size to use for history buffer for incremental compression.
 // Implementation detail: the history buffer also stores look-ahead data.
+#if LZS_COMPRESS_LINEAR_HISTORY
+#define LZS_COMPRESS_HISTORY_SIZE   (2u * (LZS_MAX_HISTORY_SIZE + 1u))
+// Look-ahead data is copied in blocks of up to this size.
+#define LZS_COMPRESS_LINEAR_LOOK_AHEAD_LEN  255u
+#else
 #define LZS_COMPRESS_HISTORY_SIZE   (LZS_MAX_HISTORY_SIZE + LZS_MAX_LOOK_AHEAD_LEN)
+#endif
 
 #define LZS_DECOMPRESS_HISTORY_SIZE LZS_MAX_HISTORY_SIZE
 
-#define INPUT_HASH_SIZE             (1u << 12u)
+// The parameter structures put the state that is used for every byte first,
+// in one cache line of this size, and align the arrays after it to the cache
+// line size. Callers that allocate them dynamically should use this alignment.
+#define LZS_CACHE_LINE_SIZE         64u
+#if defined(__GNUC__)
+#define LZS_CACHE_ALIGNED           __attribute__((aligned(LZS_CACHE_LINE_SIZE)))
+#else
+#define LZS_CACHE_ALIGNED
+#endif
+
+#define INPUT_HASH_BITS             12u
+#define INPUT_HASH_SIZE             (1u << INPUT_HASH_BITS)
 
 
 /*****************************************************************************
@@ -76,10 +103,58 @@
 // Worst case is 9/8 times original size, plus a couple of bytes for end marker.
 #define LZS_COMPRESSED_MAX(X)       ((X) + ((X) + 7u) / 8u + 3u)
 
+// Compression levels. Higher levels search harder for matches, for better
+// compression but slower speed.
+#define LZS_COMPRESS_LEVEL_MIN      1u
+#define LZS_COMPRESS_LEVEL_MAX      9u
+#define LZS_COMPRESS_LEVEL_DEFAULT  6u
+
+// Range of the number of bits of hash for LZS_HASH_MULT2 and LZS_HASH_MULT3, and
+// the number of entries needed in a caller-supplied hash table with a given
+// number of bits. LZS_HASH_DIRECT always uses LZS_HASH_BITS_MAX bits.
+#define LZS_HASH_BITS_MIN           6u
+#define LZS_HASH_BITS_MAX           16u
+#define LZS_HASH_TABLE_ENTRIES(BITS)    (1ul << (BITS))
+
 // Worst-case size of LZS decompressed data, given compressed input data of
 // size X. Worst case is 16 times original size.
+// Use lzs_decompressed_size() to get the exact size.
 #define LZS_DECOMPRESSED_MAX(X)     ((X) * 16u)
 
+// Size of a buffer for lzs_decompress_in_place(), given decompressed data of
+// size X. Any LZS stream of X bytes fits at the end of it, and the data it is
+// decompressed to never catches up with the compressed data that is still to
+// be read. The margin is the worst-case expansion of literals (9 bits for each
+// byte, so X / 8), plus 2 bytes for the end marker and the padding after it,
+// plus 8 bytes that lzs_decompress() may write past the end of a match.
+#define LZS_DECOMPRESS_IN_PLACE_MARGIN(X)   (((X) + 7u) / 8u + 2u + 8u)
+#define LZS_DECOMPRESS_IN_PLACE_SIZE(X)     ((X) + LZS_DECOMPRESS_IN_PLACE_MARGIN(X))
+
+// lzs_compress_parallel() splits its input into segments of at least this
+// size. Its output buffer should have space for LZS_COMPRESS_PARALLEL_MAX(X)
+// bytes, given input data of size X, which allows for a region for each segment.
+#define LZS_COMPRESS_PARALLEL_SEGMENT_SIZE  (128ul * 1024ul)
+#define LZS_COMPRESS_PARALLEL_MAX(X)        (LZS_COMPRESSED_MAX(X) + (X) / LZS_COMPRESS_PARALLEL_SEGMENT_SIZE + 1u)
+
+// Framed container of independent blocks (see lzs-frame.c for the layout).
+#define LZS_FRAME_VERSION           1u
+#define LZS_FRAME_HEADER_SIZE       12u
+#define LZS_FRAME_BLOCK_HEADER_SIZE 12u
+#define LZS_FRAME_FOOTER_SIZE       8u
+#define LZS_FRAME_FLAG_CHECKSUM     0x01u     // Each block header has an Adler-32 checksum of the raw data
+#define LZS_FRAME_CHECKSUM_INIT     1u
+#define LZS_FRAME_BLOCK_SIZE_DEFAULT    (1024ul * 1024ul)
+#define LZS_FRAME_BLOCK_SIZE_MAX        (256ul * 1024ul * 1024ul)
+// Worst-case size of a compressed block with its block header, given X bytes
+// of input data.
+#define LZS_FRAME_BLOCK_MAX(X)      (LZS_FRAME_BLOCK_HEADER_SIZE + LZS_COMPRESSED_MAX(X))
+
+// Checkpoint index, for seeking in an LZS stream (see lzs-checkpoint.c for the layout).
+#define LZS_CHECKPOINT_VERSION      1u
+#define LZS_CHECKPOINT_HEADER_SIZE  12u
+#define LZS_CHECKPOINT_SIZE         (24u + LZS_MAX_HISTORY_SIZE)
+#define LZS_CHECKPOINT_INTERVAL_DEFAULT (64ul * 1024ul)
+
 
 /*****************************************************************************
  * Typedefs
@@ -87,6 +162,15 @@
 
 typedef uint16_t    lzs_input_hash_t;
 
+// Hash function used by the compressor to find match candidates
+typedef enum
+{
+    LZS_HASH_DEFAULT                    = 0,    // 2 bytes, hashed to INPUT_HASH_BITS bits
+    LZS_HASH_DIRECT                     = 1,    // 2 bytes, used directly as a 16-bit index, so there are no false candidates
+    LZS_HASH_MULT3                      = 2,    // 3 bytes, multiplicative hash. Matches of length 2 aren't found.
+    LZS_HASH_MULT2                      = 3,    // 2 bytes, multiplicative hash
+} LzsHashType_t;
+
 typedef enum
 {
     LZS_C_STATUS_NONE                   = 0x00,
@@ -118,20 +202,47 @@ typedef struct
 
     /*
      * These are private members, and should not be changed.
+     * First, the state that is used for every byte, in the rest of the first cache line.
+     * The hash settings are read for every byte that is hashed.
+     * Counts that are updated for every byte are 32-bit, to avoid partial register writes.
      */
-    uint8_t             historyBuffer[LZS_COMPRESS_HISTORY_SIZE];
-    uint16_t            historyHash[LZS_COMPRESS_HISTORY_SIZE];
-    uint16_t            hashTable[INPUT_HASH_SIZE];
-    uint8_t             lookAheadLen;
-    uint32_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 31 when shifted left
-    uint8_t             bitFieldQueueLen;   // Number of bits in the queue
+    uint8_t             hashType;           // LzsHashType_t
+    uint8_t             hashBits;           // Hash table has (1 << hashBits) entries
+    uint32_t            bitFieldQueueLen;   // Number of bits in the queue
+    uint32_t            lookAheadLen;
+    uint32_t            state;              // LzsCompressState_t
     uint16_t            historyLatestIdx;
     uint16_t            historyLookAheadIdx;
     uint16_t            historyLen;
-    uint16_t            offset;
-    uint8_t             state;              // LzsCompressState_t
+    uint16_t            hashTag;            // Generation number tag of hash table entries
+    uint64_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 63 when shifted left
+
+    uint8_t             historyBuffer[LZS_COMPRESS_HISTORY_SIZE] LZS_CACHE_ALIGNED;
+    uint16_t            historyHash[LZS_COMPRESS_HISTORY_SIZE] LZS_CACHE_ALIGNED;
+    uint16_t            hashTable[INPUT_HASH_SIZE] LZS_CACHE_ALIGNED;
+    uint16_t          * pHashTable;         // Caller-supplied hash table, or NULL to use hashTable[]
+    uint16_t            offset;             // Offset of a match with extended length
+    uint8_t             level;              // Compression level, read once per call
 } LzsCompressParameters_t;
 
+/*
+ * Incremental compression contexts come in three memory tiers. Each keeps the
+ * full history, so a stream can move between tiers between calls, with
+ * lzs_compress_to_simple(), lzs_compress_from_simple() and
+ * lzs_simple_compress_set_hash(). For example, thousands of concurrent streams
+ * can be kept in the smallest tier while idle, and moved up while busy.
+ *
+ *  - Full: LzsCompressParameters_t. About 14 kB (20 kB with
+ *    LZS_COMPRESS_LINEAR_HISTORY). Hash chains, and compression levels.
+ *  - Reduced hash: LzsSimpleCompressParameters_t with a hash table of 256 to
+ *    1024 entries set by lzs_simple_compress_set_hash(). About 2 kB (4 kB with
+ *    LZS_COMPRESS_LINEAR_HISTORY) plus 2 bytes per entry. Only the latest
+ *    position with the same hash is tried, so it is about as fast as the full
+ *    tier at level 1, with about the same compression.
+ *  - History only: LzsSimpleCompressParameters_t. About 2 kB (4 kB with
+ *    LZS_COMPRESS_LINEAR_HISTORY). Every history position is searched, so it
+ *    is 50 to 100 times slower than the others.
+ */
 typedef struct
 {
     /*
@@ -155,8 +266,10 @@ typedef struct
      * These are private members, and should not be changed.
      */
     uint8_t             historyBuffer[LZS_COMPRESS_HISTORY_SIZE];
+    uint16_t          * pHashTable;         // Caller-supplied hash table of the latest position of each hash, or NULL
+    uint8_t             hashBits;           // Hash table has (1 << hashBits) entries
     uint8_t             lookAheadLen;
-    uint32_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 31 when shifted left
+    uint64_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 63 when shifted left
     uint8_t             bitFieldQueueLen;   // Number of bits in the queue
     uint16_t            historyLatestIdx;
     uint16_t            historyLookAheadIdx;
@@ -197,38 +310,126 @@ typedef struct
 
     /*
      * These are private members, and should not be changed.
+     * First, the state that is used for every byte, in the rest of the first cache line.
+     * Counts that are updated for every byte are 32-bit, to avoid partial register writes.
      */
-    uint8_t             historyBuffer[LZS_DECOMPRESS_HISTORY_SIZE];
-    uint32_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 31 when shifted left
-    uint8_t             bitFieldQueueLen;   // Number of bits in the queue
+    uint32_t            bitFieldQueueLen;   // Number of bits in the queue
+    uint32_t            length;
+    uint32_t            state;              // LzsDecompressState_t
     uint16_t            historyReadIdx;
     uint16_t            historyLatestIdx;
     uint16_t            historyLen;
     uint16_t            offset;
-    uint8_t             length;
-    uint8_t             state;              // LzsDecompressState_t
+    uint64_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 63 when shifted left
+
+    uint8_t             historyBuffer[LZS_DECOMPRESS_HISTORY_SIZE] LZS_CACHE_ALIGNED;
 } LzsDecompressParameters_t;
 
+typedef struct
+{
+    uint32_t            blockSize;          // Uncompressed size of every block but the last
+    uint8_t             flags;              // LZS_FRAME_FLAG_*
+} LzsFrameHeader_t;
+
+typedef struct
+{
+    uint32_t            compressedLen;      // Size of the LZS data after the block header
+    uint32_t            rawLen;             // Size of the data when it is decompressed
+    uint32_t            checksum;           // Adler-32 of the raw data, if LZS_FRAME_FLAG_CHECKSUM
+} LzsFrameBlock_t;
+
+// The state of incremental decompression at one position in a stream, from
+// which decompression can be resumed without the data before it. The members
+// other than outPos and inPos are private.
+typedef struct
+{
+    uint64_t            outPos;             // Position in the decompressed data
+    uint64_t            inPos;              // Position in the compressed data to resume reading from
+    uint8_t             bitCount;           // Number of bits, 0 to 7, before inPos that are still to be decoded
+    uint8_t             bits;               // Those bits, in the most significant bits
+    uint8_t             state;
+    uint8_t             length;
+    uint16_t            offset;
+    uint16_t            historyLen;
+    uint8_t             history[LZS_MAX_HISTORY_SIZE];  // The last historyLen bytes of decompressed data
+} LzsCheckpoint_t;
+
 
 /*****************************************************************************
  * Function prototypes
  ****************************************************************************/
 
 size_t lzs_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen);
+size_t lzs_compress_level(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen,
+                          uint8_t level);
+size_t lzs_compress_hash(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen,
+                         uint8_t level, uint8_t hashType, uint8_t hashBits, uint16_t * pHashTable);
+
+size_t lzs_compress_workspace_size(uint8_t hashType, uint8_t hashBits);
+void lzs_compress_workspace_init(void * pWorkspace, uint8_t hashType, uint8_t hashBits);
+size_t lzs_compress_ws(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen,
+                       uint8_t level, void * pWorkspace);
+
+size_t lzs_compress_parallel(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen,
+                             uint8_t level, unsigned numThreads);
+
+size_t lzs_compress_parallel_search_workspace_size(size_t a_inLen, uint8_t level);
+size_t lzs_compress_parallel_search(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen,
+                                    uint8_t level, unsigned numThreads, void * pWorkspace);
+
+size_t lzs_compress_optimal(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen);
 
 void lzs_compress_init_quick(LzsCompressParameters_t * pParams);
 void lzs_compress_init_full(LzsCompressParameters_t * pParams);
+void lzs_compress_init_level(LzsCompressParameters_t * pParams, uint8_t level);
+void lzs_compress_init_hash(LzsCompressParameters_t * pParams, uint8_t level,
+                            uint8_t hashType, uint8_t hashBits, uint16_t * pHashTable);
+void lzs_compress_reset(LzsCompressParameters_t * pParams);
+void lzs_compress_set_dictionary(LzsCompressParameters_t * pParams, const uint8_t * pDict, size_t dictLen);
+size_t lzs_compress_dictionary_size(const LzsCompressParameters_t * pParams);
+size_t lzs_compress_save_dictionary(const LzsCompressParameters_t * pParams, void * pBuffer, size_t bufferSize);
+bool lzs_compress_load_dictionary(LzsCompressParameters_t * pParams, const void * pBuffer, size_t bufferSize);
 size_t lzs_compress_incremental(LzsCompressParameters_t * pParams, bool add_end_marker);
 
 size_t lzs_simple_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen);
 
 void lzs_simple_compress_init(LzsSimpleCompressParameters_t * pParams);
+void lzs_simple_compress_set_hash(LzsSimpleCompressParameters_t * pParams, uint16_t * pHashTable, uint8_t hashBits);
 size_t lzs_simple_compress_incremental(LzsSimpleCompressParameters_t * pParams, bool add_end_marker);
 
+void lzs_compress_to_simple(const LzsCompressParameters_t * pParams, LzsSimpleCompressParameters_t * pSimpleParams);
+void lzs_compress_from_simple(LzsCompressParameters_t * pParams, const LzsSimpleCompressParameters_t * pSimpleParams);
+
 size_t lzs_decompress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen);
+size_t lzs_decompressed_size(const uint8_t * a_pInData, size_t a_inLen, uint8_t * a_pStatus);
+size_t lzs_decompress_in_place(uint8_t * pBuffer, size_t bufferSize, size_t inLen);
 
 void lzs_decompress_init(LzsDecompressParameters_t * pParams);
+void lzs_decompress_set_dictionary(LzsDecompressParameters_t * pParams, const uint8_t * pDict, size_t dictLen);
 size_t lzs_decompress_incremental(LzsDecompressParameters_t * pParams);
+size_t lzs_decompress_skip(LzsDecompressParameters_t * pParams, size_t len);
+void lzs_decompress_save_checkpoint(const LzsDecompressParameters_t * pParams, uint64_t inPos, uint64_t outPos,
+                                    LzsCheckpoint_t * pCheckpoint);
+bool lzs_decompress_restore_checkpoint(LzsDecompressParameters_t * pParams, const LzsCheckpoint_t * pCheckpoint);
+const LzsCheckpoint_t * lzs_decompress_seek(LzsDecompressParameters_t * pParams, const LzsCheckpoint_t * pCheckpoints,
+                                            size_t numCheckpoints, uint64_t outPos);
+
+uint32_t lzs_frame_checksum(uint32_t checksum, const uint8_t * pData, size_t len);
+size_t lzs_frame_write_header(uint8_t * pOut, const LzsFrameHeader_t * pHeader);
+bool lzs_frame_read_header(const uint8_t * pIn, size_t inLen, LzsFrameHeader_t * pHeader);
+size_t lzs_frame_write_block_header(uint8_t * pOut, const LzsFrameBlock_t * pBlock);
+bool lzs_frame_read_block_header(const uint8_t * pIn, const LzsFrameHeader_t * pHeader, LzsFrameBlock_t * pBlock);
+size_t lzs_frame_write_footer(uint8_t * pOut, uint32_t blockCount);
+bool lzs_frame_read_footer(const uint8_t * pIn, uint32_t * pBlockCount);
+size_t lzs_frame_compress_block(uint8_t * pOut, size_t outBufferSize, const uint8_t * pIn, size_t inLen,
+                                uint8_t level, uint8_t flags);
+bool lzs_frame_decompress_block(uint8_t * pOut, size_t outBufferSize, const uint8_t * pData,
+                                const LzsFrameBlock_t * pBlock, uint8_t flags);
+
+size_t lzs_checkpoint_write_header(uint8_t * pOut, uint32_t interval);
+bool lzs_checkpoint_read_header(const uint8_t * pIn, size_t inLen, uint32_t * pInterval);
+size_t lzs_checkpoint_write(uint8_t * pOut, const LzsCheckpoint_t * pCheckpoint);
+bool lzs_checkpoint_read(const uint8_t * pIn, LzsCheckpoint_t * pCheckpoint);
 
 
 /*****************************************************************************
@@ -0,0 +1,407 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Unit Tests for Checkpoints in Incremental Decompression
+ *
+ * Data is decompressed incrementally, stopping at random points (many of
+ * them part-way through a match) to save a checkpoint. The checkpoints are
+ * written in the index format and read back. Decompression is resumed from
+ * each one, and must match the original data from there.
+ *
+ * For seeking, checkpoints are saved at a fixed interval. lzs_decompress_seek()
+ * must find the last one at or before each of a range of positions, and
+ * decompression from there must match.
+ *
+ * lzs_checkpoint_read() must reject an unknown state code, and
+ * lzs_decompress_restore_checkpoint() must reject a checkpoint part-way
+ * through a match, if the match offset is beyond its history.
+ *
+ ****************************************************************************/
+
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include "lzs.h"
+#include "test-lzs-data.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>         /* For memcmp() */
+
+
+/*****************************************************************************
+ * Defines
+ ****************************************************************************/
+
+#define MAX_DATA_SIZE               (200u * 1024u)
+#define MAX_CHECKPOINTS             1024u
+
+// Decompressed bytes that are checked after resuming, enough to go past the history
+#define RESUME_CHECK_SIZE           5000u
+
+#define SEEK_INTERVAL               4096u
+
+// Offset of the state code in a checkpoint, and the first code that isn't valid
+#define CHECKPOINT_STATE_OFFSET     18u
+#define NUM_STATE_CODES             9u
+
+#define MIN(X, Y)                   (((X) < (Y)) ? (X) : (Y))
+
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+/*
+ * Decompress all the data, with input in random-sized chunks, saving a
+ * checkpoint each time the output stops. If interval is non-zero, the output
+ * stops at each multiple of it, otherwise at random points.
+ * Returns the number of checkpoints.
+ */
+static size_t save_checkpoints(const uint8_t * pCompressed, size_t compressedLen, size_t len, uint8_t * pOut,
+                               LzsCheckpoint_t * pCheckpoints, size_t interval, uint32_t seed)
+{
+    LzsDecompressParameters_t   params;
+    uint32_t                    state = seed;
+    size_t                      inPos = 0;
+    size_t                      outPos = 0;
+    size_t                      numCheckpoints = 0;
+    size_t                      count;
+
+    lzs_decompress_init(&params);
+    params.inLength = 0;
+    params.outLength = 0;
+    for (;;)
+    {
+        if (params.outLength == 0)
+        {
+            if (numCheckpoints < MAX_CHECKPOINTS)
+            {
+                lzs_decompress_save_checkpoint(&params, inPos - params.inLength, outPos,
+                                               &pCheckpoints[numCheckpoints++]);
+            }
+            if (outPos == len)
+            {
+                break;
+            }
+            if (interval != 0)
+            {
+                count = interval;
+            }
+            else
+            {
+                // Mostly short pieces, so many stop part-way through a match
+                count = 1u + random_next(&state) % ((random_next(&state) % 4u) ? 3000u : 10u);
+            }
+            params.outPtr = pOut + outPos;
+            params.outLength = MIN(count, len - outPos);
+        }
+        if ((params.inLength == 0) && (inPos < compressedLen))
+        {
+            count = MIN(1u + random_next(&state) % 2000u, compressedLen - inPos);
+            params.inPtr = pCompressed + inPos;
+            params.inLength = count;
+            inPos += count;
+        }
+
+        outPos += lzs_decompress_incremental(&params);
+        if ((params.status & LZS_D_STATUS_INPUT_STARVED) && (inPos == compressedLen))
+        {
+            break;
+        }
+    }
+    return (outPos == len) ? numCheckpoints : 0;
+}
+
+/*
+ * Resume decompression after pParams has been restored to outPos, with input
+ * from inPos. Skip skipLen bytes, then check the data. Returns true if it's right.
+ */
+static bool check_resume(LzsDecompressParameters_t * pParams, const uint8_t * pData, size_t len,
+                         const uint8_t * pCompressed, size_t compressedLen, uint8_t * pOut,
+                         size_t inPos, size_t outPos, size_t skipLen)
+{
+    size_t      checkLen;
+    size_t      outCount;
+
+    pParams->inPtr = pCompressed + inPos;
+    pParams->inLength = compressedLen - inPos;
+    if (lzs_decompress_skip(pParams, skipLen) != skipLen)
+    {
+        printf("Skip of %zu bytes after %zu failed\n", skipLen, outPos);
+        return false;
+    }
+    outPos += skipLen;
+    checkLen = MIN(RESUME_CHECK_SIZE, len - outPos);
+    pParams->outPtr = pOut;
+    pParams->outLength = checkLen;
+    outCount = lzs_decompress_incremental(pParams);
+    if ((outCount != checkLen) || (memcmp(pOut, pData + outPos, checkLen) != 0))
+    {
+        printf("Data resumed at %zu is wrong\n", outPos);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Save checkpoints at random points, write them and read them back, then
+ * resume from each one. Returns true if it's all right.
+ */
+static bool test_checkpoints(const uint8_t * pData, size_t len, const uint8_t * pCompressed, size_t compressedLen,
+                             uint8_t * pOut, LzsCheckpoint_t * pSaved, LzsCheckpoint_t * pRead, uint8_t * pIndex,
+                             uint32_t seed)
+{
+    LzsDecompressParameters_t   params;
+    size_t                      numCheckpoints;
+    size_t                      indexLen;
+    size_t                      i;
+    uint32_t                    interval;
+
+    numCheckpoints = save_checkpoints(pCompressed, compressedLen, len, pOut, pSaved, 0, seed);
+    if (numCheckpoints == 0)
+    {
+        printf("Decompression failed\n");
+        return false;
+    }
+
+    indexLen = lzs_checkpoint_write_header(pIndex, 12345u);
+    for (i = 0; i < numCheckpoints; i++)
+    {
+        indexLen += lzs_checkpoint_write(pIndex + indexLen, &pSaved[i]);
+    }
+    if ((indexLen != LZS_CHECKPOINT_HEADER_SIZE + numCheckpoints * LZS_CHECKPOINT_SIZE) ||
+        !lzs_checkpoint_read_header(pIndex, indexLen, &interval) || (interval != 12345u))
+    {
+        printf("Index header is wrong\n");
+        return false;
+    }
+
+    for (i = 0; i < numCheckpoints; i++)
+    {
+        if (!lzs_checkpoint_read(pIndex + LZS_CHECKPOINT_HEADER_SIZE + i * LZS_CHECKPOINT_SIZE, &pRead[i]) ||
+            (pRead[i].outPos != pSaved[i].outPos) || (pRead[i].inPos != pSaved[i].inPos))
+        {
+            printf("Checkpoint %zu read back is wrong\n", i);
+            return false;
+        }
+        if (!lzs_decompress_restore_checkpoint(&params, &pRead[i]))
+        {
+            printf("Checkpoint %zu at %zu isn't valid\n", i, (size_t)pRead[i].outPos);
+            return false;
+        }
+        if (!check_resume(&params, pData, len, pCompressed, compressedLen, pOut,
+                          (size_t)pRead[i].inPos, (size_t)pRead[i].outPos, 0))
+        {
+            return false;
+        }
+    }
+
+    pIndex[LZS_CHECKPOINT_HEADER_SIZE + CHECKPOINT_STATE_OFFSET] = NUM_STATE_CODES;
+    if (lzs_checkpoint_read(pIndex + LZS_CHECKPOINT_HEADER_SIZE, &pRead[0]))
+    {
+        printf("Checkpoint with unknown state code %u was read\n", NUM_STATE_CODES);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Save checkpoints at a fixed interval, then seek to positions around each
+ * one. Returns true if it's all right.
+ */
+static bool test_seek(const uint8_t * pData, size_t len, const uint8_t * pCompressed, size_t compressedLen,
+                      uint8_t * pOut, LzsCheckpoint_t * pCheckpoints, uint32_t seed)
+{
+    static const int            deltas[] = { 0, 1, -1, SEEK_INTERVAL / 2 };
+    LzsDecompressParameters_t   params;
+    const LzsCheckpoint_t     * pFound;
+    uint32_t                    state = seed;
+    size_t                      numCheckpoints;
+    size_t                      target;
+    size_t                      i;
+    size_t                      j;
+
+    numCheckpoints = save_checkpoints(pCompressed, compressedLen, len, pOut, pCheckpoints, SEEK_INTERVAL, seed);
+    for (i = 0; i < numCheckpoints; i++)
+    {
+        if (pCheckpoints[i].outPos != MIN(i * SEEK_INTERVAL, len))
+        {
+            printf("Checkpoint %zu is at %zu\n", i, (size_t)pCheckpoints[i].outPos);
+            return false;
+        }
+    }
+
+    for (i = 0; i <= numCheckpoints; i++)
+    {
+        for (j = 0; j < sizeof(deltas) / sizeof(deltas[0]) + 1u; j++)
+        {
+            if (j < sizeof(deltas) / sizeof(deltas[0]))
+            {
+                target = i * SEEK_INTERVAL + (size_t)deltas[j];
+            }
+            else
+            {
+                target = random_next(&state) % (len + 1u);
+            }
+            if (target >= len)
+            {
+                continue;
+            }
+            pFound = lzs_decompress_seek(&params, pCheckpoints, numCheckpoints, target);
+            if (pFound != &pCheckpoints[target / SEEK_INTERVAL])
+            {
+                printf("Seek to %zu found the wrong checkpoint\n", target);
+                return false;
+            }
+            if (!check_resume(&params, pData, len, pCompressed, compressedLen, pOut,
+                              (size_t)pFound->inPos, (size_t)pFound->outPos, target - (size_t)pFound->outPos))
+            {
+                return false;
+            }
+        }
+    }
+
+    // Before the first checkpoint, or with none, it starts from the beginning of the stream
+    target = MIN(SEEK_INTERVAL / 2u, len);
+    if ((lzs_decompress_seek(&params, pCheckpoints + 1, numCheckpoints - 1u, target) != NULL) ||
+        !check_resume(&params, pData, len, pCompressed, compressedLen, pOut, 0, 0, target) ||
+        (lzs_decompress_seek(&params, pCheckpoints, 0, target) != NULL) ||
+        !check_resume(&params, pData, len, pCompressed, compressedLen, pOut, 0, 0, target))
+    {
+        printf("Seek before the first checkpoint is wrong\n");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Save a checkpoint part-way through a match, then restore it with the
+ * history cut short, and with an offset of 0 (the full history size).
+ * Returns true if those are rejected, and the unchanged one is accepted.
+ */
+static bool test_restore_offset(uint8_t * pOut, LzsCheckpoint_t * pCheckpoint)
+{
+    LzsDecompressParameters_t   params;
+    uint8_t                     data[300];
+    uint8_t                     compressed[LZS_COMPRESSED_MAX(sizeof(data))];
+    size_t                      compressedLen;
+    size_t                      i;
+    bool                        ok = true;
+
+    // Three literals, then a long match with an offset of 3
+    for (i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t)('a' + i % 3u);
+    }
+    compressedLen = lzs_compress(compressed, sizeof(compressed), data, sizeof(data));
+
+    lzs_decompress_init(&params);
+    params.inPtr = compressed;
+    params.inLength = compressedLen;
+    params.outPtr = pOut;
+    params.outLength = 10u;
+    if (lzs_decompress_incremental(&params) != 10u)
+    {
+        printf("Decompression failed\n");
+        return false;
+    }
+    lzs_decompress_save_checkpoint(&params, compressedLen - params.inLength, 10u, pCheckpoint);
+
+    if (!lzs_decompress_restore_checkpoint(&params, pCheckpoint) ||
+        !check_resume(&params, data, sizeof(data), compressed, compressedLen, pOut,
+                      (size_t)pCheckpoint->inPos, 10u, 0))
+    {
+        printf("Checkpoint part-way through a match isn't restored\n");
+        ok = false;
+    }
+
+    // Keep only the latest 2 bytes of history
+    pCheckpoint->history[0] = pCheckpoint->history[8];
+    pCheckpoint->history[1] = pCheckpoint->history[9];
+    pCheckpoint->historyLen = 2u;
+    if (lzs_decompress_restore_checkpoint(&params, pCheckpoint))
+    {
+        printf("Checkpoint with offset beyond its history is accepted\n");
+        ok = false;
+    }
+    pCheckpoint->historyLen = 10u;
+    pCheckpoint->offset = 0;
+    if (lzs_decompress_restore_checkpoint(&params, pCheckpoint))
+    {
+        printf("Checkpoint with offset 0 and a short history is accepted\n");
+        ok = false;
+    }
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t           * pData;
+    uint8_t           * pCompressed;
+    uint8_t           * pOut;
+    uint8_t           * pIndex;
+    LzsCheckpoint_t   * pSaved;
+    LzsCheckpoint_t   * pRead;
+    size_t              compressedLen;
+    int                 type;
+    int                 compressor;
+    unsigned            numTests = 0;
+    unsigned            numFailures = 0;
+    uint32_t            seed = 1u;
+
+    (void)argc;
+    (void)argv;
+    pData = malloc(MAX_DATA_SIZE);
+    pCompressed = malloc(LZS_COMPRESSED_MAX(MAX_DATA_SIZE));
+    pOut = malloc(MAX_DATA_SIZE);
+    pIndex = malloc(LZS_CHECKPOINT_HEADER_SIZE + MAX_CHECKPOINTS * LZS_CHECKPOINT_SIZE);
+    pSaved = malloc(MAX_CHECKPOINTS * sizeof(LzsCheckpoint_t));
+    pRead = malloc(MAX_CHECKPOINTS * sizeof(LzsCheckpoint_t));
+    if ((pData == NULL) || (pCompressed == NULL) || (pOut == NULL) || (pIndex == NULL) ||
+        (pSaved == NULL) || (pRead == NULL))
+    {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    for (type = 0; type < NUM_DATA_TYPES; type++)
+    {
+        make_data(pData, MAX_DATA_SIZE, (DataType_t)type);
+        for (compressor = 0; compressor < NUM_COMPRESSORS; compressor++)
+        {
+            compressedLen = compress_data(pCompressed, LZS_COMPRESSED_MAX(MAX_DATA_SIZE),
+                                          pData, MAX_DATA_SIZE, (Compressor_t)compressor);
+            numTests++;
+            if (!test_checkpoints(pData, MAX_DATA_SIZE, pCompressed, compressedLen, pOut, pSaved, pRead, pIndex,
+                                  seed++))
+            {
+                printf("    for %s data, %s compressor\n", data_type_names[type], compressor_names[compressor]);
+                numFailures++;
+            }
+            numTests++;
+            if (!test_seek(pData, MAX_DATA_SIZE, pCompressed, compressedLen, pOut, pSaved, seed++))
+            {
+                printf("    for seek in %s data, %s compressor\n", data_type_names[type], compressor_names[compressor]);
+                numFailures++;
+            }
+        }
+    }
+    numTests++;
+    if (!test_restore_offset(pOut, pSaved))
+    {
+        numFailures++;
+    }
+    printf("Checkpoints: %u tests, %u failures\n", numTests, numFailures);
+
+    free(pData);
+    free(pCompressed);
+    free(pOut);
+    free(pIndex);
+    free(pSaved);
+    free(pRead);
+    return (numFailures == 0) ? 0 : 1;
+}
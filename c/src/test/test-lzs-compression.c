@@ -0,0 +1,427 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Unit Tests for Compression
+ *
+ * Data of various kinds and sizes is compressed at each compression level, by
+ * lzs_compress_level() and by incremental compression with input and output
+ * in random-sized chunks. It is decompressed by lzs_decompress(), and must
+ * match the original data. The compressed size must not be more than
+ * LZS_COMPRESSED_MAX(), and compressing text at a higher level must not give
+ * bigger output than at the lowest level.
+ *
+ * The same data is compressed by lzs_compress_optimal(), which must round-trip
+ * too. It must not give bigger output than lzs_compress_level() at the
+ * highest level.
+ *
+ * It is also compressed by lzs_compress_hash() with each kind of hash, with
+ * and without a caller-supplied hash table, and must round-trip.
+ *
+ * Then a workspace for lzs_compress_ws(), and an incremental compression
+ * context with lzs_compress_reset(), are each reused for a sequence of data of
+ * different kinds, sizes and levels, long enough for the generation numbers
+ * of the hash tables to wrap around more than once. Each output must be the
+ * same as with newly initialised hash tables.
+ *
+ ****************************************************************************/
+
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include "lzs.h"
+#include "test-lzs-data.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>         /* For memcmp() */
+
+
+/*****************************************************************************
+ * Defines
+ ****************************************************************************/
+
+#define MAX_DATA_SIZE               (200u * 1024u)
+
+// Size of text data for which compression levels are compared
+#define COMPARE_MIN_SIZE            1000u
+
+// Output space that lzs_compress_incremental() needs to add the end marker
+#define END_MARKER_MIN_OUTPUT       3u
+
+// Number of times a workspace or context is reused. This is more than twice
+// the number of hash table generations.
+#define REUSE_COUNT                 40u
+
+#ifndef MIN
+#define MIN(X, Y)                   (((X) < (Y)) ? (X) : (Y))
+#endif
+#ifndef MAX
+#define MAX(X, Y)                   (((X) > (Y)) ? (X) : (Y))
+#endif
+
+
+/*****************************************************************************
+ * Typedefs
+ ****************************************************************************/
+
+typedef struct
+{
+    const char        * pName;
+    uint8_t             hashType;           // LzsHashType_t
+    uint8_t             hashBits;
+} HashConfig_t;
+
+typedef enum
+{
+    MODE_LEVEL,
+    MODE_INCREMENTAL,
+
+    NUM_MODES
+} CompressMode_t;
+
+
+/*****************************************************************************
+ * Tables
+ ****************************************************************************/
+
+static const size_t data_sizes[] =
+{
+    0, 1, 2, 3, 7, 8, 9, 15, 16, 17, 100, 1000,
+    2047, 2048, 2049, 4099, 65536, MAX_DATA_SIZE
+};
+
+static const char * const mode_names[NUM_MODES] =
+{
+    "lzs_compress_level()", "incremental"
+};
+
+// Input and output chunk sizes for incremental compression
+static const size_t chunk_sizes[] =
+{
+    1, 3, 16, 200, 5000
+};
+
+
+static const HashConfig_t hash_configs[] =
+{
+    { "default",                LZS_HASH_DEFAULT, 0 },
+    { "direct",                 LZS_HASH_DIRECT, LZS_HASH_BITS_MAX },
+    { "mult2, minimum bits",    LZS_HASH_MULT2, LZS_HASH_BITS_MIN },
+    { "mult2, 12 bits",         LZS_HASH_MULT2, 12u },
+    { "mult3, minimum bits",    LZS_HASH_MULT3, LZS_HASH_BITS_MIN },
+    { "mult3, maximum bits",    LZS_HASH_MULT3, LZS_HASH_BITS_MAX },
+};
+
+// Hash table for compression with a caller-supplied table, big enough for any hash
+static uint16_t hash_table[LZS_HASH_TABLE_ENTRIES(LZS_HASH_BITS_MAX)];
+
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+static size_t random_chunk(uint32_t * pState)
+{
+    return chunk_sizes[random_next(pState) % (sizeof(chunk_sizes) / sizeof(chunk_sizes[0]))];
+}
+
+/*
+ * Incremental compression, with the input and output given in random-sized chunks
+ */
+static size_t compress_incremental(uint8_t * pOut, size_t outBufferSize, const uint8_t * pIn, size_t len,
+                                   uint8_t level)
+{
+    static LzsCompressParameters_t  params;
+    size_t                          outCount = 0;
+    size_t                          inPos = 0;
+    size_t                          chunk;
+    uint32_t                        state = (uint32_t)len + level;
+
+    lzs_compress_init_level(&params, level);
+    while (inPos < len)
+    {
+        chunk = random_chunk(&state);
+        params.inPtr = pIn + inPos;
+        params.inLength = MIN(chunk, len - inPos);
+        inPos += params.inLength;
+        while ((params.inLength != 0) && (outCount < outBufferSize))
+        {
+            chunk = random_chunk(&state);
+            params.outPtr = pOut + outCount;
+            params.outLength = MIN(chunk, outBufferSize - outCount);
+            outCount += lzs_compress_incremental(&params, false);
+        }
+    }
+    do
+    {
+        chunk = random_chunk(&state);
+        chunk = MAX(chunk, END_MARKER_MIN_OUTPUT);
+        params.outPtr = pOut + outCount;
+        params.outLength = MIN(chunk, outBufferSize - outCount);
+        outCount += lzs_compress_incremental(&params, true);
+    } while (((params.status & LZS_C_STATUS_END_MARKER) == 0) && (outCount < outBufferSize));
+    return outCount;
+}
+
+static size_t compress_mode(uint8_t * pOut, size_t outBufferSize, const uint8_t * pIn, size_t len,
+                            CompressMode_t mode, uint8_t level)
+{
+    switch (mode)
+    {
+        case MODE_LEVEL:
+            return lzs_compress_level(pOut, outBufferSize, pIn, len, level);
+        case MODE_INCREMENTAL:
+            return compress_incremental(pOut, outBufferSize, pIn, len, level);
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Return true if the compressed data decompresses to the original data.
+ */
+static bool check_decompress(const uint8_t * pData, size_t len, const uint8_t * pCompressed, size_t compressedLen,
+                             uint8_t * pOut)
+{
+    size_t      outLength;
+
+    if (compressedLen > LZS_COMPRESSED_MAX(len))
+    {
+        printf("Compressed size %zu is more than LZS_COMPRESSED_MAX()\n", compressedLen);
+        return false;
+    }
+    outLength = lzs_decompress(pOut, len, pCompressed, compressedLen);
+    if ((outLength != len) || (memcmp(pOut, pData, len) != 0))
+    {
+        printf("Decompressed data is wrong (size %zu)\n", outLength);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Incremental compression of all the data in one call
+ */
+static size_t compress_message(LzsCompressParameters_t * pParams, uint8_t * pOut, size_t outBufferSize,
+                               const uint8_t * pIn, size_t len)
+{
+    size_t      outCount = 0;
+
+    pParams->inPtr = pIn;
+    pParams->inLength = len;
+    pParams->outPtr = pOut;
+    pParams->outLength = outBufferSize;
+    do
+    {
+        outCount += lzs_compress_incremental(pParams, true);
+    } while ((pParams->status & LZS_C_STATUS_END_MARKER) == 0);
+    return outCount;
+}
+
+/*
+ * Reuse a workspace, and an incremental compression context, for a sequence
+ * of data. Return true if the output is always the same as with new tables.
+ */
+static bool test_reuse(const HashConfig_t * pConfig, uint8_t * pData, uint8_t * pCompressed, uint8_t * pExpected,
+                       uint8_t * pOut)
+{
+    static LzsCompressParameters_t  params;
+    static LzsCompressParameters_t  newParams;
+    static uint16_t                 paramsHashTable[LZS_HASH_TABLE_ENTRIES(LZS_HASH_BITS_MAX)];
+    void                          * pWorkspace;
+    const uint8_t                 * pIn;
+    size_t                          len;
+    size_t                          compressedLen;
+    size_t                          expectedLen;
+    unsigned                        i;
+    uint8_t                         level;
+    DataType_t                      type;
+    bool                            ok = true;
+
+    pWorkspace = malloc(lzs_compress_workspace_size(pConfig->hashType, pConfig->hashBits));
+    if (pWorkspace == NULL)
+    {
+        printf("Out of memory\n");
+        return false;
+    }
+    lzs_compress_workspace_init(pWorkspace, pConfig->hashType, pConfig->hashBits);
+    for (i = 0; i < REUSE_COUNT; i++)
+    {
+        // Sizes go up and down, so some data is smaller than the data before it
+        len = data_sizes[(i * 7u) % (sizeof(data_sizes) / sizeof(data_sizes[0]))];
+        type = (DataType_t)(i % NUM_DATA_TYPES);
+        level = LZS_COMPRESS_LEVEL_MIN + i % (LZS_COMPRESS_LEVEL_MAX - LZS_COMPRESS_LEVEL_MIN + 1u);
+        // Start i bytes in, so that stale hash table entries don't point at the same data
+        make_data(pData, len + i, type);
+        pIn = pData + i;
+
+        expectedLen = lzs_compress_hash(pExpected, LZS_COMPRESSED_MAX(len), pIn, len,
+                                        level, pConfig->hashType, pConfig->hashBits, hash_table);
+        compressedLen = lzs_compress_ws(pCompressed, LZS_COMPRESSED_MAX(len), pIn, len, level, pWorkspace);
+        if ((compressedLen != expectedLen) || (memcmp(pCompressed, pExpected, expectedLen) != 0))
+        {
+            printf("Output with a reused workspace is different\n");
+            printf("    for %s hash, call %u, %s data of size %zu, level %u\n",
+                   pConfig->pName, i, data_type_names[type], len, level);
+            ok = false;
+        }
+
+        // The context keeps its level, so compare with a new context at the same level
+        lzs_compress_init_hash(&newParams, LZS_COMPRESS_LEVEL_DEFAULT, pConfig->hashType, pConfig->hashBits,
+                               hash_table);
+        expectedLen = compress_message(&newParams, pExpected, LZS_COMPRESSED_MAX(len), pIn, len);
+        if (i == 0)
+        {
+            lzs_compress_init_hash(&params, LZS_COMPRESS_LEVEL_DEFAULT, pConfig->hashType, pConfig->hashBits,
+                                   paramsHashTable);
+        }
+        else
+        {
+            lzs_compress_reset(&params);
+        }
+        compressedLen = compress_message(&params, pCompressed, LZS_COMPRESSED_MAX(len), pIn, len);
+        if ((compressedLen != expectedLen) || (memcmp(pCompressed, pExpected, expectedLen) != 0))
+        {
+            printf("Output after lzs_compress_reset() is different\n");
+            printf("    for %s hash, call %u, %s data of size %zu\n",
+                   pConfig->pName, i, data_type_names[type], len);
+            ok = false;
+        }
+        if (!check_decompress(pIn, len, pCompressed, compressedLen, pOut))
+        {
+            printf("    for %s hash, call %u, %s data of size %zu\n",
+                   pConfig->pName, i, data_type_names[type], len);
+            ok = false;
+        }
+    }
+    free(pWorkspace);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t   * pData;
+    uint8_t   * pCompressed;
+    uint8_t   * pOut;
+    uint8_t   * pExpected;
+    size_t      sizeIdx;
+    size_t      hashIdx;
+    size_t      len;
+    size_t      compressedLen;
+    size_t      level1Len = 0;
+    size_t      levelMaxLen = 0;
+    int         type;
+    int         mode;
+    uint8_t     level;
+    unsigned    numTests = 0;
+    unsigned    numFailures = 0;
+
+    (void)argc;
+    (void)argv;
+    pData = malloc(MAX_DATA_SIZE + REUSE_COUNT);
+    pCompressed = malloc(LZS_COMPRESSED_MAX(MAX_DATA_SIZE));
+    pOut = malloc(MAX_DATA_SIZE);
+    pExpected = malloc(LZS_COMPRESSED_MAX(MAX_DATA_SIZE));
+    if ((pData == NULL) || (pCompressed == NULL) || (pOut == NULL) || (pExpected == NULL))
+    {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    for (type = 0; type < NUM_DATA_TYPES; type++)
+    {
+        for (sizeIdx = 0; sizeIdx < sizeof(data_sizes) / sizeof(data_sizes[0]); sizeIdx++)
+        {
+            len = data_sizes[sizeIdx];
+            make_data(pData, len, (DataType_t)type);
+            for (mode = 0; mode < NUM_MODES; mode++)
+            {
+                for (level = LZS_COMPRESS_LEVEL_MIN; level <= LZS_COMPRESS_LEVEL_MAX; level++)
+                {
+                    numTests++;
+                    compressedLen = compress_mode(pCompressed, LZS_COMPRESSED_MAX(len), pData, len,
+                                                  (CompressMode_t)mode, level);
+                    if (level == LZS_COMPRESS_LEVEL_MIN)
+                    {
+                        level1Len = compressedLen;
+                    }
+                    if ((mode == MODE_LEVEL) && (level == LZS_COMPRESS_LEVEL_MAX))
+                    {
+                        levelMaxLen = compressedLen;
+                    }
+                    if (!check_decompress(pData, len, pCompressed, compressedLen, pOut))
+                    {
+                        printf("    for %s data of size %zu, %s compressor, level %u\n",
+                               data_type_names[type], len, mode_names[mode], level);
+                        numFailures++;
+                    }
+                    else if ((type == DATA_TEXT) && (len >= COMPARE_MIN_SIZE) && (compressedLen > level1Len))
+                    {
+                        printf("Compressed size %zu is bigger than %zu at level %u\n",
+                               compressedLen, level1Len, LZS_COMPRESS_LEVEL_MIN);
+                        printf("    for %s data of size %zu, %s compressor, level %u\n",
+                               data_type_names[type], len, mode_names[mode], level);
+                        numFailures++;
+                    }
+                }
+            }
+
+            numTests++;
+            compressedLen = lzs_compress_optimal(pCompressed, LZS_COMPRESSED_MAX(len), pData, len);
+            if (!check_decompress(pData, len, pCompressed, compressedLen, pOut))
+            {
+                printf("    for %s data of size %zu, optimal compressor\n", data_type_names[type], len);
+                numFailures++;
+            }
+            else if (compressedLen > levelMaxLen)
+            {
+                printf("Compressed size %zu is bigger than %zu at level %u\n",
+                       compressedLen, levelMaxLen, LZS_COMPRESS_LEVEL_MAX);
+                printf("    for %s data of size %zu, optimal compressor\n", data_type_names[type], len);
+                numFailures++;
+            }
+
+            for (hashIdx = 0; hashIdx < sizeof(hash_configs) / sizeof(hash_configs[0]); hashIdx++)
+            {
+                numTests++;
+                compressedLen = lzs_compress_hash(pCompressed, LZS_COMPRESSED_MAX(len), pData, len,
+                                                  LZS_COMPRESS_LEVEL_DEFAULT, hash_configs[hashIdx].hashType,
+                                                  hash_configs[hashIdx].hashBits, hash_table);
+                if (!check_decompress(pData, len, pCompressed, compressedLen, pOut))
+                {
+                    printf("    for %s data of size %zu, %s hash\n",
+                           data_type_names[type], len, hash_configs[hashIdx].pName);
+                    numFailures++;
+                }
+                numTests++;
+                compressedLen = lzs_compress_hash(pCompressed, LZS_COMPRESSED_MAX(len), pData, len,
+                                                  LZS_COMPRESS_LEVEL_DEFAULT, hash_configs[hashIdx].hashType,
+                                                  hash_configs[hashIdx].hashBits, NULL);
+                if (!check_decompress(pData, len, pCompressed, compressedLen, pOut))
+                {
+                    printf("    for %s data of size %zu, %s hash, without a hash table\n",
+                           data_type_names[type], len, hash_configs[hashIdx].pName);
+                    numFailures++;
+                }
+            }
+        }
+    }
+    for (hashIdx = 0; hashIdx < sizeof(hash_configs) / sizeof(hash_configs[0]); hashIdx++)
+    {
+        numTests++;
+        if (!test_reuse(&hash_configs[hashIdx], pData, pCompressed, pExpected, pOut))
+        {
+            numFailures++;
+        }
+    }
+    printf("Compression: %u tests, %u failures\n", numTests, numFailures);
+
+    free(pData);
+    free(pCompressed);
+    free(pOut);
+    free(pExpected);
+    return (numFailures == 0) ? 0 : 1;
+}
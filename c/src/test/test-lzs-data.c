@@ -0,0 +1,136 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Test Data and Compressors Shared by the Unit Tests
+ *
+ ****************************************************************************/
+
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include "test-lzs-data.h"
+
+#include "lzs.h"
+
+#include <string.h>         /* For memset() */
+
+
+/*****************************************************************************
+ * Tables
+ ****************************************************************************/
+
+const char * const data_type_names[NUM_DATA_TYPES] =
+{
+    "random", "random with repeats", "text", "zeros", "text then random", "random then text"
+};
+
+const char * const compressor_names[NUM_COMPRESSORS] =
+{
+    "level 1", "default", "level 9", "simple", "optimal"
+};
+
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+uint32_t random_next(uint32_t * pState)
+{
+    *pState = *pState * 1103515245u + 12345u;
+    return *pState >> 16u;
+}
+
+void make_text(uint8_t * pData, size_t len, uint32_t * pState)
+{
+    static const char * const words[] =
+    {
+        "the ", "quick ", "brown ", "fox ", "jumps ", "over ", "lazy ", "dog, ", "and ", "then\n"
+    };
+    const char * pWord;
+    size_t      i = 0;
+
+    while (i < len)
+    {
+        pWord = words[random_next(pState) % (sizeof(words) / sizeof(words[0]))];
+        while ((*pWord != '\0') && (i < len))
+        {
+            pData[i++] = *pWord++;
+        }
+    }
+}
+
+void make_data(uint8_t * pData, size_t len, DataType_t type)
+{
+    uint32_t    state = 1u;
+    size_t      half = len / 2u;
+    size_t      i;
+
+    switch (type)
+    {
+        case DATA_RANDOM:
+            for (i = 0; i < len; i++)
+            {
+                pData[i] = (uint8_t)random_next(&state);
+            }
+            break;
+        case DATA_RANDOM_REPEATS:
+            // Now and then, repeat a few bytes from a short distance back
+            for (i = 0; i < len; i++)
+            {
+                if ((i >= 8u) && (random_next(&state) % 32u == 0))
+                {
+                    pData[i] = pData[i - 1u - random_next(&state) % 8u];
+                }
+                else
+                {
+                    pData[i] = (uint8_t)random_next(&state);
+                }
+            }
+            break;
+        case DATA_TEXT:
+            make_text(pData, len, &state);
+            break;
+        case DATA_ZEROS:
+            memset(pData, 0, len);
+            break;
+        case DATA_TEXT_THEN_RANDOM:
+            make_text(pData, half, &state);
+            for (i = half; i < len; i++)
+            {
+                pData[i] = (uint8_t)random_next(&state);
+            }
+            break;
+        case DATA_RANDOM_THEN_TEXT:
+            for (i = 0; i < half; i++)
+            {
+                pData[i] = (uint8_t)random_next(&state);
+            }
+            make_text(pData + half, len - half, &state);
+            break;
+        default:
+            break;
+    }
+}
+
+size_t compress_data(uint8_t * pOut, size_t outBufferSize, const uint8_t * pIn, size_t len,
+                     Compressor_t compressor)
+{
+    switch (compressor)
+    {
+        case COMPRESSOR_LEVEL_1:
+            return lzs_compress_level(pOut, outBufferSize, pIn, len, 1u);
+        case COMPRESSOR_DEFAULT:
+            return lzs_compress(pOut, outBufferSize, pIn, len);
+        case COMPRESSOR_LEVEL_9:
+            return lzs_compress_level(pOut, outBufferSize, pIn, len, 9u);
+        case COMPRESSOR_SIMPLE:
+            return lzs_simple_compress(pOut, outBufferSize, pIn, len);
+        case COMPRESSOR_OPTIMAL:
+            return lzs_compress_optimal(pOut, outBufferSize, pIn, len);
+        default:
+            return 0;
+    }
+}
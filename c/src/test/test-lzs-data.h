@@ -0,0 +1,89 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Test Data and Compressors Shared by the Unit Tests
+ *
+ * Each kind of test data is generated the same way for every test, from a
+ * fixed seed, so a failure can be reproduced. The compressors are the
+ * library's single-call ones.
+ *
+ ****************************************************************************/
+
+#ifndef __TEST_LZS_DATA_H
+#define __TEST_LZS_DATA_H
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*****************************************************************************
+ * Typedefs
+ ****************************************************************************/
+
+typedef enum
+{
+    DATA_RANDOM,
+    DATA_RANDOM_REPEATS,
+    DATA_TEXT,
+    DATA_ZEROS,
+    DATA_TEXT_THEN_RANDOM,
+    DATA_RANDOM_THEN_TEXT,
+
+    NUM_DATA_TYPES
+} DataType_t;
+
+typedef enum
+{
+    COMPRESSOR_LEVEL_1,
+    COMPRESSOR_DEFAULT,
+    COMPRESSOR_LEVEL_9,
+    COMPRESSOR_SIMPLE,
+    COMPRESSOR_OPTIMAL,
+
+    NUM_COMPRESSORS
+} Compressor_t;
+
+
+/*****************************************************************************
+ * Tables
+ ****************************************************************************/
+
+extern const char * const data_type_names[NUM_DATA_TYPES];
+
+extern const char * const compressor_names[NUM_COMPRESSORS];
+
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+/*
+ * Return the next pseudo-random number from a simple linear congruential
+ * generator, 15 bits.
+ */
+uint32_t random_next(uint32_t * pState);
+
+/*
+ * Fill the data with random words of text.
+ */
+void make_text(uint8_t * pData, size_t len, uint32_t * pState);
+
+/*
+ * Fill the data with the given type of test data.
+ */
+void make_data(uint8_t * pData, size_t len, DataType_t type);
+
+/*
+ * Compress the data in a single call, with the given compressor. Returns the
+ * compressed length.
+ */
+size_t compress_data(uint8_t * pOut, size_t outBufferSize, const uint8_t * pIn, size_t len,
+                     Compressor_t compressor);
+
+
+#endif // !defined(__TEST_LZS_DATA_H)
@@ -17,6 +17,18 @@
 #include <string.h>         /* For memset() */
 
 
+/*****************************************************************************
+ * Typedefs
+ ****************************************************************************/
+
+// For building small compressed streams bit by bit
+typedef struct
+{
+    uint8_t           * pOut;
+    size_t              bitLen;
+} BitWriter_t;
+
+
 /*****************************************************************************
  * Tables
  ****************************************************************************/
@@ -82,20 +94,143 @@ static const uint8_t compressed_data[] =
  * Functions
  ****************************************************************************/
 
-static void test_decompress_1(const uint8_t * p_compressed_data, size_t len)
+static void put_bits(BitWriter_t * pWriter, uint32_t value, unsigned width)
+{
+    while (width != 0)
+    {
+        width--;
+        if (pWriter->bitLen % 8u == 0)
+        {
+            pWriter->pOut[pWriter->bitLen / 8u] = 0;
+        }
+        if (value & (1u << width))
+        {
+            pWriter->pOut[pWriter->bitLen / 8u] |= (uint8_t)(0x80u >> (pWriter->bitLen % 8u));
+        }
+        pWriter->bitLen++;
+    }
+}
+
+static void put_literal(BitWriter_t * pWriter, uint8_t value)
+{
+    put_bits(pWriter, 0, 1u);
+    put_bits(pWriter, value, 8u);
+}
+
+// Short offset (1 to 127), and a length of 2
+static void put_short_match_2(BitWriter_t * pWriter, unsigned offset)
+{
+    put_bits(pWriter, 0x3u, 2u);
+    put_bits(pWriter, offset, 7u);
+    put_bits(pWriter, 0, 2u);
+}
+
+static void put_end_marker(BitWriter_t * pWriter)
+{
+    put_bits(pWriter, 0x180u, 9u);
+}
+
+/*
+ * Check lzs_decompressed_size() against lzs_decompress(), for its size and status.
+ * Return true if both are as expected.
+ */
+static bool check_decompressed_size(const char * pName, const uint8_t * p_compressed_data, size_t len,
+                                    size_t expected_length, uint8_t expected_status)
+{
+    uint8_t out_buffer[1000];
+    size_t  out_length;
+    size_t  size;
+    uint8_t status;
+
+
+    size = lzs_decompressed_size(p_compressed_data, len, &status);
+    out_length = lzs_decompress(out_buffer, sizeof(out_buffer), p_compressed_data, len);
+    if ((size != out_length) || (size != expected_length) || (status != expected_status))
+    {
+        printf("%s: decompressed size %zu, status %02X; expected %zu, status %02X; lzs_decompress() gives %zu\n",
+               pName, size, status, expected_length, expected_status, out_length);
+        return false;
+    }
+    return true;
+}
+
+static bool test_decompress_1(const uint8_t * p_compressed_data, size_t len)
 {
     uint8_t out_buffer[1000];
     size_t  out_length;
+    size_t  size;
+    uint8_t status;
 
 
     memset(out_buffer, 'A', sizeof(out_buffer));
 
+    size = lzs_decompressed_size(p_compressed_data, len, &status);
+    printf("Decompressed size %zu, status %02X\n", size, status);
+
     // out buffer length is '-1' to allow for string zero termination
     out_length = lzs_decompress(out_buffer, sizeof(out_buffer) - 1, p_compressed_data, len);
 
     // Add string zero termination
     out_buffer[out_length] = 0;
     printf("Decompressed data:\n%s\n", out_buffer);
+
+    if ((size != out_length) || (status != LZS_D_STATUS_END_MARKER))
+    {
+        printf("Decompressed size %zu doesn't match lzs_decompress() size %zu, or status is wrong\n",
+               size, out_length);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Check the status from lzs_decompressed_size() for streams that end early,
+ * have no end marker, or refer to data before the start.
+ */
+static bool test_decompressed_size_status(void)
+{
+    uint8_t     stream[32];
+    BitWriter_t writer;
+    unsigned    i;
+    bool        ok = true;
+
+
+    // Truncated part-way through the second literal
+    writer.pOut = stream;
+    writer.bitLen = 0;
+    put_literal(&writer, 'A');
+    put_literal(&writer, 'B');
+    ok &= check_decompressed_size("Truncated", stream, 2u, 1u,
+                                  LZS_D_STATUS_INPUT_STARVED | LZS_D_STATUS_INPUT_FINISHED);
+
+    // Eight literals fill exactly 9 bytes, and there's no end marker
+    writer.bitLen = 0;
+    for (i = 0; i < 8u; i++)
+    {
+        put_literal(&writer, (uint8_t)('a' + i));
+    }
+    ok &= check_decompressed_size("No end marker", stream, writer.bitLen / 8u, 8u, LZS_D_STATUS_INPUT_FINISHED);
+
+    // A match whose offset is before the start of the data
+    writer.bitLen = 0;
+    put_literal(&writer, 'A');
+    put_short_match_2(&writer, 5u);
+    put_end_marker(&writer);
+    ok &= check_decompressed_size("Offset out of history", stream, (writer.bitLen + 7u) / 8u, 3u,
+                                  LZS_D_STATUS_ERROR | LZS_D_STATUS_END_MARKER);
+
+    // The same match, within history
+    writer.bitLen = 0;
+    for (i = 0; i < 5u; i++)
+    {
+        put_literal(&writer, (uint8_t)('a' + i));
+    }
+    put_short_match_2(&writer, 5u);
+    put_end_marker(&writer);
+    ok &= check_decompressed_size("Offset in history", stream, (writer.bitLen + 7u) / 8u, 7u,
+                                  LZS_D_STATUS_END_MARKER);
+
+    return ok;
 }
 
 static void test_decompress_incremental_all(const uint8_t * p_compressed_data, size_t len)
@@ -225,12 +360,16 @@ int main(int argc, char **argv)
 {
     const uint8_t * p_compressed_data = "";
     size_t len = 0;
+    unsigned numFailures = 0;
     
     p_compressed_data = compressed_data;
     len = sizeof(compressed_data);
     
 #if 1
-    test_decompress_1(p_compressed_data, len);
+    if (!test_decompress_1(p_compressed_data, len))
+    {
+        numFailures++;
+    }
 #elif 1
     test_decompress_incremental_all(p_compressed_data, len);
 #elif 1
@@ -239,5 +378,10 @@ int main(int argc, char **argv)
     test_decompress_incremental_output_bounded(p_compressed_data, len);
 #endif
 
-    return 0;
+    if (!test_decompressed_size_status())
+    {
+        numFailures++;
+    }
+
+    return (numFailures == 0) ? 0 : 1;
 }
@@ -0,0 +1,299 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Unit Tests for Compression Dictionaries
+ *
+ * A dictionary is set for incremental compression, then saved, and loaded
+ * into another compression context for each of several small messages. The
+ * output must be the same as with the dictionary set directly, and must
+ * decompress with the dictionary set for decompression. This is done for
+ * each kind of hash, including caller-supplied hash tables.
+ *
+ * The saved dictionary must be little-endian, and a dictionary that is
+ * truncated, corrupted, for a different hash, or with hash entries outside
+ * the dictionary must be rejected, leaving the context to compress without
+ * a dictionary.
+ *
+ ****************************************************************************/
+
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include "lzs.h"
+#include "test-lzs-data.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>         /* For memcmp() */
+
+
+/*****************************************************************************
+ * Defines
+ ****************************************************************************/
+
+#define DICT_SIZE                   2000u
+#define MAX_MESSAGE_SIZE            600u
+#define NUM_MESSAGES                20u
+
+// Offset and size of the dictionary length in a saved dictionary
+#define SAVED_DICT_LEN_OFFSET       4u
+
+// Offsets of the hash chain entries, then the hash table entries, in a saved dictionary
+#define SAVED_DICT_CHAIN_OFFSET     8u
+#define SAVED_DICT_TABLE_OFFSET     (SAVED_DICT_CHAIN_OFFSET + DICT_SIZE * 2u)
+
+// Position of the hash chain entry that is corrupted
+#define CORRUPT_CHAIN_POS           100u
+
+
+/*****************************************************************************
+ * Typedefs
+ ****************************************************************************/
+
+typedef struct
+{
+    const char        * pName;
+    uint8_t             hashType;           // LzsHashType_t
+    uint8_t             hashBits;
+    bool                ownTable;           // Use a caller-supplied hash table
+} HashConfig_t;
+
+
+/*****************************************************************************
+ * Tables
+ ****************************************************************************/
+
+static const HashConfig_t hash_configs[] =
+{
+    { "default level",          0, 0, false },
+    { "direct",                 LZS_HASH_DIRECT, LZS_HASH_BITS_MAX, true },
+    { "mult2, 10 bits",         LZS_HASH_MULT2, 10u, true },
+    { "mult3, 12 bits",         LZS_HASH_MULT3, 12u, true },
+};
+
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+static void init_compress(LzsCompressParameters_t * pParams, const HashConfig_t * pConfig, uint16_t * pHashTable)
+{
+    if (pConfig->ownTable)
+    {
+        lzs_compress_init_hash(pParams, LZS_COMPRESS_LEVEL_DEFAULT, pConfig->hashType, pConfig->hashBits, pHashTable);
+    }
+    else
+    {
+        lzs_compress_init_level(pParams, LZS_COMPRESS_LEVEL_DEFAULT);
+    }
+}
+
+static size_t compress_message(LzsCompressParameters_t * pParams, const uint8_t * pIn, size_t len,
+                               uint8_t * pOut, size_t outBufferSize)
+{
+    size_t      outCount = 0;
+
+    pParams->inPtr = pIn;
+    pParams->inLength = len;
+    pParams->outPtr = pOut;
+    pParams->outLength = outBufferSize;
+    do
+    {
+        outCount += lzs_compress_incremental(pParams, true);
+    } while ((pParams->status & LZS_C_STATUS_END_MARKER) == 0);
+    return outCount;
+}
+
+/*
+ * Decompress with the dictionary, and return true if it gives the message.
+ */
+static bool check_decompress(const uint8_t * pDict, size_t dictLen, const uint8_t * pCompressed,
+                             size_t compressedLen, const uint8_t * pMessage, size_t len)
+{
+    static LzsDecompressParameters_t    params;
+    uint8_t                             out[MAX_MESSAGE_SIZE];
+    size_t                              outCount;
+
+    lzs_decompress_init(&params);
+    lzs_decompress_set_dictionary(&params, pDict, dictLen);
+    params.inPtr = pCompressed;
+    params.inLength = compressedLen;
+    params.outPtr = out;
+    params.outLength = sizeof(out);
+    outCount = lzs_decompress_incremental(&params);
+    return (outCount == len) && (memcmp(out, pMessage, len) == 0);
+}
+
+/*
+ * Return true if loading the saved dictionary fails, and leaves the context
+ * compressing the message as it would without a dictionary.
+ */
+static bool check_rejected(LzsCompressParameters_t * pParams, const uint8_t * pSaved, size_t savedLen,
+                           const uint8_t * pMessage, size_t len, const uint8_t * pPlain, size_t plainLen)
+{
+    uint8_t     compressed[LZS_COMPRESSED_MAX(MAX_MESSAGE_SIZE)];
+    size_t      compressedLen;
+
+    if (lzs_compress_load_dictionary(pParams, pSaved, savedLen))
+    {
+        return false;
+    }
+    compressedLen = compress_message(pParams, pMessage, len, compressed, sizeof(compressed));
+    return (compressedLen == plainLen) && (memcmp(compressed, pPlain, plainLen) == 0);
+}
+
+static bool test_dictionary(const HashConfig_t * pConfig, const uint8_t * pDict, const uint8_t * pMessages,
+                            uint8_t * pSaved, size_t savedBufferSize)
+{
+    static LzsCompressParameters_t  setParams;
+    static LzsCompressParameters_t  loadParams;
+    static uint16_t                 setHashTable[LZS_HASH_TABLE_ENTRIES(LZS_HASH_BITS_MAX)];
+    static uint16_t                 loadHashTable[LZS_HASH_TABLE_ENTRIES(LZS_HASH_BITS_MAX)];
+    uint8_t                         expected[LZS_COMPRESSED_MAX(MAX_MESSAGE_SIZE)];
+    uint8_t                         compressed[LZS_COMPRESSED_MAX(MAX_MESSAGE_SIZE)];
+    uint8_t                         saved;
+    uint8_t                         savedEntry[2];
+    uint8_t                       * pEntry;
+    size_t                          savedLen;
+    size_t                          expectedLen;
+    size_t                          compressedLen;
+    size_t                          len;
+    unsigned                        i;
+    bool                            ok = true;
+
+    init_compress(&setParams, pConfig, setHashTable);
+    lzs_compress_set_dictionary(&setParams, pDict, DICT_SIZE);
+    savedLen = lzs_compress_save_dictionary(&setParams, pSaved, savedBufferSize);
+    if ((savedLen == 0) || (savedLen != lzs_compress_dictionary_size(&setParams)))
+    {
+        printf("%s: dictionary isn't saved\n", pConfig->pName);
+        return false;
+    }
+    if ((memcmp(pSaved, "LZD1", 4u) != 0) ||
+        (pSaved[SAVED_DICT_LEN_OFFSET] != (uint8_t)DICT_SIZE) ||
+        (pSaved[SAVED_DICT_LEN_OFFSET + 1u] != (uint8_t)(DICT_SIZE >> 8u)))
+    {
+        printf("%s: saved dictionary header isn't little-endian\n", pConfig->pName);
+        return false;
+    }
+    if (lzs_compress_save_dictionary(&setParams, pSaved, savedLen - 1u) != 0)
+    {
+        printf("%s: dictionary is saved to a buffer that is too small\n", pConfig->pName);
+        ok = false;
+    }
+
+    // Load the same saved dictionary for each message
+    init_compress(&loadParams, pConfig, loadHashTable);
+    for (i = 0; i < NUM_MESSAGES; i++)
+    {
+        len = 1u + (i * 97u) % MAX_MESSAGE_SIZE;
+        init_compress(&setParams, pConfig, setHashTable);
+        lzs_compress_set_dictionary(&setParams, pDict, DICT_SIZE);
+        expectedLen = compress_message(&setParams, pMessages + i * MAX_MESSAGE_SIZE, len,
+                                       expected, sizeof(expected));
+
+        if (!lzs_compress_load_dictionary(&loadParams, pSaved, savedLen))
+        {
+            printf("%s: saved dictionary isn't loaded\n", pConfig->pName);
+            return false;
+        }
+        compressedLen = compress_message(&loadParams, pMessages + i * MAX_MESSAGE_SIZE, len,
+                                         compressed, sizeof(compressed));
+        if ((compressedLen != expectedLen) || (memcmp(compressed, expected, expectedLen) != 0))
+        {
+            printf("%s: message %u compresses differently with the loaded dictionary\n", pConfig->pName, i);
+            ok = false;
+        }
+        if (!check_decompress(pDict, DICT_SIZE, compressed, compressedLen, pMessages + i * MAX_MESSAGE_SIZE, len))
+        {
+            printf("%s: message %u doesn't decompress\n", pConfig->pName, i);
+            ok = false;
+        }
+    }
+
+    // Without a dictionary, for comparison
+    len = MAX_MESSAGE_SIZE;
+    init_compress(&setParams, pConfig, setHashTable);
+    expectedLen = compress_message(&setParams, pMessages, len, expected, sizeof(expected));
+
+    if (!check_rejected(&loadParams, pSaved, savedLen - 1u, pMessages, len, expected, expectedLen))
+    {
+        printf("%s: truncated dictionary isn't rejected\n", pConfig->pName);
+        ok = false;
+    }
+    for (i = 0; i < 8u; i++)
+    {
+        // Magic, dictionary length, hash type or hash bits
+        saved = pSaved[i];
+        pSaved[i] ^= (i == SAVED_DICT_LEN_OFFSET + 1u) ? 0x40u : 0x01u;
+        if (!check_rejected(&loadParams, pSaved, savedLen, pMessages, len, expected, expectedLen))
+        {
+            printf("%s: dictionary with byte %u corrupted isn't rejected\n", pConfig->pName, i);
+            ok = false;
+        }
+        pSaved[i] = saved;
+    }
+
+    // A hash chain entry that isn't before its own position, and a hash table
+    // entry past the end of the dictionary
+    for (i = 0; i < 2u; i++)
+    {
+        pEntry = pSaved + ((i == 0) ? SAVED_DICT_CHAIN_OFFSET + CORRUPT_CHAIN_POS * 2u : SAVED_DICT_TABLE_OFFSET);
+        memcpy(savedEntry, pEntry, sizeof(savedEntry));
+        pEntry[0] = (uint8_t)((i == 0) ? CORRUPT_CHAIN_POS : DICT_SIZE);
+        pEntry[1] = (uint8_t)(((i == 0) ? CORRUPT_CHAIN_POS : DICT_SIZE) >> 8u);
+        if (!check_rejected(&loadParams, pSaved, savedLen, pMessages, len, expected, expectedLen))
+        {
+            printf("%s: dictionary with %s entry outside the dictionary isn't rejected\n", pConfig->pName,
+                   (i == 0) ? "a hash chain" : "a hash table");
+            ok = false;
+        }
+        memcpy(pEntry, savedEntry, sizeof(savedEntry));
+    }
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t   * pDict;
+    uint8_t   * pMessages;
+    uint8_t   * pSaved;
+    size_t      savedBufferSize;
+    size_t      i;
+    unsigned    numTests = 0;
+    unsigned    numFailures = 0;
+    uint32_t    state = 1u;
+
+    (void)argc;
+    (void)argv;
+    savedBufferSize = 16u + 3u * DICT_SIZE + LZS_HASH_TABLE_ENTRIES(LZS_HASH_BITS_MAX) * sizeof(uint16_t);
+    pDict = malloc(DICT_SIZE);
+    pMessages = malloc(NUM_MESSAGES * MAX_MESSAGE_SIZE);
+    pSaved = malloc(savedBufferSize);
+    if ((pDict == NULL) || (pMessages == NULL) || (pSaved == NULL))
+    {
+        printf("Out of memory\n");
+        return 1;
+    }
+    // Messages are made of the same words as the dictionary
+    make_text(pDict, DICT_SIZE, &state);
+    make_text(pMessages, NUM_MESSAGES * MAX_MESSAGE_SIZE, &state);
+
+    for (i = 0; i < sizeof(hash_configs) / sizeof(hash_configs[0]); i++)
+    {
+        numTests++;
+        if (!test_dictionary(&hash_configs[i], pDict, pMessages, pSaved, savedBufferSize))
+        {
+            numFailures++;
+        }
+    }
+    printf("Dictionaries: %u tests, %u failures\n", numTests, numFailures);
+
+    free(pDict);
+    free(pMessages);
+    free(pSaved);
+    return (numFailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,425 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Unit Tests for the Framed Container
+ *
+ * Data of various kinds and sizes is written as framed data, with and without
+ * checksums, then read back both by streaming through the blocks and by
+ * random access through the index.
+ *
+ * Frame headers, block headers and footers that are truncated or corrupted
+ * must be rejected, as must block lengths that don't match the data, and
+ * block data with bytes after the end marker.
+ *
+ ****************************************************************************/
+
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include "lzs.h"
+#include "test-lzs-data.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>         /* For memcmp() */
+
+
+/*****************************************************************************
+ * Defines
+ ****************************************************************************/
+
+#define MAX_DATA_SIZE               (200u * 1024u)
+#define MIN_BLOCK_SIZE              4096u
+#define MAX_BLOCKS                  ((MAX_DATA_SIZE + MIN_BLOCK_SIZE - 1u) / MIN_BLOCK_SIZE)
+#define MAX_FRAME_SIZE              (LZS_FRAME_HEADER_SIZE + MAX_BLOCKS * LZS_FRAME_BLOCK_MAX(MIN_BLOCK_SIZE) + \
+                                     (1u + MAX_BLOCKS) * LZS_FRAME_BLOCK_HEADER_SIZE + LZS_FRAME_FOOTER_SIZE)
+
+#define MIN(X, Y)                   (((X) < (Y)) ? (X) : (Y))
+
+
+/*****************************************************************************
+ * Tables
+ ****************************************************************************/
+
+static const size_t data_sizes[] =
+{
+    0, 1, 100, MIN_BLOCK_SIZE - 1u, MIN_BLOCK_SIZE, MIN_BLOCK_SIZE + 1u, 65536, MAX_DATA_SIZE
+};
+
+static const uint32_t block_sizes[] =
+{
+    MIN_BLOCK_SIZE, 65536, LZS_FRAME_BLOCK_SIZE_DEFAULT
+};
+
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+/*
+ * Write framed data, and return its size
+ */
+static size_t write_frame(uint8_t * pFrame, const uint8_t * pData, size_t len, const LzsFrameHeader_t * pHeader,
+                          LzsFrameBlock_t * pBlocks, uint32_t * pBlockCount)
+{
+    LzsFrameBlock_t     endBlock;
+    size_t              frameLen;
+    size_t              pos;
+    size_t              blockLen;
+    uint32_t            i;
+
+    frameLen = lzs_frame_write_header(pFrame, pHeader);
+    *pBlockCount = 0;
+    for (pos = 0; pos < len; pos += blockLen)
+    {
+        blockLen = MIN(pHeader->blockSize, len - pos);
+        frameLen += lzs_frame_compress_block(pFrame + frameLen, LZS_FRAME_BLOCK_MAX(blockLen), pData + pos, blockLen,
+                                             LZS_COMPRESS_LEVEL_DEFAULT, pHeader->flags);
+        (*pBlockCount)++;
+    }
+
+    // Fill in the block headers from what was written, for the index
+    pos = LZS_FRAME_HEADER_SIZE;
+    for (i = 0; i < *pBlockCount; i++)
+    {
+        lzs_frame_read_block_header(pFrame + pos, pHeader, &pBlocks[i]);
+        pos += LZS_FRAME_BLOCK_HEADER_SIZE + pBlocks[i].compressedLen;
+    }
+
+    memset(&endBlock, 0, sizeof(endBlock));
+    frameLen += lzs_frame_write_block_header(pFrame + frameLen, &endBlock);
+    for (i = 0; i < *pBlockCount; i++)
+    {
+        frameLen += lzs_frame_write_block_header(pFrame + frameLen, &pBlocks[i]);
+    }
+    frameLen += lzs_frame_write_footer(pFrame + frameLen, *pBlockCount);
+    return frameLen;
+}
+
+/*
+ * Write framed data, then read it back by streaming and through the index.
+ * Return true if it's right.
+ */
+static bool test_frame(const uint8_t * pData, size_t len, uint32_t blockSize, uint8_t flags,
+                       uint8_t * pFrame, uint8_t * pOut, LzsFrameBlock_t * pBlocks)
+{
+    LzsFrameHeader_t    header;
+    LzsFrameHeader_t    readHeader;
+    LzsFrameBlock_t     block;
+    size_t              frameLen;
+    size_t              pos;
+    size_t              outPos;
+    size_t              indexPos;
+    uint32_t            blockCount;
+    uint32_t            readBlockCount;
+    uint32_t            i;
+
+    header.blockSize = blockSize;
+    header.flags = flags;
+    frameLen = write_frame(pFrame, pData, len, &header, pBlocks, &blockCount);
+
+    if (!lzs_frame_read_header(pFrame, frameLen, &readHeader) ||
+        (readHeader.blockSize != blockSize) || (readHeader.flags != flags))
+    {
+        printf("Frame header is wrong\n");
+        return false;
+    }
+
+    // Stream through the blocks
+    pos = LZS_FRAME_HEADER_SIZE;
+    outPos = 0;
+    while (lzs_frame_read_block_header(pFrame + pos, &readHeader, &block))
+    {
+        pos += LZS_FRAME_BLOCK_HEADER_SIZE;
+        if (!lzs_frame_decompress_block(pOut + outPos, len - outPos, pFrame + pos, &block, readHeader.flags))
+        {
+            printf("Block at %zu doesn't decompress\n", outPos);
+            return false;
+        }
+        pos += block.compressedLen;
+        outPos += block.rawLen;
+    }
+    if ((block.compressedLen != 0) || (block.rawLen != 0) || (block.checksum != 0) ||
+        (outPos != len) || (memcmp(pOut, pData, len) != 0))
+    {
+        printf("Streamed data is wrong (size %zu)\n", outPos);
+        return false;
+    }
+    pos += LZS_FRAME_BLOCK_HEADER_SIZE;
+
+    // Random access, through the index, last block first
+    if (!lzs_frame_read_footer(pFrame + frameLen - LZS_FRAME_FOOTER_SIZE, &readBlockCount) ||
+        (readBlockCount != blockCount) ||
+        (frameLen - LZS_FRAME_FOOTER_SIZE - (size_t)readBlockCount * LZS_FRAME_BLOCK_HEADER_SIZE != pos))
+    {
+        printf("Footer is wrong\n");
+        return false;
+    }
+    memset(pOut, 0, len);
+    for (i = readBlockCount; i-- > 0; )
+    {
+        pos = LZS_FRAME_HEADER_SIZE;
+        outPos = 0;
+        for (indexPos = 0; indexPos < i; indexPos++)
+        {
+            pos += LZS_FRAME_BLOCK_HEADER_SIZE + pBlocks[indexPos].compressedLen;
+            outPos += pBlocks[indexPos].rawLen;
+        }
+        if (!lzs_frame_read_block_header(pFrame + frameLen - LZS_FRAME_FOOTER_SIZE -
+                                         (size_t)(readBlockCount - i) * LZS_FRAME_BLOCK_HEADER_SIZE,
+                                         &readHeader, &block) ||
+            (memcmp(&block, &pBlocks[i], sizeof(block)) != 0) ||
+            !lzs_frame_decompress_block(pOut + outPos, len - outPos, pFrame + pos + LZS_FRAME_BLOCK_HEADER_SIZE,
+                                        &block, readHeader.flags))
+        {
+            printf("Block %u from the index doesn't decompress\n", i);
+            return false;
+        }
+    }
+    if (memcmp(pOut, pData, len) != 0)
+    {
+        printf("Data read through the index is wrong\n");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Check that truncated or corrupted headers, footers and block lengths are
+ * rejected. Return true if they all are.
+ */
+static bool test_frame_errors(const uint8_t * pData, size_t len, uint8_t flags, uint8_t * pFrame, uint8_t * pOut,
+                              LzsFrameBlock_t * pBlocks)
+{
+    LzsFrameHeader_t    header;
+    LzsFrameHeader_t    readHeader;
+    LzsFrameBlock_t     block;
+    uint8_t             saved;
+    uint32_t            blockCount;
+    size_t              frameLen;
+    size_t              i;
+    bool                ok = true;
+
+    header.blockSize = 65536u;
+    header.flags = flags;
+    frameLen = write_frame(pFrame, pData, len, &header, pBlocks, &blockCount);
+
+    // Frame header
+    for (i = 0; i < LZS_FRAME_HEADER_SIZE; i++)
+    {
+        if (lzs_frame_read_header(pFrame, i, &readHeader))
+        {
+            printf("Frame header truncated to %zu bytes is accepted\n", i);
+            ok = false;
+        }
+    }
+    for (i = 0; i < 8u; i++)
+    {
+        // Magic, version, unknown flag or reserved bytes
+        saved = pFrame[i];
+        pFrame[i] ^= 0x80u;
+        if (lzs_frame_read_header(pFrame, frameLen, &readHeader))
+        {
+            printf("Frame header with byte %zu corrupted is accepted\n", i);
+            ok = false;
+        }
+        pFrame[i] = saved;
+    }
+    header.blockSize = 0;
+    lzs_frame_write_header(pFrame, &header);
+    if (lzs_frame_read_header(pFrame, frameLen, &readHeader))
+    {
+        printf("Frame header with block size 0 is accepted\n");
+        ok = false;
+    }
+    header.blockSize = LZS_FRAME_BLOCK_SIZE_MAX + 1u;
+    lzs_frame_write_header(pFrame, &header);
+    if (lzs_frame_read_header(pFrame, frameLen, &readHeader))
+    {
+        printf("Frame header with block size too big is accepted\n");
+        ok = false;
+    }
+    header.blockSize = 65536u;
+    lzs_frame_write_header(pFrame, &header);
+
+    // Block header lengths that are out of range for the frame
+    block = pBlocks[0];
+    block.rawLen = 0;
+    lzs_frame_write_block_header(pFrame + LZS_FRAME_HEADER_SIZE, &block);
+    if (lzs_frame_read_block_header(pFrame + LZS_FRAME_HEADER_SIZE, &header, &block))
+    {
+        printf("Raw length 0 is accepted\n");
+        ok = false;
+    }
+    block = pBlocks[0];
+    block.rawLen = header.blockSize + 1u;
+    lzs_frame_write_block_header(pFrame + LZS_FRAME_HEADER_SIZE, &block);
+    if (lzs_frame_read_block_header(pFrame + LZS_FRAME_HEADER_SIZE, &header, &block))
+    {
+        printf("Raw length bigger than the block size is accepted\n");
+        ok = false;
+    }
+    block = pBlocks[0];
+    block.compressedLen = 0;
+    lzs_frame_write_block_header(pFrame + LZS_FRAME_HEADER_SIZE, &block);
+    if (lzs_frame_read_block_header(pFrame + LZS_FRAME_HEADER_SIZE, &header, &block))
+    {
+        printf("Compressed length 0 is accepted\n");
+        ok = false;
+    }
+    block = pBlocks[0];
+    block.compressedLen = LZS_COMPRESSED_MAX(header.blockSize) + 1u;
+    lzs_frame_write_block_header(pFrame + LZS_FRAME_HEADER_SIZE, &block);
+    if (lzs_frame_read_block_header(pFrame + LZS_FRAME_HEADER_SIZE, &header, &block))
+    {
+        printf("Compressed length too big for the block size is accepted\n");
+        ok = false;
+    }
+    lzs_frame_write_block_header(pFrame + LZS_FRAME_HEADER_SIZE, &pBlocks[0]);
+
+    // Block lengths that don't match the data
+    block = pBlocks[0];
+    block.rawLen--;
+    if (lzs_frame_decompress_block(pOut, len, pFrame + LZS_FRAME_HEADER_SIZE + LZS_FRAME_BLOCK_HEADER_SIZE,
+                                   &block, flags))
+    {
+        printf("Raw length too short is accepted\n");
+        ok = false;
+    }
+    block = pBlocks[0];
+    block.rawLen++;
+    if (lzs_frame_decompress_block(pOut, len, pFrame + LZS_FRAME_HEADER_SIZE + LZS_FRAME_BLOCK_HEADER_SIZE,
+                                   &block, flags))
+    {
+        printf("Raw length too long is accepted\n");
+        ok = false;
+    }
+    block = pBlocks[0];
+    block.compressedLen--;
+    if (lzs_frame_decompress_block(pOut, len, pFrame + LZS_FRAME_HEADER_SIZE + LZS_FRAME_BLOCK_HEADER_SIZE,
+                                   &block, flags))
+    {
+        printf("Truncated block data is accepted\n");
+        ok = false;
+    }
+    // Each of these is the data followed by the start of the footer or the next block
+    for (i = 1u; i <= LZS_FRAME_FOOTER_SIZE; i++)
+    {
+        block = pBlocks[0];
+        block.compressedLen += i;
+        if (lzs_frame_decompress_block(pOut, len, pFrame + LZS_FRAME_HEADER_SIZE + LZS_FRAME_BLOCK_HEADER_SIZE,
+                                       &block, flags))
+        {
+            printf("Block data with %zu bytes after the end marker is accepted\n", i);
+            ok = false;
+        }
+    }
+    block = pBlocks[0];
+    if (lzs_frame_decompress_block(pOut, block.rawLen - 1u,
+                                   pFrame + LZS_FRAME_HEADER_SIZE + LZS_FRAME_BLOCK_HEADER_SIZE, &block, flags))
+    {
+        printf("Block bigger than the output buffer is accepted\n");
+        ok = false;
+    }
+    if (flags & LZS_FRAME_FLAG_CHECKSUM)
+    {
+        block.checksum ^= 1u;
+        if (lzs_frame_decompress_block(pOut, len, pFrame + LZS_FRAME_HEADER_SIZE + LZS_FRAME_BLOCK_HEADER_SIZE,
+                                       &block, flags))
+        {
+            printf("Wrong checksum is accepted\n");
+            ok = false;
+        }
+    }
+
+    // Footer
+    for (i = 4u; i < LZS_FRAME_FOOTER_SIZE; i++)
+    {
+        saved = pFrame[frameLen - LZS_FRAME_FOOTER_SIZE + i];
+        pFrame[frameLen - LZS_FRAME_FOOTER_SIZE + i] ^= 0x80u;
+        if (lzs_frame_read_footer(pFrame + frameLen - LZS_FRAME_FOOTER_SIZE, &blockCount))
+        {
+            printf("Footer with byte %zu corrupted is accepted\n", i);
+            ok = false;
+        }
+        pFrame[frameLen - LZS_FRAME_FOOTER_SIZE + i] = saved;
+    }
+
+    // Blocks that can't be compressed
+    if ((lzs_frame_compress_block(pFrame, LZS_FRAME_BLOCK_MAX(0), pData, 0, LZS_COMPRESS_LEVEL_DEFAULT, flags) != 0) ||
+        (lzs_frame_compress_block(pFrame, LZS_FRAME_BLOCK_MAX(len) - 1u, pData, len,
+                                  LZS_COMPRESS_LEVEL_DEFAULT, flags) != 0))
+    {
+        printf("Empty block, or a block without enough output space, is compressed\n");
+        ok = false;
+    }
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t           * pData;
+    uint8_t           * pFrame;
+    uint8_t           * pOut;
+    LzsFrameBlock_t   * pBlocks;
+    size_t              sizeIdx;
+    size_t              blockSizeIdx;
+    int                 type;
+    uint8_t             flags;
+    unsigned            numTests = 0;
+    unsigned            numFailures = 0;
+
+    (void)argc;
+    (void)argv;
+    pData = malloc(MAX_DATA_SIZE);
+    pFrame = malloc(MAX_FRAME_SIZE);
+    pOut = malloc(MAX_DATA_SIZE);
+    pBlocks = malloc(MAX_BLOCKS * sizeof(LzsFrameBlock_t));
+    if ((pData == NULL) || (pFrame == NULL) || (pOut == NULL) || (pBlocks == NULL))
+    {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    for (type = 0; type < NUM_DATA_TYPES; type++)
+    {
+        for (sizeIdx = 0; sizeIdx < sizeof(data_sizes) / sizeof(data_sizes[0]); sizeIdx++)
+        {
+            make_data(pData, data_sizes[sizeIdx], (DataType_t)type);
+            for (flags = 0; flags <= LZS_FRAME_FLAG_CHECKSUM; flags++)
+            {
+                for (blockSizeIdx = 0; blockSizeIdx < sizeof(block_sizes) / sizeof(block_sizes[0]); blockSizeIdx++)
+                {
+                    numTests++;
+                    if (!test_frame(pData, data_sizes[sizeIdx], block_sizes[blockSizeIdx], flags,
+                                    pFrame, pOut, pBlocks))
+                    {
+                        printf("    for %s data of size %zu, block size %u, flags %02X\n", data_type_names[type],
+                               data_sizes[sizeIdx], (unsigned)block_sizes[blockSizeIdx], flags);
+                        numFailures++;
+                    }
+                }
+                if (data_sizes[sizeIdx] != 0)
+                {
+                    numTests++;
+                    if (!test_frame_errors(pData, data_sizes[sizeIdx], flags, pFrame, pOut, pBlocks))
+                    {
+                        printf("    for errors in %s data of size %zu, flags %02X\n", data_type_names[type],
+                               data_sizes[sizeIdx], flags);
+                        numFailures++;
+                    }
+                }
+            }
+        }
+    }
+    printf("Framed container: %u tests, %u failures\n", numTests, numFailures);
+
+    free(pData);
+    free(pFrame);
+    free(pOut);
+    free(pBlocks);
+    return (numFailures == 0) ? 0 : 1;
+}
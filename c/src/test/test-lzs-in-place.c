@@ -0,0 +1,142 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Unit Tests for In-place Decompression
+ *
+ * Data of various kinds and sizes is compressed by each of the compressors,
+ * and then decompressed with lzs_decompress_in_place(), in a buffer of exactly
+ * LZS_DECOMPRESS_IN_PLACE_SIZE() bytes with the compressed data at its end.
+ * Incompressible data is the worst case, where the input starts only a few
+ * bytes ahead of the output. Random data with some short repeats puts match
+ * copies (which write a little past the end of the match) in that case too.
+ * The output must match the original data, and the bytes after the buffer
+ * must not be written.
+ *
+ ****************************************************************************/
+
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include "lzs.h"
+#include "test-lzs-data.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>         /* For memset() */
+
+
+/*****************************************************************************
+ * Defines
+ ****************************************************************************/
+
+#define MAX_DATA_SIZE               (200u * 1024u)
+
+// Bytes after the buffer that are checked, to catch writes past its end
+#define GUARD_SIZE                  64u
+#define GUARD_BYTE                  0xA5u
+
+
+/*****************************************************************************
+ * Tables
+ ****************************************************************************/
+
+static const size_t data_sizes[] =
+{
+    0, 1, 2, 3, 7, 8, 9, 15, 16, 17, 100, 1000,
+    2047, 2048, 2049, 4099, 65536, MAX_DATA_SIZE
+};
+
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+/*
+ * Compress the data, then decompress it in place. Return true if it's right.
+ */
+static bool test_in_place(const uint8_t * pData, size_t len, uint8_t * pCompressed, uint8_t * pBuffer,
+                          Compressor_t compressor)
+{
+    size_t      compressedLen;
+    size_t      bufferSize;
+    size_t      outLength;
+    size_t      i;
+
+    compressedLen = compress_data(pCompressed, LZS_COMPRESSED_MAX(len), pData, len, compressor);
+    bufferSize = LZS_DECOMPRESS_IN_PLACE_SIZE(len);
+    if (compressedLen > bufferSize)
+    {
+        printf("Compressed size %zu is bigger than the buffer\n", compressedLen);
+        return false;
+    }
+
+    memset(pBuffer, 0, bufferSize);
+    memset(pBuffer + bufferSize, GUARD_BYTE, GUARD_SIZE);
+    memcpy(pBuffer + bufferSize - compressedLen, pCompressed, compressedLen);
+    outLength = lzs_decompress_in_place(pBuffer, bufferSize, compressedLen);
+
+    if ((outLength != len) || (memcmp(pBuffer, pData, len) != 0))
+    {
+        printf("Decompressed data is wrong (size %zu)\n", outLength);
+        return false;
+    }
+    for (i = 0; i < GUARD_SIZE; i++)
+    {
+        if (pBuffer[bufferSize + i] != GUARD_BYTE)
+        {
+            printf("Write past the end of the buffer\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t   * pData;
+    uint8_t   * pCompressed;
+    uint8_t   * pBuffer;
+    size_t      sizeIdx;
+    int         type;
+    int         compressor;
+    unsigned    numTests = 0;
+    unsigned    numFailures = 0;
+
+    (void)argc;
+    (void)argv;
+    pData = malloc(MAX_DATA_SIZE);
+    pCompressed = malloc(LZS_COMPRESSED_MAX(MAX_DATA_SIZE));
+    pBuffer = malloc(LZS_DECOMPRESS_IN_PLACE_SIZE(MAX_DATA_SIZE) + GUARD_SIZE);
+    if ((pData == NULL) || (pCompressed == NULL) || (pBuffer == NULL))
+    {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    for (type = 0; type < NUM_DATA_TYPES; type++)
+    {
+        for (sizeIdx = 0; sizeIdx < sizeof(data_sizes) / sizeof(data_sizes[0]); sizeIdx++)
+        {
+            make_data(pData, data_sizes[sizeIdx], (DataType_t)type);
+            for (compressor = 0; compressor < NUM_COMPRESSORS; compressor++)
+            {
+                numTests++;
+                if (!test_in_place(pData, data_sizes[sizeIdx], pCompressed, pBuffer, (Compressor_t)compressor))
+                {
+                    printf("    for %s data of size %zu, %s compressor\n",
+                           data_type_names[type], data_sizes[sizeIdx], compressor_names[compressor]);
+                    numFailures++;
+                }
+            }
+        }
+    }
+    printf("In-place decompression: %u tests, %u failures\n", numTests, numFailures);
+
+    free(pData);
+    free(pCompressed);
+    free(pBuffer);
+    return (numFailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,231 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Unit Tests for Incremental Decompression
+ *
+ * Several compressed streams are concatenated, then decompressed with
+ * lzs_decompress_incremental(), given input and output in chunks of random
+ * sizes. Small chunks exercise the byte-at-a-time state machine, and large
+ * ones the fast inner loop. Each call must stop at an end marker, so the
+ * output between end markers must match what lzs_decompress() gives for each
+ * stream on its own.
+ *
+ ****************************************************************************/
+
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include "lzs.h"
+#include "test-lzs-data.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>         /* For memcmp() */
+
+
+/*****************************************************************************
+ * Defines
+ ****************************************************************************/
+
+#define MAX_DATA_SIZE               (64u * 1024u)
+#define NUM_STREAMS                 5u
+#define NUM_CHUNKINGS               8u
+
+#define MIN(X, Y)                   (((X) < (Y)) ? (X) : (Y))
+
+
+/*****************************************************************************
+ * Tables
+ ****************************************************************************/
+
+// Sizes of the streams that are concatenated, in turn
+static const size_t stream_sizes[] =
+{
+    1000, 0, 1, 17, 2047, 2049, 4099, 30000, MAX_DATA_SIZE
+};
+
+// Upper limits for the random chunk sizes, from byte-by-byte to big enough for the fast loop
+static const size_t chunk_limits[] =
+{
+    1, 3, 16, 200, 5000
+};
+
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+static size_t random_chunk(uint32_t * pState, size_t limit)
+{
+    return 1u + (size_t)random_next(pState) % limit;
+}
+
+/*
+ * Decompress the concatenated streams incrementally, with random chunk sizes
+ * up to the given limits. Return true if each stream's output is right.
+ */
+static bool test_incremental(const uint8_t * pCompressed, const size_t * pCompressedLens,
+                             const uint8_t * const * ppExpected, const size_t * pExpectedLens, size_t numStreams,
+                             uint8_t * pOut, size_t outBufferSize, size_t inLimit, size_t outLimit, uint32_t seed)
+{
+    LzsDecompressParameters_t   params;
+    uint32_t                    state = seed;
+    size_t                      inPos = 0;
+    size_t                      inTotal = 0;
+    size_t                      outPos = 0;
+    size_t                      streamStart = 0;
+    size_t                      stream = 0;
+    size_t                      chunk;
+    size_t                      i;
+
+    for (i = 0; i < numStreams; i++)
+    {
+        inTotal += pCompressedLens[i];
+    }
+
+    lzs_decompress_init(&params);
+    params.inLength = 0;
+    params.outLength = 0;
+    while (stream < numStreams)
+    {
+        // At the end of input, keep calling to decode what the decompressor has already read
+        if ((params.inLength == 0) && (inPos < inTotal))
+        {
+            chunk = MIN(random_chunk(&state, inLimit), inTotal - inPos);
+            params.inPtr = pCompressed + inPos;
+            params.inLength = chunk;
+            inPos += chunk;
+        }
+        if (params.outLength == 0)
+        {
+            chunk = MIN(random_chunk(&state, outLimit), outBufferSize - outPos);
+            params.outPtr = pOut + outPos;
+            params.outLength = chunk;
+        }
+
+        outPos += lzs_decompress_incremental(&params);
+        if (params.status & LZS_D_STATUS_ERROR)
+        {
+            printf("Error status in stream %zu\n", stream);
+            return false;
+        }
+        if (params.status & LZS_D_STATUS_END_MARKER)
+        {
+            if ((outPos - streamStart != pExpectedLens[stream]) ||
+                (memcmp(pOut + streamStart, ppExpected[stream], pExpectedLens[stream]) != 0))
+            {
+                printf("Stream %zu output is wrong (size %zu, expected %zu)\n",
+                       stream, outPos - streamStart, pExpectedLens[stream]);
+                return false;
+            }
+            streamStart = outPos;
+            stream++;
+        }
+        else if ((params.status & LZS_D_STATUS_INPUT_STARVED) && (inPos == inTotal))
+        {
+            printf("Stream %zu has no end marker\n", stream);
+            return false;
+        }
+        else if ((params.outLength != 0) && (params.inLength != 0))
+        {
+            printf("Returned with input and output space left, status %02X\n", params.status);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t           * pData[NUM_STREAMS];
+    const uint8_t     * pExpected[NUM_STREAMS];
+    uint8_t           * pCompressed;
+    uint8_t           * pOut;
+    size_t              compressedLens[NUM_STREAMS];
+    size_t              expectedLens[NUM_STREAMS];
+    size_t              compressedTotal;
+    size_t              outLen;
+    size_t              i;
+    size_t              sizeIdx;
+    size_t              inLimit;
+    size_t              outLimit;
+    int                 type;
+    int                 compressor;
+    unsigned            chunking;
+    unsigned            numTests = 0;
+    unsigned            numFailures = 0;
+    uint32_t            seed = 1u;
+
+    (void)argc;
+    (void)argv;
+    pCompressed = malloc(NUM_STREAMS * LZS_COMPRESSED_MAX(MAX_DATA_SIZE));
+    pOut = malloc(NUM_STREAMS * MAX_DATA_SIZE);
+    if ((pCompressed == NULL) || (pOut == NULL))
+    {
+        printf("Out of memory\n");
+        return 1;
+    }
+    for (i = 0; i < NUM_STREAMS; i++)
+    {
+        pData[i] = malloc(MAX_DATA_SIZE);
+        if (pData[i] == NULL)
+        {
+            printf("Out of memory\n");
+            return 1;
+        }
+    }
+
+    for (type = 0; type < NUM_DATA_TYPES; type++)
+    {
+        for (compressor = 0; compressor < NUM_COMPRESSORS; compressor++)
+        {
+            // Concatenate streams of various sizes, each of a different type of data
+            compressedTotal = 0;
+            for (i = 0; i < NUM_STREAMS; i++)
+            {
+                sizeIdx = ((size_t)type + (size_t)compressor + i) % (sizeof(stream_sizes) / sizeof(stream_sizes[0]));
+                make_data(pData[i], stream_sizes[sizeIdx], (DataType_t)((type + i) % NUM_DATA_TYPES));
+                compressedLens[i] = compress_data(pCompressed + compressedTotal, LZS_COMPRESSED_MAX(MAX_DATA_SIZE),
+                                                  pData[i], stream_sizes[sizeIdx], (Compressor_t)compressor);
+
+                // The expected output of each stream is what lzs_decompress() gives
+                outLen = lzs_decompress(pOut, MAX_DATA_SIZE, pCompressed + compressedTotal, compressedLens[i]);
+                if ((outLen != stream_sizes[sizeIdx]) || (memcmp(pOut, pData[i], outLen) != 0))
+                {
+                    printf("lzs_decompress() output is wrong for %s data, %s compressor\n",
+                           data_type_names[type], compressor_names[compressor]);
+                    numFailures++;
+                }
+                pExpected[i] = pData[i];
+                expectedLens[i] = stream_sizes[sizeIdx];
+                compressedTotal += compressedLens[i];
+            }
+
+            for (chunking = 0; chunking < NUM_CHUNKINGS; chunking++)
+            {
+                inLimit = chunk_limits[chunking % (sizeof(chunk_limits) / sizeof(chunk_limits[0]))];
+                outLimit = chunk_limits[(chunking / 2u + (unsigned)type) % (sizeof(chunk_limits) / sizeof(chunk_limits[0]))];
+                numTests++;
+                if (!test_incremental(pCompressed, compressedLens, pExpected, expectedLens, NUM_STREAMS,
+                                      pOut, NUM_STREAMS * MAX_DATA_SIZE, inLimit, outLimit, seed++))
+                {
+                    printf("    for %s data, %s compressor, input chunks up to %zu, output chunks up to %zu\n",
+                           data_type_names[type], compressor_names[compressor], inLimit, outLimit);
+                    numFailures++;
+                }
+            }
+        }
+    }
+    printf("Incremental decompression: %u tests, %u failures\n", numTests, numFailures);
+
+    for (i = 0; i < NUM_STREAMS; i++)
+    {
+        free(pData[i]);
+    }
+    free(pCompressed);
+    free(pOut);
+    return (numFailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,227 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Unit Tests for Parallel Compression
+ *
+ * Data of various kinds is compressed with lzs_compress_parallel(), on 1, 2
+ * and 3 threads, at sizes around multiples of the segment size, as well as
+ * empty input and input smaller than one segment. The output must be the
+ * same for any number of threads, and decompress to the original data. Input
+ * of no more than one segment, or with an output buffer smaller than
+ * LZS_COMPRESSED_MAX(), must give the same output as lzs_compress_level().
+ *
+ * lzs_compress_parallel_search() must give exactly the same output as
+ * lzs_compress_level(), at every level, for any number of threads.
+ *
+ ****************************************************************************/
+
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include "lzs.h"
+#include "test-lzs-data.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>         /* For memcmp() */
+
+
+/*****************************************************************************
+ * Defines
+ ****************************************************************************/
+
+#define SEGMENT_SIZE                LZS_COMPRESS_PARALLEL_SEGMENT_SIZE
+#define MAX_DATA_SIZE               (3u * SEGMENT_SIZE + 12345u)
+
+// lzs_compress_parallel_search() searches ranges of at least this size
+#define SEARCH_CHUNK_SIZE           (64u * 1024u)
+
+
+/*****************************************************************************
+ * Tables
+ ****************************************************************************/
+
+static const size_t data_sizes[] =
+{
+    0, 1, 100, 2047, 2049, SEGMENT_SIZE - 1u, SEGMENT_SIZE, SEGMENT_SIZE + 1u,
+    2u * SEGMENT_SIZE + 2047u, MAX_DATA_SIZE
+};
+
+static const size_t search_sizes[] =
+{
+    0, 100, 2049, SEARCH_CHUNK_SIZE - 1u, SEARCH_CHUNK_SIZE + 1u, 3u * SEARCH_CHUNK_SIZE + 12345u
+};
+
+static const unsigned thread_counts[] =
+{
+    1, 2, 3
+};
+
+static const uint8_t levels[] =
+{
+    LZS_COMPRESS_LEVEL_MIN, LZS_COMPRESS_LEVEL_DEFAULT, LZS_COMPRESS_LEVEL_MAX
+};
+
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+/*
+ * Compress with lzs_compress_parallel() on each number of threads. Return true
+ * if the output is the same each time, and decompresses to the original data.
+ */
+static bool test_parallel(const uint8_t * pData, size_t len, uint8_t level, uint8_t * pCompressed,
+                          uint8_t * pReference, uint8_t * pOut)
+{
+    size_t      referenceLen = 0;
+    size_t      compressedLen;
+    size_t      outLen;
+    size_t      i;
+
+    for (i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++)
+    {
+        compressedLen = lzs_compress_parallel(pCompressed, LZS_COMPRESS_PARALLEL_MAX(len), pData, len,
+                                              level, thread_counts[i]);
+        if (i == 0)
+        {
+            memcpy(pReference, pCompressed, compressedLen);
+            referenceLen = compressedLen;
+        }
+        else if ((compressedLen != referenceLen) || (memcmp(pCompressed, pReference, compressedLen) != 0))
+        {
+            printf("Output on %u threads is different from 1 thread\n", thread_counts[i]);
+            return false;
+        }
+
+        outLen = lzs_decompress(pOut, len, pCompressed, compressedLen);
+        if ((outLen != len) || (memcmp(pOut, pData, len) != 0))
+        {
+            printf("Decompressed data is wrong (size %zu), on %u threads\n", outLen, thread_counts[i]);
+            return false;
+        }
+    }
+
+    // Up to one segment, it's the same as lzs_compress_level()
+    if (len <= SEGMENT_SIZE)
+    {
+        compressedLen = lzs_compress_level(pCompressed, LZS_COMPRESSED_MAX(len), pData, len, level);
+        if ((compressedLen != referenceLen) || (memcmp(pCompressed, pReference, compressedLen) != 0))
+        {
+            printf("Output is different from lzs_compress_level()\n");
+            return false;
+        }
+    }
+
+    // Without space for the worst case of each separate segment, it's the same as lzs_compress_level()
+    compressedLen = lzs_compress_parallel(pReference, LZS_COMPRESSED_MAX(len) - 1u, pData, len, level, 2u);
+    outLen = lzs_compress_level(pCompressed, LZS_COMPRESSED_MAX(len) - 1u, pData, len, level);
+    if ((compressedLen != outLen) || (memcmp(pCompressed, pReference, compressedLen) != 0))
+    {
+        printf("Output with a small buffer is different from lzs_compress_level()\n");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Compress with lzs_compress_parallel_search() on each number of threads.
+ * Return true if the output is the same as lzs_compress_level() each time.
+ */
+static bool test_parallel_search(const uint8_t * pData, size_t len, uint8_t level, uint8_t * pCompressed,
+                                 uint8_t * pReference)
+{
+    void      * pWorkspace;
+    size_t      referenceLen;
+    size_t      compressedLen;
+    size_t      i;
+
+    referenceLen = lzs_compress_level(pReference, LZS_COMPRESSED_MAX(len), pData, len, level);
+    pWorkspace = malloc(lzs_compress_parallel_search_workspace_size(len, level) + 1u);
+    if (pWorkspace == NULL)
+    {
+        printf("Out of memory\n");
+        return false;
+    }
+    for (i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++)
+    {
+        compressedLen = lzs_compress_parallel_search(pCompressed, LZS_COMPRESSED_MAX(len), pData, len,
+                                                     level, thread_counts[i], pWorkspace);
+        if ((compressedLen != referenceLen) || (memcmp(pCompressed, pReference, compressedLen) != 0))
+        {
+            printf("Output on %u threads is different from lzs_compress_level()\n", thread_counts[i]);
+            free(pWorkspace);
+            return false;
+        }
+    }
+    free(pWorkspace);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t   * pData;
+    uint8_t   * pCompressed;
+    uint8_t   * pReference;
+    uint8_t   * pOut;
+    size_t      sizeIdx;
+    size_t      levelIdx;
+    uint8_t     level;
+    int         type;
+    unsigned    numTests = 0;
+    unsigned    numFailures = 0;
+
+    (void)argc;
+    (void)argv;
+    pData = malloc(MAX_DATA_SIZE);
+    pCompressed = malloc(LZS_COMPRESS_PARALLEL_MAX(MAX_DATA_SIZE));
+    pReference = malloc(LZS_COMPRESS_PARALLEL_MAX(MAX_DATA_SIZE));
+    pOut = malloc(MAX_DATA_SIZE);
+    if ((pData == NULL) || (pCompressed == NULL) || (pReference == NULL) || (pOut == NULL))
+    {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    for (type = 0; type < NUM_DATA_TYPES; type++)
+    {
+        for (sizeIdx = 0; sizeIdx < sizeof(data_sizes) / sizeof(data_sizes[0]); sizeIdx++)
+        {
+            make_data(pData, data_sizes[sizeIdx], (DataType_t)type);
+            for (levelIdx = 0; levelIdx < sizeof(levels) / sizeof(levels[0]); levelIdx++)
+            {
+                numTests++;
+                if (!test_parallel(pData, data_sizes[sizeIdx], levels[levelIdx], pCompressed, pReference, pOut))
+                {
+                    printf("    for %s data of size %zu, level %u\n",
+                           data_type_names[type], data_sizes[sizeIdx], levels[levelIdx]);
+                    numFailures++;
+                }
+            }
+        }
+        for (sizeIdx = 0; sizeIdx < sizeof(search_sizes) / sizeof(search_sizes[0]); sizeIdx++)
+        {
+            make_data(pData, search_sizes[sizeIdx], (DataType_t)type);
+            for (level = LZS_COMPRESS_LEVEL_MIN; level <= LZS_COMPRESS_LEVEL_MAX; level++)
+            {
+                numTests++;
+                if (!test_parallel_search(pData, search_sizes[sizeIdx], level, pCompressed, pReference))
+                {
+                    printf("    for parallel search in %s data of size %zu, level %u\n",
+                           data_type_names[type], search_sizes[sizeIdx], level);
+                    numFailures++;
+                }
+            }
+        }
+    }
+    printf("Parallel compression: %u tests, %u failures\n", numTests, numFailures);
+
+    free(pData);
+    free(pCompressed);
+    free(pReference);
+    free(pOut);
+    return (numFailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Unit Tests for Skipping in Incremental Decompression
+ *
+ * lzs_decompress_skip() skips N bytes, then lzs_decompress_incremental()
+ * decompresses the rest. The result must match the original data from
+ * offset N. For short data, every N is tried, which covers N = 0, every token
+ * boundary, and every point part-way through a match. For longer data, the
+ * skips and the decompression are split into random-sized pieces, with input
+ * in random-sized chunks.
+ *
+ ****************************************************************************/
+
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include "lzs.h"
+#include "test-lzs-data.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>         /* For memcmp() */
+
+
+/*****************************************************************************
+ * Defines
+ ****************************************************************************/
+
+// Every skip length is tried for data up to this size
+#define SHORT_DATA_SIZE             4099u
+
+#define MAX_DATA_SIZE               (200u * 1024u)
+#define NUM_RANDOM_TESTS            20u
+
+#define MIN(X, Y)                   (((X) < (Y)) ? (X) : (Y))
+
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+/*
+ * Skip the first skipLen bytes, then decompress the rest. Return true if it's right.
+ */
+static bool test_skip(const uint8_t * pData, size_t len, const uint8_t * pCompressed, size_t compressedLen,
+                      uint8_t * pOut, size_t skipLen)
+{
+    LzsDecompressParameters_t   params;
+    size_t                      skipCount;
+    size_t                      outCount;
+
+    lzs_decompress_init(&params);
+    params.inPtr = pCompressed;
+    params.inLength = compressedLen;
+    params.outPtr = pOut;
+    params.outLength = 0;
+
+    skipCount = lzs_decompress_skip(&params, skipLen);
+    if (skipCount != skipLen)
+    {
+        printf("Skipped %zu bytes, not %zu\n", skipCount, skipLen);
+        return false;
+    }
+    if ((params.outPtr != pOut) || (params.outLength != 0))
+    {
+        printf("Skip changed the output buffer\n");
+        return false;
+    }
+    if ((skipLen < len) && (params.status != LZS_D_STATUS_NO_OUTPUT_BUFFER_SPACE))
+    {
+        printf("Skip status is %02X\n", params.status);
+        return false;
+    }
+
+    params.outLength = len - skipLen;
+    outCount = lzs_decompress_incremental(&params);
+    if ((outCount != len - skipLen) || (memcmp(pOut, pData + skipLen, outCount) != 0))
+    {
+        printf("Data after skipping %zu bytes is wrong (size %zu)\n", skipLen, outCount);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Alternately skip and decompress random-sized pieces, with the input in
+ * random-sized chunks. Return true if the decompressed pieces are right.
+ */
+static bool test_skip_pieces(const uint8_t * pData, size_t len, const uint8_t * pCompressed, size_t compressedLen,
+                             uint8_t * pOut, uint32_t seed)
+{
+    LzsDecompressParameters_t   params;
+    uint32_t                    state = seed;
+    size_t                      inPos = 0;
+    size_t                      outPos = 0;
+    size_t                      count;
+    size_t                      want;
+    bool                        skip;
+
+    lzs_decompress_init(&params);
+    params.inLength = 0;
+    while (outPos < len)
+    {
+        if ((params.inLength == 0) && (inPos < compressedLen))
+        {
+            count = MIN(1u + random_next(&state) % 5000u, compressedLen - inPos);
+            params.inPtr = pCompressed + inPos;
+            params.inLength = count;
+            inPos += count;
+        }
+
+        // Mostly short pieces, so skips often stop part-way through a match
+        want = 1u + random_next(&state) % ((random_next(&state) % 2u) ? 20u : 20000u);
+        skip = (random_next(&state) % 2u) != 0;
+        if (skip)
+        {
+            count = lzs_decompress_skip(&params, want);
+        }
+        else
+        {
+            params.outPtr = pOut;
+            params.outLength = want;
+            count = lzs_decompress_incremental(&params);
+            if ((count > len - outPos) || (memcmp(pOut, pData + outPos, count) != 0))
+            {
+                printf("Data at %zu is wrong\n", outPos);
+                return false;
+            }
+        }
+        outPos += count;
+
+        if ((params.status & LZS_D_STATUS_INPUT_STARVED) && (inPos == compressedLen) && (outPos < len))
+        {
+            printf("Input ended at %zu of %zu bytes\n", outPos, len);
+            return false;
+        }
+    }
+    if (outPos != len)
+    {
+        printf("Decompressed %zu bytes, not %zu\n", outPos, len);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t   * pData;
+    uint8_t   * pCompressed;
+    uint8_t   * pOut;
+    size_t      compressedLen;
+    size_t      skipLen;
+    int         type;
+    int         compressor;
+    unsigned    i;
+    unsigned    numTests = 0;
+    unsigned    numFailures = 0;
+    uint32_t    seed = 1u;
+
+    (void)argc;
+    (void)argv;
+    pData = malloc(MAX_DATA_SIZE);
+    pCompressed = malloc(LZS_COMPRESSED_MAX(MAX_DATA_SIZE));
+    pOut = malloc(MAX_DATA_SIZE);
+    if ((pData == NULL) || (pCompressed == NULL) || (pOut == NULL))
+    {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    for (type = 0; type < NUM_DATA_TYPES; type++)
+    {
+        for (compressor = 0; compressor < NUM_COMPRESSORS; compressor++)
+        {
+            make_data(pData, SHORT_DATA_SIZE, (DataType_t)type);
+            compressedLen = compress_data(pCompressed, LZS_COMPRESSED_MAX(SHORT_DATA_SIZE),
+                                          pData, SHORT_DATA_SIZE, (Compressor_t)compressor);
+            for (skipLen = 0; skipLen <= SHORT_DATA_SIZE; skipLen++)
+            {
+                numTests++;
+                if (!test_skip(pData, SHORT_DATA_SIZE, pCompressed, compressedLen, pOut, skipLen))
+                {
+                    printf("    for %s data, %s compressor\n", data_type_names[type], compressor_names[compressor]);
+                    numFailures++;
+                    break;
+                }
+            }
+
+            make_data(pData, MAX_DATA_SIZE, (DataType_t)type);
+            compressedLen = compress_data(pCompressed, LZS_COMPRESSED_MAX(MAX_DATA_SIZE),
+                                          pData, MAX_DATA_SIZE, (Compressor_t)compressor);
+            for (i = 0; i < NUM_RANDOM_TESTS; i++)
+            {
+                numTests++;
+                if (!test_skip_pieces(pData, MAX_DATA_SIZE, pCompressed, compressedLen, pOut, seed++))
+                {
+                    printf("    for %s data, %s compressor, in pieces\n",
+                           data_type_names[type], compressor_names[compressor]);
+                    numFailures++;
+                }
+            }
+        }
+    }
+    printf("Skip: %u tests, %u failures\n", numTests, numFailures);
+
+    free(pData);
+    free(pCompressed);
+    free(pOut);
+    return (numFailures == 0) ? 0 : 1;
+}
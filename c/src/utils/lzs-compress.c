@@ -4,6 +4,14 @@
  *
  * \brief Compression of a file
  *
+ * Usage: lzs-compress [-f] [-s] [-j threads] [-b block-size] in-file out-file
+ *
+ * By default, the output is a single LZS stream. With -f, the output is the
+ * framed container (see lzs-frame.c), of blocks of block-size bytes (with an
+ * optional k or m suffix) that are compressed independently, on a pool of
+ * threads (one per CPU by default). -s adds a checksum to each block. -s, -j
+ * and -b imply -f.
+ *
  ****************************************************************************/
 
 
@@ -11,7 +19,12 @@
  * Includes
  ****************************************************************************/
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include "lzs.h"
+#include "lzs-thread-pool.h"
 
 #include <stdio.h>
 #include <string.h>         /* For memset() */
@@ -31,6 +44,26 @@
 #define INCREMENTAL_INPUT_SIZE      512
 #define INCREMENTAL_OUTPUT_SIZE     512
 
+// Blocks that are read ahead, per thread, so threads don't wait for the
+// output to be written in order.
+#define FRAME_JOBS_PER_THREAD       2u
+
+
+/*****************************************************************************
+ * Typedefs
+ ****************************************************************************/
+
+typedef struct
+{
+    ThreadPoolTask_t    task;
+    uint8_t           * pIn;
+    size_t              inLen;
+    uint8_t           * pOut;
+    size_t              outBufferSize;
+    size_t              outLen;
+    uint8_t             flags;
+} FrameJob_t;
+
 
 /*****************************************************************************
  * Functions
@@ -41,10 +74,8 @@
 /*
  * Use incremental version of the compression algorithm.
  */
-int main(int argc, char **argv)
+static void compress_stream(int in_fd, int out_fd)
 {
-    int in_fd;
-    int out_fd;
     ssize_t read_len;
     ssize_t write_len;
     uint8_t in_buffer[INCREMENTAL_INPUT_SIZE];
@@ -57,24 +88,6 @@ int main(int argc, char **argv)
     size_t  out_length;
     bool    finish = false;
 
-    if (argc < 3)
-    {
-        printf("Too few arguments\n");
-        exit(1);
-    }
-    in_fd = open(argv[1], O_RDONLY);
-    if (in_fd < 0)
-    {
-        perror("argv[1]");
-        exit(2);
-    }
-    out_fd = open(argv[2], O_WRONLY|O_CREAT|O_TRUNC, 0666);
-    if (out_fd < 0)
-    {
-        perror("argv[2]");
-        exit(3);
-    }
-
     // Initialise
 #if LZS_USE_SIMPLE_ALGORITHM
     lzs_simple_compress_init(&compress_params);
@@ -132,8 +145,6 @@ int main(int argc, char **argv)
         }
 #endif
     }
-
-    return 0;
 }
 
 #else
@@ -144,10 +155,8 @@ int main(int argc, char **argv)
  * The whole of the source data must be loaded into memory as a single buffer.
  * The output also goes into a single output buffer in memory.
  */
-int main(int argc, char **argv)
+static void compress_stream(int in_fd, int out_fd)
 {
-    int in_fd;
-    int out_fd;
     struct stat stbuf;
     ssize_t read_len;
     ssize_t write_len;
@@ -157,24 +166,6 @@ int main(int argc, char **argv)
     ssize_t outBufferSize;
     size_t  out_length;
 
-    if (argc < 3)
-    {
-        printf("Too few arguments\n");
-        exit(1);
-    }
-    in_fd = open(argv[1], O_RDONLY);
-    if (in_fd < 0)
-    {
-        perror("argv[1]");
-        exit(2);
-    }
-    out_fd = open(argv[2], O_WRONLY|O_CREAT|O_TRUNC, 0666);
-    if (out_fd < 0)
-    {
-        perror("argv[2]");
-        exit(3);
-    }
-
     if ((fstat(in_fd, &stbuf) != 0) || (!S_ISREG(stbuf.st_mode)))
     {
         perror("fstat");
@@ -212,8 +203,266 @@ int main(int argc, char **argv)
         perror("write");
         exit(8);
     }
-
-    return 0;
 }
 
 #endif
+
+/*
+ * Read until the buffer is full or the input ends.
+ */
+static size_t read_full(int fd, uint8_t * pBuffer, size_t len)
+{
+    size_t      count = 0;
+    ssize_t     read_len;
+
+    while (count < len)
+    {
+        read_len = read(fd, pBuffer + count, len - count);
+        if (read_len < 0)
+        {
+            perror("read");
+            exit(4);
+        }
+        if (read_len == 0)
+        {
+            break;
+        }
+        count += read_len;
+    }
+    return count;
+}
+
+static void write_full(int fd, const uint8_t * pBuffer, size_t len)
+{
+    ssize_t     write_len;
+
+    while (len != 0)
+    {
+        write_len = write(fd, pBuffer, len);
+        if (write_len < 0)
+        {
+            perror("write");
+            exit(5);
+        }
+        pBuffer += write_len;
+        len -= write_len;
+    }
+}
+
+static void frame_compress_job(ThreadPoolTask_t * pTask)
+{
+    FrameJob_t        * pJob = (FrameJob_t *)pTask;
+
+    pJob->outLen = lzs_frame_compress_block(pJob->pOut, pJob->outBufferSize, pJob->pIn, pJob->inLen,
+                                            LZS_COMPRESS_LEVEL_DEFAULT, pJob->flags);
+}
+
+/*
+ * Compress to the framed container.
+ *
+ * Blocks are read into a ring of jobs, and compressed on the thread pool. The
+ * oldest job is waited for and written out, then its slot is used for the
+ * next block, so the output is in order while the threads stay busy.
+ */
+static void compress_framed(int in_fd, int out_fd, uint32_t blockSize, uint8_t flags, unsigned numThreads)
+{
+    ThreadPool_t      * pPool;
+    FrameJob_t        * pJobs;
+    FrameJob_t        * pJob;
+    LzsFrameHeader_t    header;
+    LzsFrameBlock_t     block;
+    uint8_t           * pIndex = NULL;
+    size_t              indexLen = 0;
+    size_t              indexSize = 0;
+    uint32_t            blockCount = 0;
+    size_t              numJobs;
+    size_t              head = 0;           // Count of jobs submitted
+    size_t              tail = 0;           // Count of jobs written out
+    size_t              i;
+    bool                finish = false;
+    uint8_t             buffer[LZS_FRAME_HEADER_SIZE];
+
+    numJobs = (size_t)numThreads * FRAME_JOBS_PER_THREAD;
+    pJobs = calloc(numJobs, sizeof(pJobs[0]));
+    if (pJobs == NULL)
+    {
+        perror("malloc for jobs");
+        exit(6);
+    }
+    for (i = 0; i < numJobs; i++)
+    {
+        pJobs[i].task.pFunc = frame_compress_job;
+        pJobs[i].pIn = malloc(blockSize);
+        pJobs[i].outBufferSize = LZS_FRAME_BLOCK_MAX(blockSize);
+        pJobs[i].pOut = malloc(pJobs[i].outBufferSize);
+        pJobs[i].flags = flags;
+        if (pJobs[i].pIn == NULL || pJobs[i].pOut == NULL)
+        {
+            perror("malloc for blocks");
+            exit(6);
+        }
+    }
+    pPool = thread_pool_create(numThreads);
+    if (pPool == NULL)
+    {
+        perror("thread pool");
+        exit(6);
+    }
+
+    header.blockSize = blockSize;
+    header.flags = flags;
+    write_full(out_fd, buffer, lzs_frame_write_header(buffer, &header));
+
+    for (;;)
+    {
+        while (!finish && head - tail < numJobs)
+        {
+            pJob = &pJobs[head % numJobs];
+            pJob->inLen = read_full(in_fd, pJob->pIn, blockSize);
+            if (pJob->inLen < blockSize)
+            {
+                finish = true;
+            }
+            if (pJob->inLen == 0)
+            {
+                break;
+            }
+            thread_pool_submit(pPool, &pJob->task);
+            head++;
+        }
+        if (tail == head)
+        {
+            break;
+        }
+
+        pJob = &pJobs[tail % numJobs];
+        thread_pool_wait(pPool, &pJob->task);
+        write_full(out_fd, pJob->pOut, pJob->outLen);
+        tail++;
+
+        // Keep a copy of the block header for the index
+        if (indexLen + LZS_FRAME_BLOCK_HEADER_SIZE > indexSize)
+        {
+            indexSize = indexSize * 2u + 64u * LZS_FRAME_BLOCK_HEADER_SIZE;
+            pIndex = realloc(pIndex, indexSize);
+            if (pIndex == NULL)
+            {
+                perror("malloc for index");
+                exit(6);
+            }
+        }
+        memcpy(pIndex + indexLen, pJob->pOut, LZS_FRAME_BLOCK_HEADER_SIZE);
+        indexLen += LZS_FRAME_BLOCK_HEADER_SIZE;
+        blockCount++;
+    }
+    thread_pool_destroy(pPool);
+
+    // End of blocks, then the index and footer
+    memset(&block, 0, sizeof(block));
+    write_full(out_fd, buffer, lzs_frame_write_block_header(buffer, &block));
+    write_full(out_fd, pIndex, indexLen);
+    write_full(out_fd, buffer, lzs_frame_write_footer(buffer, blockCount));
+
+    for (i = 0; i < numJobs; i++)
+    {
+        free(pJobs[i].pIn);
+        free(pJobs[i].pOut);
+    }
+    free(pJobs);
+    free(pIndex);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: lzs-compress [-f] [-s] [-j threads] [-b block-size] in-file out-file\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int         in_fd;
+    int         out_fd;
+    int         opt;
+    char      * pEnd;
+    unsigned long value;
+    bool        framed = false;
+    uint8_t     flags = 0;
+    unsigned    numThreads = 0;
+    uint32_t    blockSize = LZS_FRAME_BLOCK_SIZE_DEFAULT;
+
+    while ((opt = getopt(argc, argv, "fsj:b:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'f':
+                framed = true;
+                break;
+            case 's':
+                framed = true;
+                flags |= LZS_FRAME_FLAG_CHECKSUM;
+                break;
+            case 'j':
+                framed = true;
+                value = strtoul(optarg, &pEnd, 10);
+                if (*pEnd != '\0' || value == 0 || value > 1024u)
+                {
+                    usage();
+                }
+                numThreads = value;
+                break;
+            case 'b':
+                framed = true;
+                value = strtoul(optarg, &pEnd, 10);
+                if (*pEnd == 'k' || *pEnd == 'K')
+                {
+                    value *= 1024u;
+                    pEnd++;
+                }
+                else if (*pEnd == 'm' || *pEnd == 'M')
+                {
+                    value *= 1024u * 1024u;
+                    pEnd++;
+                }
+                if (*pEnd != '\0' || value == 0 || value > LZS_FRAME_BLOCK_SIZE_MAX)
+                {
+                    usage();
+                }
+                blockSize = value;
+                break;
+            default:
+                usage();
+        }
+    }
+    if (argc - optind < 2)
+    {
+        printf("Too few arguments\n");
+        exit(1);
+    }
+    in_fd = open(argv[optind], O_RDONLY);
+    if (in_fd < 0)
+    {
+        perror(argv[optind]);
+        exit(2);
+    }
+    out_fd = open(argv[optind + 1], O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if (out_fd < 0)
+    {
+        perror(argv[optind + 1]);
+        exit(3);
+    }
+
+    if (framed)
+    {
+        if (numThreads == 0)
+        {
+            numThreads = thread_pool_default_threads();
+        }
+        compress_framed(in_fd, out_fd, blockSize, flags, numThreads);
+    }
+    else
+    {
+        compress_stream(in_fd, out_fd);
+    }
+
+    return 0;
+}
@@ -4,6 +4,18 @@
  *
  * \brief Decompression of a file
  *
+ * Usage: lzs-decompress [-j threads] [-i index-file [-n interval-KiB]] in-file out-file
+ *        lzs-decompress -i index-file -r offset,length in-file out-file
+ *
+ * The input can be a single LZS stream, or the framed container (see
+ * lzs-frame.c) written by lzs-compress -f. The blocks of a framed container
+ * are decompressed on a pool of threads (one per CPU by default).
+ *
+ * With -i, a checkpoint index (see lzs-checkpoint.c) of a single LZS stream is
+ * written while it is decompressed. With -r as well, the index is read
+ * instead, and only the given range of the decompressed data is output,
+ * decompressed from the checkpoint before it.
+ *
  ****************************************************************************/
 
 
@@ -11,7 +23,12 @@
  * Includes
  ****************************************************************************/
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include "lzs.h"
+#include "lzs-thread-pool.h"
 
 #include <stdio.h>
 #include <string.h>         /* For memset() */
@@ -30,57 +47,128 @@
 #define INCREMENTAL_INPUT_SIZE      512
 #define INCREMENTAL_OUTPUT_SIZE     512
 
+// Blocks that are read ahead, per thread, so threads don't wait for the
+// output to be written in order.
+#define FRAME_JOBS_PER_THREAD       2u
+
+#define MIN(X, Y)                   (((X) < (Y)) ? (X) : (Y))
+
+
+/*****************************************************************************
+ * Typedefs
+ ****************************************************************************/
+
+typedef struct
+{
+    ThreadPoolTask_t    task;
+    LzsFrameBlock_t     block;
+    uint8_t           * pIn;
+    uint8_t           * pOut;
+    size_t              outBufferSize;
+    uint8_t             flags;
+    bool                ok;
+} FrameJob_t;
+
 
 /*****************************************************************************
  * Functions
  ****************************************************************************/
 
+/*
+ * Read until the buffer is full or the input ends.
+ */
+static size_t read_full(int fd, uint8_t * pBuffer, size_t len)
+{
+    size_t      count = 0;
+    ssize_t     read_len;
+
+    while (count < len)
+    {
+        read_len = read(fd, pBuffer + count, len - count);
+        if (read_len < 0)
+        {
+            perror("read");
+            exit(4);
+        }
+        if (read_len == 0)
+        {
+            break;
+        }
+        count += read_len;
+    }
+    return count;
+}
+
+static void write_full(int fd, const uint8_t * pBuffer, size_t len)
+{
+    ssize_t     write_len;
+
+    while (len != 0)
+    {
+        write_len = write(fd, pBuffer, len);
+        if (write_len < 0)
+        {
+            perror("write");
+            exit(5);
+        }
+        pBuffer += write_len;
+        len -= write_len;
+    }
+}
+
 #if LZS_USE_INCREMENTAL
 
 /*
  * Use incremental version of the decompression algorithm.
  *
- * The data is input and output in chunks.
+ * The data is input and output in chunks. The first chunk of input is the
+ * data that was read to check for a frame header.
+ *
+ * If index_fd is open, a checkpoint index is written to it, with a checkpoint
+ * every interval bytes of output. Decompression stops at each of those
+ * positions, to save a checkpoint there.
  */
-int main(int argc, char **argv)
+static void decompress_stream(int in_fd, int out_fd, const uint8_t * pPrefix, size_t prefixLen,
+                              int index_fd, uint32_t interval)
 {
-    int in_fd;
-    int out_fd;
     ssize_t read_len;
     ssize_t write_len;
     uint8_t in_buffer[INCREMENTAL_INPUT_SIZE];
     uint8_t out_buffer[INCREMENTAL_OUTPUT_SIZE];
     LzsDecompressParameters_t   decompress_params;
     size_t  out_length;
-
-    if (argc < 3)
-    {
-        printf("Too few arguments\n");
-        exit(1);
-    }
-    in_fd = open(argv[1], O_RDONLY);
-    if (in_fd < 0)
-    {
-        perror("argv[1]");
-        exit(2);
-    }
-    out_fd = open(argv[2], O_WRONLY|O_CREAT|O_TRUNC, 0666);
-    if (out_fd < 0)
-    {
-        perror("argv[2]");
-        exit(3);
-    }
+    uint64_t in_buffer_pos = 0;     // Position in the input of in_buffer
+    uint64_t out_pos = 0;
+    uint64_t next_checkpoint = 0;
+    LzsCheckpoint_t checkpoint;
+    uint8_t index_buffer[LZS_CHECKPOINT_SIZE];
 
     // Initialise
     lzs_decompress_init(&decompress_params);
+    if (index_fd >= 0)
+    {
+        write_full(index_fd, index_buffer, lzs_checkpoint_write_header(index_buffer, interval));
+    }
 
     // Decompress bounded by input buffer size
+    memcpy(in_buffer, pPrefix, prefixLen);
     decompress_params.inPtr = in_buffer;
-    decompress_params.inLength = 0;
+    decompress_params.inLength = prefixLen;
     decompress_params.outPtr = out_buffer;
     decompress_params.outLength = sizeof(out_buffer);
     while (1)
     {
+        if ((index_fd >= 0) && (out_pos == next_checkpoint))
+        {
+            lzs_decompress_save_checkpoint(&decompress_params, in_buffer_pos + (decompress_params.inPtr - in_buffer),
+                                           out_pos, &checkpoint);
+            write_full(index_fd, index_buffer, lzs_checkpoint_write(index_buffer, &checkpoint));
+            next_checkpoint += interval;
+        }
+        if (index_fd >= 0)
+        {
+            decompress_params.outLength = MIN(decompress_params.outLength, next_checkpoint - out_pos);
+        }
         if (decompress_params.inLength == 0)
         {
             read_len = read(in_fd, in_buffer, sizeof(in_buffer));
@@ -89,6 +177,7 @@ int main(int argc, char **argv)
                 perror("read");
                 exit(4);
             }
+            in_buffer_pos += decompress_params.inPtr - in_buffer;
             decompress_params.inPtr = in_buffer;
             decompress_params.inLength = read_len;
         }
@@ -109,6 +198,7 @@ int main(int argc, char **argv)
                 perror("write");
                 exit(5);
             }
+            out_pos += out_length;
             decompress_params.outPtr = out_buffer;
             decompress_params.outLength = sizeof(out_buffer);
         }
@@ -119,8 +209,6 @@ int main(int argc, char **argv)
         }
 #endif
     }
-
-    return 0;
 }
 
 #else
@@ -131,10 +219,9 @@ int main(int argc, char **argv)
  * The whole of the source data must be loaded into memory as a single buffer.
  * The output also goes into a single output buffer in memory.
  */
-int main(int argc, char **argv)
+static void decompress_stream(int in_fd, int out_fd, const uint8_t * pPrefix, size_t prefixLen,
+                              int index_fd, uint32_t interval)
 {
-    int in_fd;
-    int out_fd;
     struct stat stbuf;
     ssize_t read_len;
     ssize_t write_len;
@@ -144,25 +231,15 @@ int main(int argc, char **argv)
     ssize_t outBufferSize;
     size_t  out_length;
 
-    if (argc < 3)
+    (void)pPrefix;
+    (void)prefixLen;
+    (void)interval;
+    if (index_fd >= 0)
     {
-        printf("Too few arguments\n");
+        fprintf(stderr, "An index needs incremental decompression\n");
         exit(1);
     }
-    in_fd = open(argv[1], O_RDONLY);
-    if (in_fd < 0)
-    {
-        perror("argv[1]");
-        exit(2);
-    }
-    out_fd = open(argv[2], O_WRONLY|O_CREAT|O_TRUNC, 0666);
-    if (out_fd < 0)
-    {
-        perror("argv[2]");
-        exit(3);
-    }
-
-    if ((fstat(in_fd, &stbuf) != 0) || (!S_ISREG(stbuf.st_mode)))
+    if ((fstat(in_fd, &stbuf) != 0) || (!S_ISREG(stbuf.st_mode)) || (lseek(in_fd, 0, SEEK_SET) != 0))
     {
         perror("fstat");
         exit(4);
@@ -199,8 +276,344 @@ int main(int argc, char **argv)
         perror("write");
         exit(8);
     }
-
-    return 0;
 }
 
 #endif
+
+/*
+ * Decompress length bytes from offset in the decompressed data of a single
+ * LZS stream, starting from the checkpoint before it in the index.
+ */
+static void decompress_range(int in_fd, int out_fd, int index_fd, uint64_t offset, uint64_t length)
+{
+    struct stat stbuf;
+    uint8_t in_buffer[INCREMENTAL_INPUT_SIZE];
+    uint8_t out_buffer[INCREMENTAL_OUTPUT_SIZE];
+    uint8_t index_buffer[LZS_CHECKPOINT_SIZE];
+    LzsDecompressParameters_t   decompress_params;
+    LzsCheckpoint_t checkpoint;
+    uint32_t interval;
+    uint64_t numCheckpoints;
+    uint64_t skip;
+    size_t  out_length;
+
+    if (
+            (read_full(index_fd, index_buffer, LZS_CHECKPOINT_HEADER_SIZE) != LZS_CHECKPOINT_HEADER_SIZE) ||
+            !lzs_checkpoint_read_header(index_buffer, LZS_CHECKPOINT_HEADER_SIZE, &interval) ||
+            (fstat(index_fd, &stbuf) != 0)
+       )
+    {
+        fprintf(stderr, "Invalid index\n");
+        exit(9);
+    }
+    numCheckpoints = (stbuf.st_size - LZS_CHECKPOINT_HEADER_SIZE) / LZS_CHECKPOINT_SIZE;
+    if (numCheckpoints == 0)
+    {
+        fprintf(stderr, "Invalid index\n");
+        exit(9);
+    }
+    // Checkpoint k is at k * interval. Past the last one, use the last one.
+    if (
+            (lseek(index_fd, LZS_CHECKPOINT_HEADER_SIZE + MIN(offset / interval, numCheckpoints - 1u) * LZS_CHECKPOINT_SIZE,
+                   SEEK_SET) < 0) ||
+            (read_full(index_fd, index_buffer, LZS_CHECKPOINT_SIZE) != LZS_CHECKPOINT_SIZE) ||
+            !lzs_checkpoint_read(index_buffer, &checkpoint) ||
+            (checkpoint.outPos > offset) ||
+            !lzs_decompress_restore_checkpoint(&decompress_params, &checkpoint)
+       )
+    {
+        fprintf(stderr, "Invalid checkpoint\n");
+        exit(9);
+    }
+    if (lseek(in_fd, checkpoint.inPos, SEEK_SET) < 0)
+    {
+        perror("lseek");
+        exit(4);
+    }
+
+    // Decompress from the checkpoint, skipping the output before offset
+    skip = offset - checkpoint.outPos;
+    decompress_params.inLength = 0;
+    while (length != 0)
+    {
+        if (decompress_params.inLength == 0)
+        {
+            decompress_params.inPtr = in_buffer;
+            decompress_params.inLength = read_full(in_fd, in_buffer, sizeof(in_buffer));
+            if ((decompress_params.inLength == 0) && (decompress_params.status & LZS_D_STATUS_INPUT_STARVED))
+            {
+                break;
+            }
+        }
+        if (skip != 0)
+        {
+            skip -= lzs_decompress_skip(&decompress_params, MIN(skip, SIZE_MAX));
+        }
+        else
+        {
+            decompress_params.outPtr = out_buffer;
+            decompress_params.outLength = MIN(length, sizeof(out_buffer));
+            out_length = lzs_decompress_incremental(&decompress_params);
+            write_full(out_fd, out_buffer, out_length);
+            length -= out_length;
+        }
+        if (decompress_params.status & LZS_D_STATUS_END_MARKER)
+        {
+            break;
+        }
+    }
+}
+
+static void frame_decompress_job(ThreadPoolTask_t * pTask)
+{
+    FrameJob_t        * pJob = (FrameJob_t *)pTask;
+
+    pJob->ok = lzs_frame_decompress_block(pJob->pOut, pJob->outBufferSize, pJob->pIn, &pJob->block, pJob->flags);
+}
+
+/*
+ * Decompress the framed container, after its frame header.
+ *
+ * Blocks are read into a ring of jobs, and decompressed on the thread pool.
+ * The oldest job is waited for and written out, then its slot is used for the
+ * next block, so the output is in order while the threads stay busy.
+ */
+static void decompress_framed(int in_fd, int out_fd, const LzsFrameHeader_t * pHeader, unsigned numThreads)
+{
+    ThreadPool_t      * pPool;
+    FrameJob_t        * pJobs;
+    FrameJob_t        * pJob;
+    uint8_t           * pIndex;
+    size_t              indexLen;
+    uint32_t            blockCount = 0;
+    uint32_t            footerBlockCount;
+    size_t              numJobs;
+    size_t              head = 0;           // Count of jobs submitted
+    size_t              tail = 0;           // Count of jobs written out
+    size_t              i;
+    bool                finish = false;
+    uint8_t             buffer[LZS_FRAME_BLOCK_HEADER_SIZE];
+
+    numJobs = (size_t)numThreads * FRAME_JOBS_PER_THREAD;
+    pJobs = calloc(numJobs, sizeof(pJobs[0]));
+    if (pJobs == NULL)
+    {
+        perror("malloc for jobs");
+        exit(6);
+    }
+    for (i = 0; i < numJobs; i++)
+    {
+        pJobs[i].task.pFunc = frame_decompress_job;
+        pJobs[i].pIn = malloc(LZS_COMPRESSED_MAX(pHeader->blockSize));
+        pJobs[i].outBufferSize = pHeader->blockSize;
+        pJobs[i].pOut = malloc(pJobs[i].outBufferSize);
+        pJobs[i].flags = pHeader->flags;
+        if (pJobs[i].pIn == NULL || pJobs[i].pOut == NULL)
+        {
+            perror("malloc for blocks");
+            exit(6);
+        }
+    }
+    pPool = thread_pool_create(numThreads);
+    if (pPool == NULL)
+    {
+        perror("thread pool");
+        exit(6);
+    }
+
+    for (;;)
+    {
+        while (!finish && head - tail < numJobs)
+        {
+            pJob = &pJobs[head % numJobs];
+            if (read_full(in_fd, buffer, sizeof(buffer)) != sizeof(buffer))
+            {
+                fprintf(stderr, "Truncated input\n");
+                exit(9);
+            }
+            if (!lzs_frame_read_block_header(buffer, pHeader, &pJob->block))
+            {
+                if (pJob->block.compressedLen != 0 || pJob->block.rawLen != 0)
+                {
+                    fprintf(stderr, "Invalid header of block %zu\n", (size_t)head);
+                    exit(9);
+                }
+                finish = true;
+                break;
+            }
+            if (read_full(in_fd, pJob->pIn, pJob->block.compressedLen) != pJob->block.compressedLen)
+            {
+                fprintf(stderr, "Truncated input\n");
+                exit(9);
+            }
+            thread_pool_submit(pPool, &pJob->task);
+            head++;
+        }
+        if (tail == head)
+        {
+            break;
+        }
+
+        pJob = &pJobs[tail % numJobs];
+        thread_pool_wait(pPool, &pJob->task);
+        if (!pJob->ok)
+        {
+            fprintf(stderr, "Corrupt data in block %zu\n", (size_t)tail);
+            exit(9);
+        }
+        write_full(out_fd, pJob->pOut, pJob->block.rawLen);
+        tail++;
+        blockCount++;
+    }
+    thread_pool_destroy(pPool);
+
+    // The index isn't needed to stream the data, but check that it is there
+    indexLen = (size_t)blockCount * LZS_FRAME_BLOCK_HEADER_SIZE + LZS_FRAME_FOOTER_SIZE;
+    pIndex = malloc(indexLen);
+    if (pIndex == NULL)
+    {
+        perror("malloc for index");
+        exit(6);
+    }
+    if (
+            (read_full(in_fd, pIndex, indexLen) != indexLen) ||
+            !lzs_frame_read_footer(pIndex + indexLen - LZS_FRAME_FOOTER_SIZE, &footerBlockCount) ||
+            (footerBlockCount != blockCount)
+       )
+    {
+        fprintf(stderr, "Invalid index\n");
+        exit(9);
+    }
+
+    for (i = 0; i < numJobs; i++)
+    {
+        free(pJobs[i].pIn);
+        free(pJobs[i].pOut);
+    }
+    free(pJobs);
+    free(pIndex);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: lzs-decompress [-j threads] [-i index-file [-n interval-KiB]] in-file out-file\n"
+                    "       lzs-decompress -i index-file -r offset,length in-file out-file\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int         in_fd;
+    int         out_fd;
+    int         opt;
+    char      * pEnd;
+    unsigned long value;
+    unsigned    numThreads = 0;
+    int         index_fd = -1;
+    const char * pIndexName = NULL;
+    uint32_t    interval = LZS_CHECKPOINT_INTERVAL_DEFAULT;
+    bool        range = false;
+    uint64_t    rangeOffset = 0;
+    uint64_t    rangeLength = 0;
+    size_t      prefixLen;
+    LzsFrameHeader_t header;
+    uint8_t     prefix[LZS_FRAME_HEADER_SIZE];
+
+    while ((opt = getopt(argc, argv, "j:i:n:r:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'j':
+                value = strtoul(optarg, &pEnd, 10);
+                if (*pEnd != '\0' || value == 0 || value > 1024u)
+                {
+                    usage();
+                }
+                numThreads = value;
+                break;
+            case 'i':
+                pIndexName = optarg;
+                break;
+            case 'n':
+                value = strtoul(optarg, &pEnd, 10);
+                if (*pEnd != '\0' || value == 0 || value > 1024ul * 1024ul)
+                {
+                    usage();
+                }
+                interval = value * 1024u;
+                break;
+            case 'r':
+                rangeOffset = strtoull(optarg, &pEnd, 10);
+                if (*pEnd != ',')
+                {
+                    usage();
+                }
+                rangeLength = strtoull(pEnd + 1, &pEnd, 10);
+                if (*pEnd != '\0')
+                {
+                    usage();
+                }
+                range = true;
+                break;
+            default:
+                usage();
+        }
+    }
+    if (argc - optind < 2)
+    {
+        printf("Too few arguments\n");
+        exit(1);
+    }
+    if (range && pIndexName == NULL)
+    {
+        usage();
+    }
+    in_fd = open(argv[optind], O_RDONLY);
+    if (in_fd < 0)
+    {
+        perror(argv[optind]);
+        exit(2);
+    }
+    out_fd = open(argv[optind + 1], O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if (out_fd < 0)
+    {
+        perror(argv[optind + 1]);
+        exit(3);
+    }
+
+    if (pIndexName != NULL)
+    {
+        index_fd = range ? open(pIndexName, O_RDONLY) : open(pIndexName, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+        if (index_fd < 0)
+        {
+            perror(pIndexName);
+            exit(2);
+        }
+    }
+    if (range)
+    {
+        decompress_range(in_fd, out_fd, index_fd, rangeOffset, rangeLength);
+        return 0;
+    }
+
+    prefixLen = read_full(in_fd, prefix, sizeof(prefix));
+    if (lzs_frame_read_header(prefix, prefixLen, &header))
+    {
+        if (index_fd >= 0)
+        {
+            fprintf(stderr, "The framed container has its own index\n");
+            exit(1);
+        }
+        if (numThreads == 0)
+        {
+            numThreads = thread_pool_default_threads();
+        }
+        decompress_framed(in_fd, out_fd, &header, numThreads);
+    }
+    else
+    {
+        decompress_stream(in_fd, out_fd, prefix, prefixLen, index_fd, interval);
+    }
+
+    return 0;
+}
@@ -0,0 +1,213 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Thread pool for the utilities
+ *
+ * Without POSIX threads, or with only one thread, each task is run as soon
+ * as it is submitted, on the caller's thread.
+ *
+ ****************************************************************************/
+
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "lzs-thread-pool.h"
+
+#include <stdlib.h>
+
+#include <unistd.h>
+
+#if HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+
+/*****************************************************************************
+ * Typedefs
+ ****************************************************************************/
+
+struct ThreadPool
+{
+    unsigned            numThreads;
+#if HAVE_PTHREAD
+    pthread_mutex_t     mutex;
+    pthread_cond_t      workCond;           // Signalled when a task is queued, or on stop
+    pthread_cond_t      doneCond;           // Signalled when a task is done
+    ThreadPoolTask_t  * pHead;
+    ThreadPoolTask_t  * pTail;
+    bool                stop;
+    pthread_t         * pThreads;
+#endif
+};
+
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+#if HAVE_PTHREAD
+
+static void * thread_pool_worker(void * pArg)
+{
+    ThreadPool_t      * pPool = pArg;
+    ThreadPoolTask_t  * pTask;
+
+    pthread_mutex_lock(&pPool->mutex);
+    for (;;)
+    {
+        while (pPool->pHead == NULL && !pPool->stop)
+        {
+            pthread_cond_wait(&pPool->workCond, &pPool->mutex);
+        }
+        if (pPool->pHead == NULL)
+        {
+            break;
+        }
+        pTask = pPool->pHead;
+        pPool->pHead = pTask->pNext;
+        if (pPool->pHead == NULL)
+        {
+            pPool->pTail = NULL;
+        }
+        pthread_mutex_unlock(&pPool->mutex);
+
+        pTask->pFunc(pTask);
+
+        pthread_mutex_lock(&pPool->mutex);
+        pTask->done = true;
+        pthread_cond_broadcast(&pPool->doneCond);
+    }
+    pthread_mutex_unlock(&pPool->mutex);
+    return NULL;
+}
+
+#endif
+
+/*
+ * Number of threads to use when the user doesn't say: one per online CPU.
+ */
+unsigned thread_pool_default_threads(void)
+{
+    long        numCpus;
+
+    numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return (numCpus > 0) ? (unsigned)numCpus : 1u;
+}
+
+ThreadPool_t * thread_pool_create(unsigned numThreads)
+{
+    ThreadPool_t      * pPool;
+
+    pPool = calloc(1, sizeof(*pPool));
+    if (pPool == NULL)
+    {
+        return NULL;
+    }
+#if HAVE_PTHREAD
+    if (numThreads > 1u)
+    {
+        pPool->pThreads = calloc(numThreads, sizeof(pPool->pThreads[0]));
+        if (pPool->pThreads == NULL)
+        {
+            free(pPool);
+            return NULL;
+        }
+        pthread_mutex_init(&pPool->mutex, NULL);
+        pthread_cond_init(&pPool->workCond, NULL);
+        pthread_cond_init(&pPool->doneCond, NULL);
+        for (pPool->numThreads = 0; pPool->numThreads < numThreads; pPool->numThreads++)
+        {
+            if (pthread_create(&pPool->pThreads[pPool->numThreads], NULL, thread_pool_worker, pPool) != 0)
+            {
+                // Carry on with the threads that were created
+                break;
+            }
+        }
+    }
+#else
+    (void)numThreads;
+#endif
+    return pPool;
+}
+
+void thread_pool_submit(ThreadPool_t * pPool, ThreadPoolTask_t * pTask)
+{
+    pTask->pNext = NULL;
+    pTask->done = false;
+#if HAVE_PTHREAD
+    if (pPool->numThreads != 0)
+    {
+        pthread_mutex_lock(&pPool->mutex);
+        if (pPool->pTail != NULL)
+        {
+            pPool->pTail->pNext = pTask;
+        }
+        else
+        {
+            pPool->pHead = pTask;
+        }
+        pPool->pTail = pTask;
+        pthread_cond_signal(&pPool->workCond);
+        pthread_mutex_unlock(&pPool->mutex);
+        return;
+    }
+#endif
+    pTask->pFunc(pTask);
+    pTask->done = true;
+}
+
+/*
+ * Wait until a submitted task has been run.
+ */
+void thread_pool_wait(ThreadPool_t * pPool, ThreadPoolTask_t * pTask)
+{
+#if HAVE_PTHREAD
+    if (pPool->numThreads != 0)
+    {
+        pthread_mutex_lock(&pPool->mutex);
+        while (!pTask->done)
+        {
+            pthread_cond_wait(&pPool->doneCond, &pPool->mutex);
+        }
+        pthread_mutex_unlock(&pPool->mutex);
+    }
+#else
+    (void)pPool;
+    (void)pTask;
+#endif
+}
+
+/*
+ * Stop the worker threads, once they have run all the queued tasks, and free
+ * the pool.
+ */
+void thread_pool_destroy(ThreadPool_t * pPool)
+{
+#if HAVE_PTHREAD
+    unsigned    i;
+
+    if (pPool->pThreads != NULL)
+    {
+        pthread_mutex_lock(&pPool->mutex);
+        pPool->stop = true;
+        pthread_cond_broadcast(&pPool->workCond);
+        pthread_mutex_unlock(&pPool->mutex);
+        for (i = 0; i < pPool->numThreads; i++)
+        {
+            pthread_join(pPool->pThreads[i], NULL);
+        }
+        pthread_cond_destroy(&pPool->doneCond);
+        pthread_cond_destroy(&pPool->workCond);
+        pthread_mutex_destroy(&pPool->mutex);
+        free(pPool->pThreads);
+    }
+#endif
+    free(pPool);
+}
@@ -0,0 +1,52 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Thread pool for the utilities
+ *
+ * A fixed number of worker threads run tasks from a FIFO queue. The caller
+ * waits for each task on its own, so it can collect results in the order
+ * that it submitted them, while later tasks are still running.
+ *
+ ****************************************************************************/
+
+#ifndef __LZS_THREAD_POOL_H
+#define __LZS_THREAD_POOL_H
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include <stdbool.h>
+
+
+/*****************************************************************************
+ * Typedefs
+ ****************************************************************************/
+
+typedef struct ThreadPoolTask ThreadPoolTask_t;
+
+// Embed this as the first member of a task's own structure, and set pFunc
+// before submitting it.
+struct ThreadPoolTask
+{
+    void             (* pFunc)(ThreadPoolTask_t * pTask);
+    ThreadPoolTask_t  * pNext;
+    bool                done;
+};
+
+typedef struct ThreadPool ThreadPool_t;
+
+
+/*****************************************************************************
+ * Function prototypes
+ ****************************************************************************/
+
+unsigned thread_pool_default_threads(void);
+ThreadPool_t * thread_pool_create(unsigned numThreads);
+void thread_pool_submit(ThreadPool_t * pPool, ThreadPoolTask_t * pTask);
+void thread_pool_wait(ThreadPool_t * pPool, ThreadPoolTask_t * pTask);
+void thread_pool_destroy(ThreadPool_t * pPool);
+
+
+#endif // !defined(__LZS_THREAD_POOL_H)
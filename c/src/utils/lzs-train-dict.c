@@ -0,0 +1,427 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Training of a dictionary for compression of small data
+ *
+ * Usage: lzs-train-dict [-l level] dictionary-file sample-file...
+ *
+ * Each sample file holds one typical message. This picks up to
+ * LZS_MAX_HISTORY_SIZE bytes of content from the samples, that is common to
+ * many of them, and writes it to the dictionary file, for use with
+ * lzs_compress_set_dictionary() and lzs_decompress_set_dictionary().
+ *
+ * Content is picked in segments. Segments are scored by how many samples
+ * contain each of their substrings of a few bytes ("d-mers"), and picked
+ * greedily, best first. The best segments go at the end of the dictionary,
+ * nearest to the data, where they can be reached with short offsets (up to
+ * 127), which take 4 fewer bits than long offsets.
+ *
+ * The segment and d-mer sizes are chosen by compressing the samples with the
+ * real encoder. If there are enough samples, some are held out of training
+ * and used for that, so that the reported ratio is what can be expected for
+ * new data.
+ *
+ ****************************************************************************/
+
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include "lzs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+/*****************************************************************************
+ * Defines
+ ****************************************************************************/
+
+#define ARRAY_ENTRIES(a)            (sizeof(a)/sizeof((a)[0]))
+
+#define DMER_HASH_BITS              20u
+#define DMER_HASH_SIZE              (1u << DMER_HASH_BITS)
+
+// With at least this many samples, every HOLD_OUT_INTERVAL'th sample is held
+// out of training, to measure the ratio.
+#define HOLD_OUT_MIN_SAMPLES        16u
+#define HOLD_OUT_INTERVAL           8u
+
+
+/*****************************************************************************
+ * Typedefs
+ ****************************************************************************/
+
+typedef struct
+{
+    uint8_t           * data;               // All samples, one after another
+    size_t            * offsets;            // Start of each sample in data[], then the end of the last one
+    size_t              count;              // Number of samples
+    size_t              maxSize;            // Size of the largest sample
+} SampleSet_t;
+
+
+/*****************************************************************************
+ * Tables
+ ****************************************************************************/
+
+static const unsigned dmerSizes[] = { 4u, 6u, 8u };
+static const unsigned segmentSizes[] = { 16u, 32u, 64u, 128u, 256u };
+
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+// Return true if sample i is used for training, with every holdOut'th sample
+// held out. holdOut 0 means all samples are used.
+static bool is_training_sample(size_t i, size_t holdOut)
+{
+    return (holdOut == 0) || ((i % holdOut) != holdOut - 1u);
+}
+
+// Return a hash of the d bytes (up to 8) at p.
+static uint32_t dmer_hash(const uint8_t * p, unsigned d)
+{
+    uint64_t    value = 0;
+    unsigned    i;
+
+    for (i = 0; i < d; i++)
+    {
+        value = (value << 8u) | p[i];
+    }
+    return (uint32_t)((value * 0x9E3779B97F4A7C15ull) >> (64u - DMER_HASH_BITS));
+}
+
+// Read a file into the sample set.
+static void load_sample(SampleSet_t * pSet, const char * pName)
+{
+    static size_t   capacity = 0;
+    struct stat     stbuf;
+    ssize_t         read_len;
+    size_t          size;
+    int             fd;
+
+    fd = open(pName, O_RDONLY);
+    if (fd < 0 || fstat(fd, &stbuf) != 0 || !S_ISREG(stbuf.st_mode))
+    {
+        perror(pName);
+        exit(2);
+    }
+    size = pSet->offsets[pSet->count];
+    if (size + stbuf.st_size > capacity)
+    {
+        capacity = 2u * (size + stbuf.st_size);
+        pSet->data = (uint8_t *)realloc(pSet->data, capacity);
+        if (pSet->data == NULL)
+        {
+            perror("realloc for sample data");
+            exit(3);
+        }
+    }
+    read_len = read(fd, pSet->data + size, stbuf.st_size);
+    if (read_len != stbuf.st_size)
+    {
+        perror("read");
+        exit(4);
+    }
+    close(fd);
+    pSet->count++;
+    pSet->offsets[pSet->count] = size + read_len;
+    if ((size_t)read_len > pSet->maxSize)
+    {
+        pSet->maxSize = read_len;
+    }
+}
+
+// Return the total compressed size of the samples, either the training samples
+// or the held out ones, compressed one by one with the dictionary.
+static size_t compressed_size(const SampleSet_t * pSet, size_t holdOut, bool heldOut,
+                              const uint8_t * pDict, size_t dictLen, uint8_t level)
+{
+    static LzsCompressParameters_t  compress_params;
+    static uint8_t    * outBufferPtr = NULL;
+    static uint8_t    * blobPtr = NULL;
+    size_t              blobSize;
+    size_t              outBufferSize;
+    size_t              total = 0;
+    size_t              i;
+
+    outBufferSize = LZS_COMPRESSED_MAX(pSet->maxSize);
+    if (outBufferPtr == NULL)
+    {
+        outBufferPtr = (uint8_t *)malloc(outBufferSize);
+        if (outBufferPtr == NULL)
+        {
+            perror("malloc for output data");
+            exit(3);
+        }
+    }
+
+    // Hash the dictionary once, then load it for each sample.
+    lzs_compress_init_level(&compress_params, level);
+    lzs_compress_set_dictionary(&compress_params, pDict, dictLen);
+    blobSize = lzs_compress_dictionary_size(&compress_params);
+    blobPtr = (uint8_t *)realloc(blobPtr, blobSize);
+    if (blobPtr == NULL)
+    {
+        perror("realloc for dictionary");
+        exit(3);
+    }
+    lzs_compress_save_dictionary(&compress_params, blobPtr, blobSize);
+
+    for (i = 0; i < pSet->count; i++)
+    {
+        if (is_training_sample(i, holdOut) == heldOut)
+        {
+            continue;
+        }
+        lzs_compress_load_dictionary(&compress_params, blobPtr, blobSize);
+        compress_params.inPtr = pSet->data + pSet->offsets[i];
+        compress_params.inLength = pSet->offsets[i + 1u] - pSet->offsets[i];
+        compress_params.outPtr = outBufferPtr;
+        compress_params.outLength = outBufferSize;
+        while ((compress_params.status & LZS_C_STATUS_END_MARKER) == 0)
+        {
+            total += lzs_compress_incremental(&compress_params, true);
+        }
+    }
+    return total;
+}
+
+// Return the total size of the samples, either the training samples or the
+// held out ones.
+static size_t sample_size(const SampleSet_t * pSet, size_t holdOut, bool heldOut)
+{
+    size_t  total = 0;
+    size_t  i;
+
+    for (i = 0; i < pSet->count; i++)
+    {
+        if (is_training_sample(i, holdOut) != heldOut)
+        {
+            total += pSet->offsets[i + 1u] - pSet->offsets[i];
+        }
+    }
+    return total;
+}
+
+// Return the compression ratio, of compressed size to raw size.
+static double ratio(size_t size, size_t rawSize)
+{
+    return (rawSize != 0) ? (double)size / rawSize : 0;
+}
+
+// Train a dictionary of up to dictSize bytes from the training samples, with
+// d-mers of size d and segments of size k. It goes at the end of pDict[], and
+// its length is returned.
+static size_t train(const SampleSet_t * pSet, size_t holdOut, unsigned d, unsigned k,
+                    uint8_t * pDict, size_t dictSize)
+{
+    static uint32_t   * freq = NULL;
+    static uint32_t   * lastSample = NULL;
+    static uint32_t   * hashes = NULL;
+    static size_t       hashesSize = 0;
+    size_t              dataSize;
+    size_t              dictLen = 0;
+    size_t              i;
+    size_t              pos;
+    size_t              start;
+    size_t              end;
+    size_t              best_start = 0;
+    size_t              best_end = 0;
+    uint64_t            score;
+    uint64_t            best_score;
+
+    if (freq == NULL)
+    {
+        freq = (uint32_t *)malloc(DMER_HASH_SIZE * sizeof(freq[0]));
+        lastSample = (uint32_t *)malloc(DMER_HASH_SIZE * sizeof(lastSample[0]));
+        if (freq == NULL || lastSample == NULL)
+        {
+            perror("malloc for d-mer counts");
+            exit(3);
+        }
+    }
+    dataSize = pSet->offsets[pSet->count];
+    if (dataSize > hashesSize)
+    {
+        hashesSize = dataSize;
+        hashes = (uint32_t *)realloc(hashes, hashesSize * sizeof(hashes[0]));
+        if (hashes == NULL)
+        {
+            perror("realloc for d-mer hashes");
+            exit(3);
+        }
+    }
+
+    // Count the number of training samples that contain each d-mer.
+    memset(freq, 0, DMER_HASH_SIZE * sizeof(freq[0]));
+    memset(lastSample, 0, DMER_HASH_SIZE * sizeof(lastSample[0]));
+    for (i = 0; i < pSet->count; i++)
+    {
+        for (pos = pSet->offsets[i]; pos + d <= pSet->offsets[i + 1u]; pos++)
+        {
+            hashes[pos] = dmer_hash(pSet->data + pos, d);
+            if (is_training_sample(i, holdOut) && lastSample[hashes[pos]] != i + 1u)
+            {
+                lastSample[hashes[pos]] = i + 1u;
+                freq[hashes[pos]]++;
+            }
+        }
+    }
+
+    // Repeatedly pick the segment with the best score, the sum of the counts
+    // of the d-mers in it. Then clear the counts of those d-mers, so that
+    // later segments add different content.
+    while (dictLen < dictSize)
+    {
+        best_score = 0;
+        for (i = 0; i < pSet->count; i++)
+        {
+            if (!is_training_sample(i, holdOut) ||
+                pSet->offsets[i + 1u] - pSet->offsets[i] < k)
+            {
+                continue;
+            }
+            // Slide a window of k bytes, that holds k - d + 1 d-mers.
+            score = 0;
+            for (pos = pSet->offsets[i]; pos + d <= pSet->offsets[i + 1u]; pos++)
+            {
+                score += freq[hashes[pos]];
+                if (pos >= pSet->offsets[i] + k - d)
+                {
+                    if (score > best_score)
+                    {
+                        best_score = score;
+                        best_start = pos - (k - d);
+                        best_end = pos + d;
+                    }
+                    score -= freq[hashes[pos - (k - d)]];
+                }
+            }
+        }
+        if (best_score == 0)
+        {
+            break;
+        }
+        // Trim d-mers that add nothing from both ends of the segment.
+        for (start = best_start; freq[hashes[start]] == 0; start++)
+            ;
+        for (end = best_end; freq[hashes[end - d]] == 0; end--)
+            ;
+        for (pos = start; pos + d <= end; pos++)
+        {
+            freq[hashes[pos]] = 0;
+        }
+        // Segments that are picked first go at the end of the dictionary.
+        // If the last one doesn't fit, keep the end of it.
+        if (end - start > dictSize - dictLen)
+        {
+            start = end - (dictSize - dictLen);
+        }
+        dictLen += end - start;
+        memcpy(pDict + dictSize - dictLen, pSet->data + start, end - start);
+    }
+    return dictLen;
+}
+
+int main(int argc, char **argv)
+{
+    SampleSet_t     samples;
+    uint8_t         dict[LZS_MAX_HISTORY_SIZE];
+    size_t          dictLen;
+    size_t          holdOut;
+    size_t          rawSize;
+    size_t          noDictSize;
+    size_t          size;
+    size_t          best_size = SIZE_MAX;
+    unsigned        best_d = 0;
+    unsigned        best_k = 0;
+    unsigned        di;
+    unsigned        ki;
+    uint8_t         level = LZS_COMPRESS_LEVEL_DEFAULT;
+    int             out_fd;
+    int             opt;
+
+    while ((opt = getopt(argc, argv, "l:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'l':
+                level = atoi(optarg);
+                break;
+            default:
+                printf("Usage: %s [-l level] dictionary-file sample-file...\n", argv[0]);
+                exit(1);
+        }
+    }
+    if (argc - optind < 2)
+    {
+        printf("Too few arguments\n");
+        exit(1);
+    }
+
+    memset(&samples, 0, sizeof(samples));
+    samples.offsets = (size_t *)calloc(argc - optind, sizeof(samples.offsets[0]));
+    if (samples.offsets == NULL)
+    {
+        perror("calloc for sample offsets");
+        exit(3);
+    }
+    for (opt = optind + 1; opt < argc; opt++)
+    {
+        load_sample(&samples, argv[opt]);
+    }
+
+    // Choose the d-mer and segment sizes that give the smallest output.
+    holdOut = (samples.count >= HOLD_OUT_MIN_SAMPLES) ? HOLD_OUT_INTERVAL : 0;
+    rawSize = sample_size(&samples, holdOut, holdOut != 0);
+    noDictSize = compressed_size(&samples, holdOut, holdOut != 0, dict, 0, level);
+    for (di = 0; di < ARRAY_ENTRIES(dmerSizes); di++)
+    {
+        for (ki = 0; ki < ARRAY_ENTRIES(segmentSizes); ki++)
+        {
+            dictLen = train(&samples, holdOut, dmerSizes[di], segmentSizes[ki], dict, sizeof(dict));
+            size = compressed_size(&samples, holdOut, holdOut != 0, dict + sizeof(dict) - dictLen, dictLen, level);
+            printf("d-mer %u, segment %3u: dictionary %4zu bytes, ratio %.3f\n",
+                   dmerSizes[di], segmentSizes[ki], dictLen, ratio(size, rawSize));
+            if (size < best_size)
+            {
+                best_size = size;
+                best_d = dmerSizes[di];
+                best_k = segmentSizes[ki];
+            }
+        }
+    }
+
+    // Train the final dictionary from all of the samples.
+    dictLen = train(&samples, 0, best_d, best_k, dict, sizeof(dict));
+    out_fd = open(argv[optind], O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if (out_fd < 0)
+    {
+        perror(argv[optind]);
+        exit(5);
+    }
+    if (write(out_fd, dict + sizeof(dict) - dictLen, dictLen) != (ssize_t)dictLen)
+    {
+        perror("write");
+        exit(6);
+    }
+    close(out_fd);
+
+    printf("%zu samples, %zu bytes%s\n", samples.count, rawSize,
+           holdOut ? " held out of training" : " (too few to hold any out of training)");
+    printf("Ratio without dictionary %.3f, with dictionary %.3f (d-mer %u, segment %u, level %u)\n",
+           ratio(noDictSize, rawSize), ratio(best_size, rawSize), best_d, best_k, level);
+    printf("Wrote %zu byte dictionary to %s\n", dictLen, argv[optind]);
+
+    return 0;
+}